@@ -0,0 +1,17 @@
+#include <L/src/engine/Resource.inl>
+#include <L/src/rendering/Animation.h>
+
+using namespace L;
+
+static Symbol tolerance_symbol("tol");
+
+void animation_reduce_transformer(const ResourceSlot& slot, Animation::Intermediate& intermediate) {
+  L_SCOPE_MARKER("animation_reduce");
+  float tolerance = 1e-3f;
+  slot.parameter(tolerance_symbol, tolerance);
+  animation_reduce_keys(intermediate, tolerance);
+}
+
+void animation_reduce_module_init() {
+  ResourceLoading<Animation>::add_transformer(animation_reduce_transformer);
+}
@@ -0,0 +1,4 @@
+add_module(
+  animation_reduce
+  CONDITION ${DEV_DBG}
+)
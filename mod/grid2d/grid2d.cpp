@@ -54,15 +54,17 @@ Array<Vector2i> Grid2d::find_path(const Parameters& parameters) {
   }
 
   while(true) {
-    Table<Vector2i, Node>::Slot current(0, Vector2i());
+    Table<Vector2i, Node>::Slot current{Vector2i()};
+    bool has_current = false;
     for(const auto& node : _nodes) {
       if(node.value().status == NodeStatus::Open &&
-        (current.empty() || node.value().f_score < current.value().f_score)) {
+        (!has_current || node.value().f_score < current.value().f_score)) {
         current = node;
+        has_current = true;
       }
     }
 
-    if(current.empty()) {
+    if(!has_current) {
       // No more open nodes
       return Array<Vector2i>{};
     }
@@ -117,15 +119,17 @@ Array<Vector2i> Grid2d::find_zone(const Parameters& parameters) {
   }
 
   while(true) {
-    Table<Vector2i, Node>::Slot current(0, Vector2i());
+    Table<Vector2i, Node>::Slot current{Vector2i()};
+    bool has_current = false;
     for(const auto& node : _nodes) {
       if(node.value().status == NodeStatus::Open) {
         current = node;
+        has_current = true;
         break;
       }
     }
 
-    if(current.empty()) {
+    if(!has_current) {
       // No more open nodes
       Array<Vector2i> zone;
       for(const auto& node : _nodes) {
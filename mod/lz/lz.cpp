@@ -1,104 +1,435 @@
-#include <L/src/container/Buffer.h>
+#include "lz.h"
+
 #include <L/src/macros.h>
 #include <L/src/math/math.h>
-#include <L/src/stream/CFileStream.h>
+#include <L/src/system/intrinsics.h>
+#include <L/src/system/Memory.h>
 #include <L/src/text/compression.h>
 
 using namespace L;
 
-static size_t equal_until(const uint8_t* a, const uint8_t* b, size_t size) {
-  // Number of bytes a and b share, size is max value
-  if(size >= 8 && *(uint64_t*)a == *(uint64_t*)b) {
-    size_t wtr(8);
+static const uint32_t lz_magic = 0x315a4c4c; // LLZ1
+static const uint32_t raw_flag = 1u << 31;
+static const uint32_t min_match = 4;
+static const uint32_t max_distance = 0xffff;
+static const uint32_t lazy_level = 7;
+static const uint32_t buffer_size = Lz::window_size + Lz::block_size;
+
+static inline uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+static inline uint32_t hash4(const uint8_t* p, uint32_t bits) {
+  return (read32(p) * 2654435761u) >> (32 - bits);
+}
+static inline size_t count_equal(const uint8_t* a, const uint8_t* b, const uint8_t* b_end) {
+  const uint8_t* b_start(b);
+  while(b + 8 <= b_end) {
+    uint64_t x, y;
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+    if(const uint64_t diff = x ^ y) {
+      return (b - b_start) + (bsf(diff) >> 3);
+    }
     a += 8;
     b += 8;
-    while(wtr < size && *a++ == *b++) {
-      wtr++;
-    }
-    return wtr;
-  } else {
-    return 0;
   }
+  while(b < b_end && *a == *b) {
+    a++;
+    b++;
+  }
+  return b - b_start;
+}
+static inline uint8_t* write_length(uint8_t* out, size_t length) {
+  for(; length >= 255; length -= 255) {
+    *out++ = 255;
+  }
+  *out++ = uint8_t(length);
+  return out;
 }
-static const uint8_t* find_pattern(const uint8_t* haystack, const uint8_t* needle, size_t needle_size, size_t* pattern_size) {
-  const uint8_t* pattern(nullptr);
-  *pattern_size = 0;
-  while((haystack + *pattern_size) < needle) {
-    const size_t eq_size(equal_until(haystack, needle, min<size_t>(needle_size, needle - haystack)));
-    if(eq_size > *pattern_size) {
-      pattern = haystack;
-      *pattern_size = eq_size;
+static inline bool read_length(const uint8_t*& in, const uint8_t* in_end, size_t& length) {
+  uint8_t byte;
+  do {
+    if(in >= in_end) {
+      return false;
+    }
+    byte = *in++;
+    length += byte;
+  } while(byte == 255);
+  return true;
+}
+static inline size_t max_compressed_size(size_t size) {
+  return size + size / 255 + 16;
+}
+
+// Copies that may write up to 16 bytes past the end are only used far enough from the end of the output
+static bool decompress_sequences(const uint8_t* in, size_t in_size, uint8_t* out, size_t out_size, const uint8_t* out_start) {
+  const uint8_t* const in_end(in + in_size);
+  uint8_t* const out_end(out + out_size);
+  while(true) {
+    if(in >= in_end) {
+      return false;
+    }
+    const uint8_t token(*in++);
+
+    size_t literal_length(token >> 4);
+    if(literal_length == 15 && !read_length(in, in_end, literal_length)) {
+      return false;
+    }
+    if(literal_length > size_t(in_end - in) || literal_length > size_t(out_end - out)) {
+      return false;
+    }
+    if(literal_length <= 16 && in_end - in >= 16 && out_end - out >= 16) {
+      memcpy(out, in, 16);
     } else {
-      haystack++;
+      memcpy(out, in, literal_length);
+    }
+    in += literal_length;
+    out += literal_length;
+
+    if(in == in_end) { // Last sequence has no match
+      return out == out_end;
     }
+    if(in_end - in < 2) {
+      return false;
+    }
+    const size_t distance(size_t(in[0]) | (size_t(in[1]) << 8));
+    in += 2;
+    size_t match_length(token & 15);
+    if(match_length == 15 && !read_length(in, in_end, match_length)) {
+      return false;
+    }
+    match_length += min_match;
+    if(distance == 0 || distance > size_t(out - out_start) || match_length > size_t(out_end - out)) {
+      return false;
+    }
+
+    const uint8_t* match(out - distance);
+    uint8_t* const match_end(out + match_length);
+    if(distance >= 16 && out_end - match_end >= 16) {
+      do {
+        memcpy(out, match, 16);
+        out += 16;
+        match += 16;
+      } while(out < match_end);
+    } else if(distance >= 8 && out_end - match_end >= 8) {
+      do {
+        memcpy(out, match, 8);
+        out += 8;
+        match += 8;
+      } while(out < match_end);
+    } else { // Overlapping copy repeating a short pattern
+      while(out < match_end) {
+        *out++ = *match++;
+      }
+    }
+    out = match_end;
   }
-  return pattern;
 }
-static void output_raw(const uint8_t* data, size_t size, Stream& out_stream) {
-  while(size) {
-    const uint16_t offset(0), chunk_size(uint16_t(min<size_t>(size, 0xffff)));
-    out_stream.write(&offset, sizeof(offset));
-    out_stream.write(&chunk_size, sizeof(chunk_size));
-    out_stream.write(data, chunk_size);
 
-    data += chunk_size;
-    size -= chunk_size;
+LzCompressStream::LzCompressStream(Stream& out_stream, uint32_t level, size_t size_hint)
+  : _out_stream(out_stream), _level(clamp(level, Lz::min_level, Lz::max_level)),
+  _base(0), _history(0), _end(0), _finished(false) {
+  // Tables don't need to be bigger than the input
+  _hash_bits = size_hint > 0 ? clamp<uint32_t>(clog2(uint32_t(min<size_t>(size_hint, Lz::window_size))), 10, 16) : 16;
+  _chain_mask = (1 << _hash_bits) - 1;
+  _head = Memory::alloc_type_zero<uint32_t>(size_t(1) << _hash_bits);
+  _chain = Memory::alloc_type_zero<uint32_t>(size_t(1) << _hash_bits);
+  _buffer = Memory::alloc_type<uint8_t>(buffer_size);
+  _output = Memory::alloc_type<uint8_t>(max_compressed_size(Lz::block_size));
+  _out_stream.write(&lz_magic, sizeof(lz_magic));
+}
+LzCompressStream::~LzCompressStream() {
+  L_ASSERT(_finished);
+  Memory::free_type(_head, size_t(1) << _hash_bits);
+  Memory::free_type(_chain, size_t(1) << _hash_bits);
+  Memory::free_type(_buffer, buffer_size);
+  Memory::free_type(_output, max_compressed_size(Lz::block_size));
+}
+size_t LzCompressStream::write(const void* data_void, size_t size) {
+  const uint8_t* data((const uint8_t*)data_void);
+  const size_t written(size);
+  while(size > 0) {
+    if(_end == buffer_size) { // Keep only the window before the next block
+      const uint32_t shift(_end - Lz::window_size);
+      memmove(_buffer, _buffer + shift, Lz::window_size);
+      _base += shift;
+      _history -= shift;
+      _end -= shift;
+    }
+    const size_t chunk(min<size_t>(size, Lz::block_size - (_end - _history)));
+    memcpy(_buffer + _end, data, chunk);
+    _end += uint32_t(chunk);
+    data += chunk;
+    size -= chunk;
+    if(_end - _history == Lz::block_size) {
+      compress_block();
+    }
   }
+  return written;
 }
-static void lz_compress(const void* in_data_void, size_t in_size, Stream& out_stream) {
-  const uint8_t* in_data_start((uint8_t*)in_data_void);
-  const uint8_t* in_data(in_data_start);
-  const uint8_t* in_data_needle(in_data);
-  while(in_size > 0) {
-    size_t pattern_size;
-    if(const uint8_t* pattern = find_pattern(max(in_data_start, in_data_needle - 0x2000), in_data_needle, in_size, &pattern_size)) {
-      if(in_data != in_data_needle) {
-        output_raw(in_data, in_data_needle - in_data, out_stream);
+void LzCompressStream::finish() {
+  L_ASSERT(!_finished);
+  if(_end > _history) {
+    compress_block();
+  }
+  const uint32_t end_header[2] {0, 0};
+  _out_stream.write(end_header, sizeof(end_header));
+  _finished = true;
+}
+void LzCompressStream::compress_block() {
+  const uint32_t size(_end - _history);
+  const size_t compressed_size(compress_sequences(_output));
+  if(compressed_size < size) {
+    const uint32_t header[2] {uint32_t(compressed_size), size};
+    _out_stream.write(header, sizeof(header));
+    _out_stream.write(_output, compressed_size);
+  } else {
+    const uint32_t header[2] {size | raw_flag, size};
+    _out_stream.write(header, sizeof(header));
+    _out_stream.write(_buffer + _history, size);
+  }
+  _history = _end;
+}
+// Returns the longest match found within the level's search depth and adds ip to the chains
+uint32_t LzCompressStream::find_match(const uint8_t* ip, const uint8_t* end, uint32_t& best_distance) {
+  const uint32_t max_depth(1u << (_level - 1)), nice_length(32u << (_level / 3));
+  const uint32_t position(_base + uint32_t(ip - _buffer));
+  const uint32_t hash(hash4(ip, _hash_bits));
+  const uint32_t available(min<uint32_t>(max_distance, uint32_t(ip - _buffer)));
+  uint32_t candidate(_head[hash]), previous_distance(0), best_length(0);
+  for(uint32_t depth(0); depth < max_depth; depth++) {
+    const uint32_t distance(position - candidate);
+    // Chains are ordered from closest to farthest, anything else was overwritten
+    if(distance <= previous_distance || distance > available) {
+      break;
+    }
+    const uint8_t* match(ip - distance);
+    if(read32(match) == read32(ip)) {
+      const uint32_t length(uint32_t(min_match + count_equal(match + min_match, ip + min_match, end)));
+      if(length > best_length) {
+        best_length = length;
+        best_distance = distance;
+        if(length >= nice_length) {
+          break;
+        }
       }
-      {
-        const uint16_t offset(uint16_t(in_data_needle - pattern)), size((uint16_t)pattern_size);
-        L_ASSERT(!offset || size <= offset);
-        out_stream.write(&offset, sizeof(offset));
-        out_stream.write(&size, sizeof(size));
-        in_data_needle += pattern_size;
-        in_data = in_data_needle;
-        in_size -= pattern_size;
+    }
+    previous_distance = distance;
+    candidate = _chain[candidate & _chain_mask];
+  }
+  _chain[position & _chain_mask] = _head[hash];
+  _head[hash] = position;
+  return best_length;
+}
+size_t LzCompressStream::compress_sequences(uint8_t* out_start) {
+  uint8_t* out(out_start);
+  const uint8_t* const end(_buffer + _end);
+  const uint8_t* const match_limit(_end - _history >= 12 ? end - 12 : _buffer + _history); // Leaves room to read hashes
+  const uint8_t* anchor(_buffer + _history);
+  const uint8_t* ip(anchor);
+
+  while(ip < match_limit) {
+    uint32_t distance(0);
+    uint32_t length(find_match(ip, end, distance));
+    if(length < min_match) {
+      // Skip faster and faster through incompressible data, higher levels wait longer before skipping
+      ip += (_level < lazy_level) ? 1 + ((ip - anchor) >> (5 + _level)) : 1;
+      continue;
+    }
+
+    // Higher levels look for a longer match starting at the next byte before committing
+    const uint8_t* hashed_end(ip + 1);
+    while(_level >= lazy_level && ip + 1 < match_limit) {
+      uint32_t next_distance(0);
+      const uint32_t next_length(find_match(ip + 1, end, next_distance));
+      hashed_end = ip + 2;
+      if(next_length <= length) {
+        break;
       }
-    } else {
-      in_data_needle++;
-      in_size--;
+      ip++;
+      length = next_length;
+      distance = next_distance;
+    }
+
+    const size_t literal_length(ip - anchor), match_length(length - min_match);
+    uint8_t* token(out++);
+    *token = uint8_t((min<size_t>(literal_length, 15) << 4) | min<size_t>(match_length, 15));
+    if(literal_length >= 15) {
+      out = write_length(out, literal_length - 15);
+    }
+    memcpy(out, anchor, literal_length);
+    out += literal_length;
+    *out++ = uint8_t(distance);
+    *out++ = uint8_t(distance >> 8);
+    if(match_length >= 15) {
+      out = write_length(out, match_length - 15);
+    }
+
+    // Positions inside the match are worth finding later except at the lowest level
+    const uint8_t* const match_end(ip + length);
+    if(_level > Lz::min_level) {
+      for(ip = hashed_end; ip < match_end && ip < match_limit; ip++) {
+        const uint32_t position(_base + uint32_t(ip - _buffer));
+        const uint32_t hash(hash4(ip, _hash_bits));
+        _chain[position & _chain_mask] = _head[hash];
+        _head[hash] = position;
+      }
+    }
+    ip = anchor = match_end;
+  }
+
+  const size_t literal_length(end - anchor);
+  *out++ = uint8_t(min<size_t>(literal_length, 15) << 4);
+  if(literal_length >= 15) {
+    out = write_length(out, literal_length - 15);
+  }
+  memcpy(out, anchor, literal_length);
+  out += literal_length;
+  return out - out_start;
+}
+
+LzDecompressStream::LzDecompressStream(const void* data, size_t size)
+  : _in((const uint8_t*)data), _in_end(_in + size), _buffer(Memory::alloc_type<uint8_t>(buffer_size)),
+  _read(0), _end(0), _ended(false), _failed(false) {
+  if(size < sizeof(lz_magic) || read32(_in) != lz_magic) {
+    _ended = _failed = true;
+  } else {
+    _in += sizeof(lz_magic);
+  }
+}
+LzDecompressStream::~LzDecompressStream() {
+  Memory::free_type(_buffer, buffer_size);
+}
+size_t LzDecompressStream::read(void* data_void, size_t size) {
+  uint8_t* data((uint8_t*)data_void);
+  const size_t requested(size);
+  while(size > 0) {
+    if(_read == _end && (_ended || !decompress_block())) {
+      break;
     }
+    const size_t chunk(min<size_t>(size, _end - _read));
+    memcpy(data, _buffer + _read, chunk);
+    _read += uint32_t(chunk);
+    data += chunk;
+    size -= chunk;
+  }
+  return requested - size;
+}
+bool LzDecompressStream::decompress_block() {
+  uint32_t header[2];
+  if(_in_end - _in < ptrdiff_t(sizeof(header))) {
+    _ended = _failed = true;
+    return false;
+  }
+  memcpy(header, _in, sizeof(header));
+  _in += sizeof(header);
+  const uint32_t compressed_size(header[0] & ~raw_flag), size(header[1]);
+  if(size == 0) {
+    _ended = true;
+    return false;
+  }
+  if(size > Lz::block_size || compressed_size > size_t(_in_end - _in)) {
+    _ended = _failed = true;
+    return false;
   }
-  if(in_data != in_data_needle) {
-    output_raw(in_data, in_data_needle - in_data, out_stream);
+  if(_end + size > buffer_size) { // Keep only the window before the next block
+    const uint32_t shift(_end - Lz::window_size);
+    memmove(_buffer, _buffer + shift, Lz::window_size);
+    _end -= shift;
   }
+  if(header[0] & raw_flag) {
+    if(compressed_size != size) {
+      _ended = _failed = true;
+      return false;
+    }
+    memcpy(_buffer + _end, _in, size);
+  } else if(!decompress_sequences(_in, compressed_size, _buffer + _end, size, _buffer)) {
+    _ended = _failed = true;
+    return false;
+  }
+  _in += compressed_size;
+  _read = _end;
+  _end += size;
+  return true;
 }
 
-static Buffer lz_decompress(const void* in_data_void, size_t in_size) {
-  const uint8_t* in_data((uint8_t*)in_data_void);
-  const uint8_t* in_data_end(in_data + in_size);
-  Buffer wtr;
-  uintptr_t i(0);
-  while(in_data < in_data_end) {
-    uint16_t offset, size;
-    offset = ((uint16_t*)in_data)[0]; // Endianness?
-    size = ((uint16_t*)in_data)[1];
+bool Lz::decompress(const void* data, size_t size, Buffer& buffer) {
+  const uint8_t* in((const uint8_t*)data);
+  const uint8_t* const in_end(in + size);
+  if(size < sizeof(lz_magic) || read32(in) != lz_magic) {
+    return false;
+  }
+  in += sizeof(lz_magic);
 
-    if(wtr.size() < i + size) { // Grow buffer if necessary
-      wtr.size(upperpow2(i + size));
+  // Sum block sizes first to decompress everything in place
+  size_t total_size(0);
+  for(const uint8_t* block(in);;) {
+    uint32_t header[2];
+    if(size_t(in_end - block) < sizeof(header)) {
+      return false;
+    }
+    memcpy(header, block, sizeof(header));
+    block += sizeof(header);
+    if(header[1] == 0) {
+      break;
+    }
+    const uint32_t compressed_size(header[0] & ~raw_flag);
+    if(compressed_size > size_t(in_end - block) || header[1] > Lz::block_size) {
+      return false;
     }
+    block += compressed_size;
+    total_size += header[1];
+  }
 
-    const void* src(offset ? ((uint8_t*)wtr.data() + (i - offset)) : (in_data + 4));
-    memcpy((uint8_t*)wtr.data() + i, src, size);
-    i += size;
+  buffer = Buffer(total_size);
+  uint8_t* const out_start((uint8_t*)buffer.data());
+  uint8_t* out(out_start);
+  while(true) {
+    uint32_t header[2];
+    memcpy(header, in, sizeof(header));
+    in += sizeof(header);
+    const uint32_t compressed_size(header[0] & ~raw_flag), block_size(header[1]);
+    if(block_size == 0) {
+      return true;
+    }
+    if(header[0] & raw_flag) {
+      if(compressed_size != block_size) {
+        return false;
+      }
+      memcpy(out, in, block_size);
+    } else if(!decompress_sequences(in, compressed_size, out, block_size, out_start)) {
+      return false;
+    }
+    in += compressed_size;
+    out += block_size;
+  }
+}
 
-    const uintptr_t advance(offset ? 4 : size + 4);
-    in_data += advance;
+static void lz_compress(const void* data, size_t size, Stream& out_stream) {
+  LzCompressStream stream(out_stream, Lz::default_level, size);
+  stream.write(data, size);
+  stream.finish();
+}
+static void lz_high_compress(const void* data, size_t size, Stream& out_stream) {
+  LzCompressStream stream(out_stream, Lz::max_level, size);
+  stream.write(data, size);
+  stream.finish();
+}
+static void lz_chunked_compress(const void* data, size_t size, Stream& out_stream) {
+  chunked_compress(get_compression("lz"), data, size, out_stream);
+}
+static bool lz_decompress(const void* data, size_t size, Buffer& out) {
+  if(!Lz::decompress(data, size, out)) {
+    warning("lz: Couldn't decompress %d bytes", size);
+    return false;
   }
-  wtr.size(i);
-  return wtr;
+  return true;
 }
 
 void lz_module_init() {
   register_compression({"lz", lz_compress, lz_decompress});
+  register_compression({"lz_high", lz_high_compress, lz_decompress});
+  register_compression({"lz_chunked", lz_chunked_compress, chunked_decompress});
 }
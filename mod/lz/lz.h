@@ -0,0 +1,62 @@
+#pragma once
+
+#include <L/src/container/Buffer.h>
+#include <L/src/stream/Stream.h>
+
+namespace L {
+  // LZ77 codec with a 64KB window, hash chain match finding and LZ4-like sequences
+  // Data is cut in blocks that can reference previous ones, each starting with
+  // its compressed size (high bit set if stored raw) and its uncompressed size
+  namespace Lz {
+    static const uint32_t window_size = 1 << 16;
+    static const uint32_t block_size = 1 << 16;
+    static const uint32_t min_level = 1, default_level = 5, max_level = 9; // Levels trade speed for ratio
+
+    bool decompress(const void* data, size_t size, Buffer& out); // Returns false if data is corrupted
+  }
+
+  // Compresses written data to another stream, finish must be called once everything is written
+  class LzCompressStream : public Stream {
+  protected:
+    Stream& _out_stream;
+    uint32_t _level, _hash_bits, _chain_mask;
+    uint32_t *_head, *_chain; // Absolute positions of latest and previous occurrences of hashes
+    uint8_t *_buffer, *_output; // Window followed by the current block, compressed block
+    uint32_t _base; // Absolute position of the start of the buffer
+    uint32_t _history, _end; // Start of the current block and end of data in the buffer
+    bool _finished;
+
+  public:
+    // Size hint allows smaller tables for small inputs
+    LzCompressStream(Stream& out_stream, uint32_t level = Lz::default_level, size_t size_hint = 0);
+    ~LzCompressStream();
+    size_t write(const void* data, size_t size) override;
+    inline size_t read(void*, size_t) override { return 0; }
+    void finish();
+
+  protected:
+    void compress_block();
+    size_t compress_sequences(uint8_t* out);
+    uint32_t find_match(const uint8_t* ip, const uint8_t* end, uint32_t& distance);
+  };
+
+  // Decompresses from memory as it's read
+  class LzDecompressStream : public Stream {
+  protected:
+    const uint8_t *_in, *_in_end;
+    uint8_t* _buffer; // Window followed by the current block
+    uint32_t _read, _end;
+    bool _ended, _failed;
+
+  public:
+    LzDecompressStream(const void* data, size_t size);
+    ~LzDecompressStream();
+    size_t write(const void*, size_t) override { return 0; }
+    size_t read(void* data, size_t size) override;
+    inline bool end() override { return _ended && _read == _end; }
+    inline bool failed() const { return _failed; }
+
+  protected:
+    bool decompress_block();
+  };
+}
@@ -6,6 +6,39 @@ using namespace L;
 static bool is_jump_inst(ScriptInstruction inst) {
   return inst.opcode == IterEndJump || inst.opcode == Jump || inst.opcode == CondJump || inst.opcode == CondNotJump;
 }
+// Whether executing the instruction may change the value of a local
+static bool writes_local(ScriptInstruction inst, uint8_t local) {
+  switch(inst.opcode) {
+    case StoreGlobal: case StoreOuter: case CaptLocal: case CaptOuter:
+    case SetItem: case SetItemConst: case PushItem:
+    case IterEndJump: case Jump: case CondJump: case CondNotJump:
+      return false;
+    case GetItem: case GetItemConst: return inst.bc8.c == local;
+    case Iterate: return inst.a == local || inst.bc8.b == local;
+    case Call: return local >= inst.a; // Callee's frame starts there
+    case Return: return true;
+    default: return inst.a == local;
+  }
+}
+// Finds the constant a local is known to hold before an instruction, following copies back to the start of its block
+static bool constant_local(const Script& script, const Array<bool>& jump_targets, uintptr_t index, uint8_t local, uint16_t& constant) {
+  while(index > 0 && !jump_targets[index]) {
+    const ScriptInstruction& inst(script.bytecode[--index]);
+    if(is_jump_inst(inst)) {
+      return false;
+    } else if(writes_local(inst, local)) {
+      if(inst.opcode == LoadConst && inst.a == local) {
+        constant = inst.bcu16;
+        return true;
+      } else if(inst.opcode == CopyLocal && inst.a == local) {
+        local = inst.bc8.b;
+      } else {
+        return false;
+      }
+    }
+  }
+  return false;
+}
 static void remove_instruction(Script& script, uintptr_t index) {
   for(uintptr_t i(0); i < script.bytecode.size(); i++) {
     ScriptInstruction& inst(script.bytecode[i]);
@@ -52,6 +85,29 @@ static void script_optimize(Script& script) {
     }
   }
 
+  { // Use constant indices directly in item accesses so they can cache where the key was found
+    Array<bool> jump_targets;
+    jump_targets.size(script.bytecode.size() + 1, false);
+    for(uintptr_t i(0); i < script.bytecode.size(); i++) {
+      const ScriptInstruction& inst(script.bytecode[i]);
+      if(is_jump_inst(inst)) {
+        const uintptr_t target(i + intptr_t(inst.bc16) + 1);
+        if(target < jump_targets.size()) {
+          jump_targets[target] = true;
+        }
+      }
+    }
+    for(uintptr_t i(0); i < script.bytecode.size(); i++) {
+      ScriptInstruction& inst(script.bytecode[i]);
+      uint16_t constant;
+      if((inst.opcode == GetItem || inst.opcode == SetItem)
+         && constant_local(script, jump_targets, i, inst.bc8.b, constant) && constant <= UINT8_MAX) {
+        inst.opcode = inst.opcode == GetItem ? GetItemConst : SetItemConst;
+        inst.bc8.b = uint8_t(constant);
+      }
+    }
+  }
+
   { // Remove null jumps
     for(uintptr_t i(0); i < script.bytecode.size(); i++) {
       if(is_jump_inst(script.bytecode[i]) && script.bytecode[i].bc16 == 0) {
@@ -82,7 +138,7 @@ static void script_optimize(Script& script) {
         // Walk through code to update constant indices
         for(uintptr_t j(0); j < script.bytecode.size(); j++) {
           ScriptInstruction& inst(script.bytecode[j]);
-          if(inst.opcode == LoadConst && inst.bc8.b > after_i) {
+          if((inst.opcode == LoadConst || inst.opcode == GetItemConst || inst.opcode == SetItemConst) && inst.bc8.b > after_i) {
             inst.bc8.b--;
           }
         }
@@ -91,6 +147,8 @@ static void script_optimize(Script& script) {
       }
     }
   }
+
+  script.item_slots.size(script.bytecode.size(), uint32_t(-1));
 }
 void script_optimize_transformer(const ResourceSlot&, ScriptFunction::Intermediate& intermediate) {
   script_optimize(*intermediate.script);
@@ -0,0 +1,4 @@
+add_module(
+  test_animation
+  CONDITION ${DEV_DBG}
+)
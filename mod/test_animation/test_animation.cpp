@@ -0,0 +1,316 @@
+#include <L/src/container/Array.h>
+#include <L/src/dev/test.h>
+#include <L/src/math/geometry.h>
+#include <L/src/rendering/Animation.h>
+#include <L/src/stream/BufferStream.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uint32_t joint_count = 100;
+constexpr uint32_t key_count = 1000;
+constexpr float key_rate = 30.f;
+constexpr float frame_delta = 1.f / 60.f;
+constexpr uint32_t benchmark_frame_count = 1 << 10;
+constexpr uint32_t skinning_instance_count = 512;
+
+static float key_value(uint32_t joint, uint32_t key, uint32_t component) {
+  return float((joint * 7 + key * 13 + component * 3) % 17) / 17.f;
+}
+
+// Translation, rotation and scale channels with the same key times for every joint
+static Animation::Intermediate make_clip() {
+  Animation::Intermediate clip;
+  clip.duration = (key_count - 1) / key_rate;
+  for(uint32_t joint = 0; joint < joint_count; joint++) {
+    const AnimationChannelType types[] = {AnimationChannelType::Translation, AnimationChannelType::Rotation, AnimationChannelType::Scale};
+    const uint32_t component_counts[] = {3, 4, 1};
+    for(uint32_t type = 0; type < 3; type++) {
+      AnimationChannel channel;
+      channel.joint_index = joint;
+      channel.type = types[type];
+      channel.interpolation = AnimationInterpolationType::Linear;
+      for(uint32_t key = 0; key < key_count; key++) {
+        channel.times.push(key / key_rate);
+        for(uint32_t component = 0; component < component_counts[type]; component++) {
+          channel.values.push(key_value(joint, key, component));
+        }
+      }
+      clip.channels.push(channel);
+    }
+  }
+  return clip;
+}
+
+// Slowly varying translations and rotations, most keys can be interpolated
+static Animation::Intermediate make_smooth_clip() {
+  Animation::Intermediate clip;
+  clip.duration = (key_count - 1) / key_rate;
+  for(uint32_t joint = 0; joint < joint_count; joint++) {
+    AnimationChannel translation, rotation;
+    translation.joint_index = rotation.joint_index = joint;
+    translation.type = AnimationChannelType::Translation;
+    rotation.type = AnimationChannelType::Rotation;
+    translation.interpolation = rotation.interpolation = AnimationInterpolationType::Linear;
+    for(uint32_t key = 0; key < key_count; key++) {
+      const float time = key / key_rate;
+      translation.times.push(time);
+      rotation.times.push(time);
+      translation.values.push_multiple(sin(time + joint), cos(time * .5f), 1.f);
+      const Quatf q(Vector3f(1.f, 0.f, 0.f), sin(time * .7f + joint));
+      rotation.values.push_multiple(q.x(), q.y(), q.z(), q.w());
+    }
+    clip.channels.push(translation);
+    clip.channels.push(rotation);
+  }
+  return clip;
+}
+
+static float max_pose_difference(const JointPose* a, const JointPose* b) {
+  float difference = 0.f;
+  for(uint32_t joint = 0; joint < joint_count; joint++) {
+    for(uint32_t i = 0; i < 3; i++) {
+      difference = max(difference, abs(a[joint].translation[i] - b[joint].translation[i]));
+    }
+    for(uint32_t i = 0; i < 4; i++) {
+      difference = max(difference, abs(a[joint].rotation[i] - b[joint].rotation[i]));
+    }
+    difference = max(difference, abs(a[joint].scale - b[joint].scale));
+  }
+  return difference;
+}
+
+static void reset_pose(JointPose* joints) {
+  for(uint32_t joint = 0; joint < joint_count; joint++) {
+    joints[joint] = JointPose {Vector3f(0.f), Quatf(), 1.f};
+  }
+}
+
+// Balanced binary tree of joints with arbitrary bind poses
+static Skeleton make_skeleton() {
+  Skeleton skeleton;
+  for(uint32_t joint = 0; joint < joint_count; joint++) {
+    const Vector3f axis = Vector3f(1.f, key_value(joint, 0, 0), key_value(joint, 0, 1)).normalized();
+    const Matrix44f bind_pose = sqt_to_mat(Quatf(axis, key_value(joint, 0, 2) * 3.f), Vector3f(0.f, 1.f, key_value(joint, 0, 3)), 1.f);
+    skeleton.joints.push(SkeletonJoint {bind_pose.inverse(), Symbol(), joint == 0 ? -1 : intptr_t(joint - 1) / 2});
+  }
+  return skeleton;
+}
+
+// Straightforward matrix version
+static void reference_skinning(const Skeleton& skeleton, const JointPose* local_pose, Matrix44f* global_pose, Matrix44f* skin) {
+  for(uintptr_t i = 0; i < skeleton.joints.size(); i++) {
+    const Matrix44f matrix = sqt_to_mat(local_pose[i].rotation, local_pose[i].translation, local_pose[i].scale);
+    global_pose[i] = skeleton.joints[i].parent < 0 ? matrix : global_pose[skeleton.joints[i].parent] * matrix;
+    skin[i] = global_pose[i] * skeleton.joints[i].inv_bind_pose;
+  }
+}
+
+void test_animation_module_init() {
+  Test test_animation{};
+  test_animation.name = "animation";
+  test_animation.func = []() {
+    bool success = true;
+    const Animation animation(make_clip());
+    JointPose joints[joint_count];
+
+    // Halfway between keys 10 and 11
+    animation.pose_at(10.5f / key_rate, joints);
+    const float expected = (key_value(3, 10, 0) + key_value(3, 11, 0)) * .5f;
+    if(abs(joints[3].translation.x() - expected) > 1e-4f) {
+      warning("test_animation: sampled %f instead of %f", joints[3].translation.x(), expected);
+      success = false;
+    }
+
+    // Cursor must not change results, even when looping or jumping around
+    AnimationCursor cursor;
+    JointPose cursor_joints[joint_count];
+    const float times[] = {0.f, 1.f, 1.01f, 1.5f, 20.f, 33.3f, 40.f, 0.5f, -1.f, 0.51f};
+    for(float time : times) {
+      animation.pose_at(time, joints);
+      animation.pose_at(time, cursor_joints, &cursor);
+      if(memcmp(joints, cursor_joints, sizeof(joints))) {
+        warning("test_animation: cursor sampling differs at %f", time);
+        success = false;
+      }
+    }
+
+    // Playback of a looping clip at 60fps
+    const String clip_str = to_string(joint_count) + " joints, " + to_string(key_count) + " keys";
+    Timer timer;
+    float time = 0.f;
+    for(uint32_t frame = 0; frame < benchmark_frame_count; frame++) {
+      animation.pose_at(time, joints);
+      time = fmod(time + frame_delta, animation.duration);
+    }
+    const Time search_time = timer.since();
+
+    timer.setoff();
+    time = 0.f;
+    for(uint32_t frame = 0; frame < benchmark_frame_count; frame++) {
+      animation.pose_at(time, joints, &cursor);
+      time = fmod(time + frame_delta, animation.duration);
+    }
+    const Time cursor_time = timer.since();
+
+    log("test_animation: %s: %d poses/s with search, %d poses/s with cursor", clip_str.begin(),
+      uint32_t(benchmark_frame_count * 1000000ll / max<int64_t>(1, search_time.microseconds())),
+      uint32_t(benchmark_frame_count * 1000000ll / max<int64_t>(1, cursor_time.microseconds())));
+
+    return success;
+  };
+
+  add_test(test_animation);
+
+  Test test_skinning{};
+  test_skinning.name = "skinning";
+  test_skinning.func = []() {
+    bool success = true;
+    const Animation animation(make_clip());
+    const Skeleton skeleton = make_skeleton();
+    JointPose local_pose[joint_count];
+    Matrix44f reference_global[joint_count], reference_skin[joint_count];
+    Matrix44f global[joint_count], skin[joint_count];
+
+    animation.pose_at(4.2f, local_pose);
+    reference_skinning(skeleton, local_pose, reference_global, reference_skin);
+    compute_skinning(skeleton, local_pose, global, skin);
+    for(uint32_t joint = 0; joint < joint_count && success; joint++) {
+      for(uint32_t i = 0; i < 16; i++) {
+        const float expected = reference_skin[joint].array()[i];
+        if(abs(skin[joint].array()[i] - expected) > 1e-3f * max(1.f, abs(expected))) {
+          warning("test_animation: skinning matrix %d differs at %d: %f instead of %f", joint, i, skin[joint].array()[i], expected);
+          success = false;
+          break;
+        }
+      }
+    }
+
+    // Same pose for many instances
+    Timer timer;
+    for(uint32_t instance = 0; instance < skinning_instance_count; instance++) {
+      reference_skinning(skeleton, local_pose, reference_global, reference_skin);
+    }
+    const Time reference_time = timer.since();
+
+    timer.setoff();
+    for(uint32_t instance = 0; instance < skinning_instance_count; instance++) {
+      compute_skinning(skeleton, local_pose, global, skin);
+    }
+    const Time simd_time = timer.since();
+
+    log("test_animation: %d joints: %d skinned instances/s with matrices, %d with affine columns", joint_count,
+      uint32_t(skinning_instance_count * 1000000ll / max<int64_t>(1, reference_time.microseconds())),
+      uint32_t(skinning_instance_count * 1000000ll / max<int64_t>(1, simd_time.microseconds())));
+
+    return success;
+  };
+
+  add_test(test_skinning);
+
+  Test test_compression{};
+  test_compression.name = "animation_compression";
+  test_compression.func = []() {
+    bool success = true;
+    const float tolerance = 1e-3f;
+    const Animation::Intermediate clip = make_smooth_clip();
+    Animation::Intermediate reduced_clip = make_smooth_clip();
+    animation_reduce_keys(reduced_clip, tolerance);
+
+    // Goes through serialization like a cooked resource would
+    StringStream out_stream;
+    resource_write(out_stream, reduced_clip);
+    Animation::Intermediate read_clip;
+    BufferStream in_stream((char*)out_stream.string().begin(), out_stream.string().size());
+    resource_read(in_stream, read_clip);
+
+    const Animation animation(clip), reduced_animation(read_clip);
+    JointPose joints[joint_count], reduced_joints[joint_count];
+    float max_difference = 0.f;
+    for(float time = 0.f; time < animation.duration; time += frame_delta) {
+      reset_pose(joints);
+      reset_pose(reduced_joints);
+      animation.pose_at(time, joints);
+      reduced_animation.pose_at(time, reduced_joints);
+      max_difference = max(max_difference, max_pose_difference(joints, reduced_joints));
+    }
+    // Quantization adds its own error on top of the tolerance
+    if(max_difference > tolerance * 2.f) {
+      warning("test_animation: reduced animation is off by %f", max_difference);
+      success = false;
+    }
+
+    const size_t raw_size = clip.channels.size() * sizeof(AnimationChannel) + key_count * joint_count * (2 + 3 + 4) * sizeof(float);
+    log("test_animation: %d joints, %d keys: %d keys kept, %d bytes raw, %d bytes packed, %d bytes reduced, off by %f",
+      joint_count, key_count, read_clip.channels[0].times.size(),
+      raw_size, resource_cpu_size(clip), resource_cpu_size(read_clip), max_difference);
+
+    return success;
+  };
+
+  add_test(test_compression);
+
+  Test test_blend{};
+  test_blend.name = "animation_blend";
+  test_blend.func = []() {
+    bool success = true;
+    const Animation base(make_smooth_clip()), other(make_clip());
+    JointPose expected[joint_count], joints[joint_count];
+    const float time = 2.5f;
+
+    // Full weight override is the same as sampling
+    reset_pose(expected);
+    other.pose_at(time, expected);
+    base.pose_at(time, expected);
+    reset_pose(joints);
+    other.pose_at(time, joints);
+    base.blend_at(time, joints, 1.f);
+    if(max_pose_difference(expected, joints) > 1e-3f) {
+      warning("test_animation: full weight blending differs from sampling");
+      success = false;
+    }
+
+    // Additive layer at its first key changes nothing
+    reset_pose(expected);
+    base.pose_at(time, expected);
+    memcpy(joints, expected, sizeof(joints));
+    other.blend_at(0.f, joints, 1.f, AnimationBlendMode::Additive);
+    if(max_pose_difference(expected, joints) > 1e-3f) {
+      warning("test_animation: additive blending at first key changes the pose");
+      success = false;
+    }
+
+    // Masked out joints are left untouched
+    float joint_weights[joint_count];
+    for(uint32_t joint = 0; joint < joint_count; joint++) {
+      joint_weights[joint] = joint < joint_count / 2 ? 0.f : 1.f;
+    }
+    memcpy(joints, expected, sizeof(joints));
+    other.blend_at(time, joints, .5f, AnimationBlendMode::Override, joint_weights);
+    if(memcmp(joints, expected, sizeof(JointPose) * joint_count / 2) || !memcmp(joints, expected, sizeof(joints))) {
+      warning("test_animation: joint mask isn't respected");
+      success = false;
+    }
+
+    // Base pose with an additive layer and a crossfade on half the skeleton
+    AnimationCursor cursors[3];
+    Timer timer;
+    float t = 0.f;
+    for(uint32_t frame = 0; frame < benchmark_frame_count; frame++) {
+      base.pose_at(t, joints, cursors);
+      other.blend_at(t, joints, .3f, AnimationBlendMode::Additive, nullptr, cursors + 1);
+      base.blend_at(t * 2.f, joints, .5f, AnimationBlendMode::Override, joint_weights, cursors + 2);
+      t = fmod(t + frame_delta, base.duration);
+    }
+    const Time blend_time = timer.since();
+
+    log("test_animation: %d joints, 3 layers: %d poses/s", joint_count,
+      uint32_t(benchmark_frame_count * 1000000ll / max<int64_t>(1, blend_time.microseconds())));
+
+    return success;
+  };
+
+  add_test(test_blend);
+}
@@ -0,0 +1,4 @@
+add_module(
+  test_archive
+  CONDITION ${DEV_DBG}
+)
@@ -0,0 +1,260 @@
+#include <cstdio>
+
+#include <L/src/container/Archive.h>
+#include <L/src/container/Array.h>
+#include <L/src/container/Buffer.h>
+#include <L/src/dev/test.h>
+#include <L/src/engine/Resource.inl>
+#include <L/src/math/Rand.h>
+#include <L/src/stream/CFileStream.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/system/File.h>
+#include <L/src/text/String.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uint32_t entry_count = 2048;
+constexpr uint32_t max_entry_size = 64 * 1024;
+static const char* archive_path = "test_archive.bin";
+
+static String entry_key(uint32_t i) {
+  StringStream ss;
+  ss << "entry" << i;
+  return ss.string();
+}
+
+static bool archive() {
+  remove(archive_path);
+  bool success = true;
+  Time file_time, map_time;
+  {
+    Archive archive(archive_path);
+    Array<Buffer> values;
+    for(uint32_t i = 0; i < entry_count; i++) {
+      Buffer value(Rand::next(1, int(max_entry_size)));
+      for(uintptr_t j = 0; j < value.size(); j++) {
+        ((uint8_t*)value.data())[j] = uint8_t(i + j);
+      }
+      archive.store(entry_key(i), value.data(), value.size());
+      values.push(static_cast<Buffer&&>(value));
+
+      // Read back while the archive is growing to exercise remapping
+      if(i % 256 == 0) {
+        const Archive::Entry entry = archive.find(entry_key(i));
+        const void* data = archive.map(entry);
+        if(!data || memcmp(data, values[i].data(), values[i].size())) {
+          warning("test_archive: entry %d differs right after being stored", i);
+          success = false;
+        }
+      }
+    }
+
+    // Both paths end with a copy into the destination like unserializing would
+    Buffer destination(max_entry_size);
+
+    // What loading used to do: open the file, seek and read each entry into its own buffer
+    Timer timer;
+    size_t file_checksum = 0;
+    for(uint32_t i = 0; i < entry_count; i++) {
+      const Archive::Entry entry = archive.find(entry_key(i));
+      Buffer buffer(entry.size);
+      CFileStream stream(archive_path, "rb");
+      stream.seek(entry.position);
+      stream.read(buffer, entry.size);
+      memcpy(destination, buffer, entry.size);
+      file_checksum += ((const uint8_t*)destination.data())[entry.size - 1];
+    }
+    file_time = timer.since();
+
+    timer.setoff();
+    size_t map_checksum = 0;
+    for(uint32_t i = 0; i < entry_count; i++) {
+      const Archive::Entry entry = archive.find(entry_key(i));
+      memcpy(destination, archive.map(entry), entry.size);
+      map_checksum += ((const uint8_t*)destination.data())[entry.size - 1];
+    }
+    map_time = timer.since();
+
+    for(uint32_t i = 0; i < entry_count && success; i++) {
+      const Archive::Entry entry = archive.find(entry_key(i));
+      if(entry.size != values[i].size() || memcmp(archive.map(entry), values[i].data(), entry.size)) {
+        warning("test_archive: entry %d differs", i);
+        success = false;
+      }
+    }
+    if(file_checksum != map_checksum) {
+      warning("test_archive: file and mapped reads differ");
+      success = false;
+    }
+  }
+
+  // Reopening maps the existing file
+  {
+    Archive archive(archive_path);
+    const Archive::Entry entry = archive.find(entry_key(entry_count - 1));
+    if(!entry || !archive.map(entry)) {
+      warning("test_archive: entry missing after reopening");
+      success = false;
+    }
+  }
+  remove(archive_path);
+
+  // Only storing opens the file for writing, so reading a missing archive doesn't create it
+  {
+    Archive archive(archive_path);
+    if(archive.find(entry_key(0)) || archive.count() != 0) {
+      warning("test_archive: missing archive has entries");
+      success = false;
+    }
+  }
+  if(File(archive_path).exists()) {
+    warning("test_archive: reading a missing archive created it");
+    success = false;
+    remove(archive_path);
+  }
+
+  const String file_str = to_string(file_time), map_str = to_string(map_time);
+  log("test_archive: %d entries: %s with file reads, %s with mapping", entry_count, file_str.begin(), map_str.begin());
+  return success;
+}
+
+// Even entries are stored twice, the second time bigger so they can't reuse their space
+static uint32_t expected_version(uint32_t i) {
+  return i % 2 == 0 ? 1 : 0;
+}
+static bool check_entries(Archive& archive, uint32_t count, const char* step) {
+  if(archive.count() != count) {
+    warning("test_archive: %d entries instead of %d %s", archive.count(), count, step);
+    return false;
+  }
+  for(uint32_t i = 0; i < count; i++) {
+    const uint32_t version = expected_version(i);
+    const Archive::Entry entry = archive.find(entry_key(i));
+    const uint32_t* value = entry ? (const uint32_t*)archive.map(entry) : nullptr;
+    if(!value || entry.size != sizeof(uint32_t) * (1 + i % 8 + version) || *value != i + version) {
+      warning("test_archive: entry %d is wrong %s", i, step);
+      return false;
+    }
+  }
+  return true;
+}
+
+// More entries than the old fixed table could hold, reopened, recovered and compacted
+static bool archive_index() {
+  constexpr uint32_t count = 20000;
+  const char* copy_path = "test_archive_copy.bin";
+  remove(archive_path);
+  remove(copy_path);
+  bool success = true;
+  {
+    Archive archive(archive_path);
+    uint32_t values[16];
+    for(uint32_t version = 0; version < 2; version++) {
+      for(uint32_t i = 0; i < count; i++) {
+        if(expected_version(i) >= version) {
+          for(uint32_t& value : values) {
+            value = i + version;
+          }
+          archive.store(entry_key(i), values, sizeof(uint32_t) * (1 + i % 8 + version));
+        }
+      }
+    }
+    success = success && check_entries(archive, count, "after storing");
+
+    // Copy the file before it gets an index when closing
+    Buffer content(size_t(archive.file_size()));
+    CFileStream(archive_path, "rb").read(content, content.size());
+    CFileStream(copy_path, "wb").write(content, content.size());
+  }
+  {
+    Archive archive(archive_path);
+    success = success && check_entries(archive, count, "after reopening");
+
+    const uint64_t file_size = archive.file_size(), dead_size = archive.dead_size();
+    archive.compact();
+    success = success && check_entries(archive, count, "after compacting");
+    if(archive.dead_size() != 0 || archive.file_size() != file_size - dead_size) {
+      warning("test_archive: compacting left %llu dead bytes", (unsigned long long)archive.dead_size());
+      success = false;
+    }
+    log("test_archive: %d entries: compacted from %llu to %llu bytes", count, (unsigned long long)file_size, (unsigned long long)archive.file_size());
+  }
+  {
+    Archive archive(copy_path);
+    success = success && check_entries(archive, count, "after rebuilding the index");
+  }
+  remove(archive_path);
+  remove(copy_path);
+  return success;
+}
+
+static bool cook() {
+  constexpr uint32_t file_count = 64;
+  const char* manifest_path = "test_cook_manifest.txt";
+  {
+    CFileStream manifest(manifest_path, "wb");
+    manifest << "# Cook test\n";
+    for(uint32_t i = 0; i < file_count; i++) {
+      const String path = "test_cook_" + to_string(i) + ".txt";
+      CFileStream source(path, "wb");
+      for(uint32_t j = 0; j <= i; j++) {
+        source << "Source file " << i << '\n';
+      }
+      manifest << type_name<Buffer>() << ' ' << path << '\n';
+    }
+    // Duplicates are only cooked once
+    for(uint32_t i = 0; i < file_count; i += 16) {
+      manifest << type_name<Buffer>() << " test_cook_" << i << ".txt\n";
+    }
+  }
+
+  bool success = ResourceSlot::cook(manifest_path);
+  for(uint32_t i = 0; i < file_count && success; i++) {
+    const String path = "test_cook_" + to_string(i) + ".txt";
+    ResourceSlot* slot = ResourceSlot::find(type_name<Buffer>(), path);
+    const Buffer source = slot->read_source_file();
+    size_t size;
+    const void* data = slot->read_archive(size);
+    if(!data) {
+      warning("test_archive: %s wasn't cooked", path.begin());
+      success = false;
+      break;
+    }
+    Buffer cooked, uncompressed;
+    const Compression* compression = read_compression_tag(data, size);
+    if(compression != &ResourceLoading<Buffer>::compression() || !compression->decompress(data, size, uncompressed)) {
+      warning("test_archive: %s doesn't decompress", path.begin());
+      success = false;
+      break;
+    }
+    BufferStream stream((char*)uncompressed.data(), uncompressed.size());
+    resource_read(stream, cooked);
+    if(cooked.size() != source.size() || memcmp(cooked, source, source.size())) {
+      warning("test_archive: %s was cooked wrong", path.begin());
+      success = false;
+    }
+  }
+
+  // Unknown types make cooking fail
+  {
+    CFileStream manifest(manifest_path, "wb");
+    manifest << "UnknownType test_cook_0.txt\n";
+  }
+  if(ResourceSlot::cook(manifest_path)) {
+    warning("test_archive: cooking an unknown type succeeded");
+    success = false;
+  }
+
+  for(uint32_t i = 0; i < file_count; i++) {
+    remove("test_cook_" + to_string(i) + ".txt");
+  }
+  remove(manifest_path);
+  return success;
+}
+
+void test_archive_module_init() {
+  add_test(Test {"archive", archive});
+  add_test(Test {"archive_index", archive_index});
+  add_test(Test {"cook", cook});
+}
@@ -0,0 +1,4 @@
+add_module(
+  test_bvh
+  CONDITION ${DEV_DBG}
+)
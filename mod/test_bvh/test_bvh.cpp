@@ -0,0 +1,212 @@
+#include <L/src/container/Array.h>
+#include <L/src/container/BVH.h>
+#include <L/src/container/IntervalTree.h>
+#include <L/src/container/Table.h>
+#include <L/src/dev/test.h>
+#include <L/src/math/Rand.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uint32_t element_count = 2048;
+constexpr uint32_t benchmark_frame_count = 8;
+constexpr float box_radius = .5f;
+constexpr float fat_margin = .25f;
+constexpr float speed = .1f; // Distance travelled each frame
+
+struct MovingBox {
+  Vector3f position, velocity;
+  inline Interval3f box() const { return Interval3f(position - box_radius, position + box_radius); }
+};
+
+// Same density of boxes whatever their count
+static float world_size(uint32_t count) {
+  return pow(float(count), 1.f / 3.f) * 2.5f;
+}
+
+static Array<MovingBox> make_boxes(uint32_t count) {
+  const float size = world_size(count);
+  Array<MovingBox> boxes;
+  for(uint32_t i = 0; i < count; i++) {
+    const Vector3f direction = Vector3f(Rand::next(-1.f, 1.f), Rand::next(-1.f, 1.f), Rand::next(-1.f, 1.f)).normalized();
+    boxes.push(MovingBox {Vector3f(Rand::next(0.f, size), Rand::next(0.f, size), Rand::next(0.f, size)), direction * speed});
+  }
+  return boxes;
+}
+
+static void move_boxes(Array<MovingBox>& boxes) {
+  const float size = world_size(uint32_t(boxes.size()));
+  for(MovingBox& box : boxes) {
+    box.position += box.velocity;
+    for(uint32_t i = 0; i < 3; i++) {
+      if(box.position[i] < 0.f || box.position[i] > size) {
+        box.velocity[i] = -box.velocity[i];
+      }
+    }
+  }
+}
+
+static inline uint64_t pair_key(uint32_t a, uint32_t b) {
+  return (uint64_t(min(a, b)) << 32) | max(a, b);
+}
+
+// Every overlapping pair must be found exactly once
+static bool check_pairs(const BVH<uint32_t>& bvh, const Array<int32_t>& nodes, const Array<uint32_t>& pairs) {
+  Table<uint64_t, bool> found;
+  for(uintptr_t i = 0; i < pairs.size(); i += 2) {
+    bool& pair_found = found[pair_key(pairs[i], pairs[i + 1])];
+    if(pair_found) {
+      warning("test_bvh: pair (%d,%d) found twice", pairs[i], pairs[i + 1]);
+      return false;
+    }
+    pair_found = true;
+  }
+  uintptr_t expected_count = 0;
+  for(uint32_t i = 0; i < nodes.size(); i++) {
+    for(uint32_t j = i + 1; j < nodes.size(); j++) {
+      if(nodes[i] != BVH<uint32_t>::null && nodes[j] != BVH<uint32_t>::null
+        && bvh.box(nodes[i]).overlaps(bvh.box(nodes[j]))) {
+        if(!found.find(pair_key(i, j))) {
+          warning("test_bvh: pair (%d,%d) is missing", i, j);
+          return false;
+        }
+        expected_count++;
+      }
+    }
+  }
+  if(expected_count != found.count()) {
+    warning("test_bvh: found %d pairs instead of %d", found.count(), expected_count);
+    return false;
+  }
+  return true;
+}
+
+static void log_benchmark(uint32_t count, const char* name, const Time& time) {
+  const String time_str = to_string(time / benchmark_frame_count);
+  log("test_bvh: %d moving boxes: %s per frame with %s", count, time_str.begin(), name);
+}
+
+static void benchmark(uint32_t count) {
+  Array<MovingBox> boxes = make_boxes(count);
+  Array<MovingBox> start_boxes = boxes;
+
+  { // Persistent flat tree with parallel refit and self-traversal
+    BVH<uint32_t> bvh;
+    Array<int32_t> nodes;
+    Array<uint32_t> pairs;
+    for(uint32_t i = 0; i < count; i++) {
+      nodes.push(bvh.insert(boxes[i].box().extended(fat_margin), i));
+    }
+    Timer timer;
+    for(uint32_t frame = 0; frame < benchmark_frame_count; frame++) {
+      move_boxes(boxes);
+      for(uint32_t i = 0; i < count; i++) {
+        const Interval3f box = boxes[i].box();
+        if(!bvh.box(nodes[i]).contains(box)) {
+          bvh.update(nodes[i], box.extended(fat_margin));
+        }
+      }
+      bvh.refit();
+      bvh.pairs(pairs);
+    }
+    log_benchmark(count, "BVH", timer.since());
+  }
+
+  boxes = start_boxes;
+  { // Pointer tree queried once per box
+    typedef Interval3fTree<uint32_t> Tree;
+    Tree tree;
+    Array<Tree::Node*> nodes, query, pairs;
+    for(uint32_t i = 0; i < count; i++) {
+      nodes.push(tree.insert(boxes[i].box().extended(fat_margin), i));
+    }
+    Timer timer;
+    for(uint32_t frame = 0; frame < benchmark_frame_count; frame++) {
+      move_boxes(boxes);
+      for(uint32_t i = 0; i < count; i++) {
+        const Interval3f box = boxes[i].box();
+        if(!nodes[i]->key().contains(box)) {
+          tree.update(nodes[i], box.extended(fat_margin));
+        }
+      }
+      pairs.clear();
+      for(uint32_t i = 0; i < count; i++) {
+        tree.query(nodes[i]->key(), query);
+        for(Tree::Node* other : query) {
+          if(other < nodes[i]) {
+            pairs.push_multiple(nodes[i], other);
+          }
+        }
+      }
+    }
+    log_benchmark(count, "IntervalTree", timer.since());
+  }
+}
+
+void test_bvh_module_init() {
+  Test test_bvh{};
+  test_bvh.name = "bvh";
+  test_bvh.func = []() {
+    bool success = true;
+    Array<MovingBox> boxes = make_boxes(element_count);
+    BVH<uint32_t> bvh;
+    Array<int32_t> nodes;
+    Array<uint32_t> pairs;
+    for(uint32_t i = 0; i < element_count; i++) {
+      nodes.push(bvh.insert(boxes[i].box(), i));
+    }
+    bvh.pairs(pairs);
+    success = check_pairs(bvh, nodes, pairs) && success;
+
+    // Incremental updates
+    for(uint32_t frame = 0; frame < 16 && success; frame++) {
+      move_boxes(boxes);
+      for(uint32_t i = 0; i < element_count; i++) {
+        if(nodes[i] != BVH<uint32_t>::null && !bvh.box(nodes[i]).contains(boxes[i].box())) {
+          bvh.update(nodes[i], boxes[i].box().extended(fat_margin));
+        }
+      }
+      // Remove and add back a few boxes while others have pending updates
+      for(uint32_t i = frame; i < element_count; i += 61) {
+        if(nodes[i] != BVH<uint32_t>::null) {
+          bvh.remove(nodes[i]);
+          nodes[i] = BVH<uint32_t>::null;
+        } else {
+          nodes[i] = bvh.insert(boxes[i].box(), i);
+        }
+      }
+      bvh.refit();
+      bvh.pairs(pairs);
+      success = check_pairs(bvh, nodes, pairs) && success;
+    }
+
+    Array<uint32_t> values;
+    const Interval3f zone(Vector3f(0.f), Vector3f(4.f));
+    bvh.query(zone, values);
+    uint32_t expected_count = 0;
+    for(int32_t node : nodes) {
+      expected_count += node != BVH<uint32_t>::null && bvh.box(node).overlaps(zone);
+    }
+    if(values.size() != expected_count) {
+      warning("test_bvh: query found %d boxes instead of %d", values.size(), expected_count);
+      success = false;
+    }
+
+    log("test_bvh: %d boxes, height %d", element_count, bvh.height(bvh.root()));
+    return success;
+  };
+
+  add_test(test_bvh);
+
+  Test test_bvh_benchmark{};
+  test_bvh_benchmark.name = "bvh_benchmark";
+  test_bvh_benchmark.func = []() {
+    benchmark(10000);
+    benchmark(50000);
+    return true;
+  };
+
+  add_test(test_bvh_benchmark);
+}
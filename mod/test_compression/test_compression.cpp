@@ -1,9 +1,240 @@
 #include <L/src/dev/test.h>
+#include <L/src/parallelism/TaskSystem.h>
+#include <L/src/stream/CFileStream.h>
 #include <L/src/stream/StringStream.h>
 #include <L/src/text/compression.h>
+#include <L/src/time/Timer.h>
+#include "../lz/lz.h"
 
 using namespace L;
 
+struct CorpusFile {
+  const char* name;
+  const char* paths[4]; // Concatenated
+};
+static const CorpusFile corpus[] = {
+  {"text", {"src/script/ScriptContext.cpp", "src/rendering/Material.cpp", "src/container/Table.h", "mod/ls/LSCompiler.cpp"}},
+  {"mesh", {"smp/material/Fox.glb"}},
+  {"model", {"smp/material/DamagedHelmet.glb"}},
+  {"wav", {"smp/audio/guitar.wav"}},
+  {"png", {"smp/texture/jerrican.png"}},
+};
+static constexpr size_t corpus_max_size = 1 << 20;
+
+// Sources are compiled with absolute paths so assets are found relative to this file
+static String repository_path(const char* relative) {
+  String path(__FILE__);
+  path.trim_right(sizeof("mod/test_compression/test_compression.cpp") - 1);
+  return path + relative;
+}
+static Buffer read_corpus_file(const CorpusFile& file) {
+  Buffer buffer;
+  size_t size = 0;
+  for(const char* path : file.paths) {
+    if(!path) {
+      break;
+    }
+    CFileStream stream(repository_path(path), "rb");
+    if(!stream) {
+      return Buffer();
+    }
+    const size_t file_size = min(stream.size(), corpus_max_size - size);
+    buffer.size(size + file_size);
+    stream.read(buffer.data(size), file_size);
+    size += file_size;
+  }
+  return buffer;
+}
+
+static bool compression_benchmark() {
+  bool success = true;
+  for(const CorpusFile& file : corpus) {
+    const Buffer data = read_corpus_file(file);
+    if(data.size() == 0) {
+      log("test_compression: %s corpus is missing", file.name);
+      continue;
+    }
+    for(const Compression& comp : get_compressions()) {
+      StringStream compressed_stream;
+      Timer timer;
+      comp.compress(data.data(), data.size(), compressed_stream);
+      const Time compress_time = timer.since();
+      timer.setoff();
+      Buffer decompressed;
+      const bool decompressed_valid = comp.decompress(compressed_stream.string().begin(), compressed_stream.string().size(), decompressed);
+      const Time decompress_time = timer.since();
+
+      if(!decompressed_valid || decompressed.size() != data.size() || memcmp(decompressed.data(), data.data(), data.size())) {
+        warning("test_compression: %s failed on %s corpus", comp.name, file.name);
+        success = false;
+        continue;
+      }
+      const float mb = float(data.size()) / float(1 << 20);
+      log("test_compression: %s %s: %d to %d bytes (%f), compress %f MB/s, decompress %f MB/s",
+          file.name, comp.name, data.size(), compressed_stream.string().size(), float(compressed_stream.string().size()) / float(data.size()),
+          mb / max(compress_time.seconds_float(), 1e-6f), mb / max(decompress_time.seconds_float(), 1e-6f));
+    }
+  }
+  return success;
+}
+
+// Writes and reads in uneven chunks across blocks, then checks truncated data is rejected
+static bool lz_stream() {
+  Buffer data;
+  for(const CorpusFile& file : corpus) {
+    data = read_corpus_file(file);
+    if(data.size() > 3 * Lz::block_size) {
+      break;
+    }
+  }
+  if(data.size() == 0) {
+    log("test_compression: corpus is missing");
+    return true;
+  }
+
+  StringStream compressed_stream;
+  {
+    LzCompressStream compress_stream(compressed_stream);
+    for(uintptr_t i = 0; i < data.size(); i += 1000) {
+      compress_stream.write(data.data(i), min<size_t>(1000, data.size() - i));
+    }
+    compress_stream.finish();
+  }
+  const String& compressed = compressed_stream.string();
+
+  Buffer decompressed(data.size());
+  LzDecompressStream decompress_stream(compressed.begin(), compressed.size());
+  size_t decompressed_size = 0;
+  while(size_t read = decompress_stream.read(decompressed.data(decompressed_size), min<size_t>(777, data.size() - decompressed_size))) {
+    decompressed_size += read;
+  }
+  char extra;
+  if(decompressed_size != data.size() || memcmp(decompressed.data(), data.data(), data.size())
+     || decompress_stream.read(&extra, 1) != 0 || !decompress_stream.end() || decompress_stream.failed()) {
+    warning("test_compression: lz stream gave %d bytes instead of %d", decompressed_size, data.size());
+    return false;
+  }
+
+  Buffer truncated;
+  if(Lz::decompress(compressed.begin(), compressed.size() / 2, truncated)) {
+    warning("test_compression: lz accepted truncated data");
+    return false;
+  }
+  return true;
+}
+
+// Compares chunked and contiguous compression of a large resource, then decompresses ranges across chunk boundaries
+static bool chunked_compression() {
+  static const size_t data_size = 16 << 20;
+  Buffer data(data_size);
+  size_t size = 0;
+  while(size < data_size) {
+    for(const CorpusFile& file : corpus) {
+      const Buffer file_data = read_corpus_file(file);
+      const size_t copy_size = min(file_data.size(), data_size - size);
+      memcpy(data.data(size), file_data.data(), copy_size);
+      size += copy_size;
+    }
+    if(size == 0) {
+      log("test_compression: corpus is missing");
+      return true;
+    }
+  }
+
+  const Compression& lz = get_compression("lz");
+  const Compression& lz_chunked = get_compression("lz_chunked");
+  Time compress_times[2], decompress_times[2];
+  String compressed;
+  for(uintptr_t i = 0; i < 2; i++) {
+    const Compression& comp = i ? lz_chunked : lz;
+    StringStream compressed_stream;
+    Timer timer;
+    comp.compress(data.data(), data.size(), compressed_stream);
+    compress_times[i] = timer.since();
+    timer.setoff();
+    Buffer decompressed;
+    const bool decompressed_valid = comp.decompress(compressed_stream.string().begin(), compressed_stream.string().size(), decompressed);
+    decompress_times[i] = timer.since();
+    if(!decompressed_valid || decompressed.size() != data.size() || memcmp(decompressed.data(), data.data(), data.size())) {
+      warning("test_compression: %s failed on %d bytes", comp.name, data.size());
+      return false;
+    }
+    const String compress_str = to_string(compress_times[i]), decompress_str = to_string(decompress_times[i]);
+    log("test_compression: %s: %d MB to %d bytes, compressed in %s, decompressed in %s",
+        comp.name, data_size >> 20, compressed_stream.string().size(), compress_str.begin(), decompress_str.begin());
+    compressed = compressed_stream.string();
+  }
+  log("test_compression: chunked on %d threads: compression %fx, decompression %fx faster",
+      TaskSystem::thread_count(), compress_times[0].seconds_float() / compress_times[1].seconds_float(),
+      decompress_times[0].seconds_float() / decompress_times[1].seconds_float());
+
+  if(chunked_size(compressed.begin(), compressed.size()) != data.size()) {
+    warning("test_compression: chunked size mismatch");
+    return false;
+  }
+  const size_t ranges[][2] = {
+    {0, 1},
+    {chunked_default_chunk_size - 100, 200},
+    {3 * chunked_default_chunk_size, chunked_default_chunk_size},
+    {data_size - 1000, 1000},
+    {12345, 3 * chunked_default_chunk_size},
+  };
+  Buffer range_data(3 * chunked_default_chunk_size);
+  for(const auto& range : ranges) {
+    if(!chunked_decompress_range(compressed.begin(), compressed.size(), range[0], range[1], range_data.data())
+       || memcmp(range_data.data(), data.data(range[0]), range[1])) {
+      warning("test_compression: chunked range of %d bytes at %d failed", range[1], range[0]);
+      return false;
+    }
+  }
+  // Archived data may not be aligned
+  Buffer unaligned(compressed.size() + 1);
+  memcpy(unaligned.data(1), compressed.begin(), compressed.size());
+  if(!chunked_decompress_range(unaligned.data(1), compressed.size(), data_size - 100, 100, range_data.data())
+     || memcmp(range_data.data(), data.data(data_size - 100), 100)) {
+    warning("test_compression: chunked failed on unaligned data");
+    return false;
+  }
+  if(chunked_decompress_range(compressed.begin(), compressed.size(), data_size - 10, 20, range_data.data())
+     || chunked_decompress(compressed.begin(), compressed.size() / 2, range_data)) {
+    warning("test_compression: chunked accepted invalid range or truncated data");
+    return false;
+  }
+  return true;
+}
+
+// Tagged data is read with the compression it was made with, untagged or unknown data is rejected
+static bool compression_tag() {
+  static const char test_string[] = "Tagged test string";
+  bool success = true;
+  for(const Compression& comp : get_compressions()) {
+    StringStream compressed_stream;
+    write_compression_tag(comp, compressed_stream);
+    comp.compress(test_string, sizeof(test_string), compressed_stream);
+    const void* data = compressed_stream.string().begin();
+    size_t size = compressed_stream.string().size();
+    Buffer decompressed;
+    if(read_compression_tag(data, size) != &comp || !comp.decompress(data, size, decompressed)
+       || decompressed.size() != sizeof(test_string) || memcmp(decompressed.data(), test_string, sizeof(test_string))) {
+      warning("test_compression: tagged %s data wasn't read back", comp.name);
+      success = false;
+    }
+  }
+  static const char unknown[] = "\x07unknownpayload";
+  const void* data = unknown;
+  size_t size = sizeof(unknown) - 1;
+  if(read_compression_tag(data, size) != nullptr || data != unknown) {
+    warning("test_compression: unknown compression tag was accepted");
+    success = false;
+  }
+  size = 0;
+  if(read_compression_tag(data, size) != nullptr) {
+    warning("test_compression: empty data was accepted as tagged");
+    success = false;
+  }
+  return success;
+}
+
 void test_compression_module_init() {
   Test test_compression{};
   test_compression.name = "compression";
@@ -27,12 +258,13 @@ void test_compression_module_init() {
         comp.compress(test_string.begin(), test_string.size(), compressed_stream);
 
         Buffer decompressed_buffer;
-        decompressed_buffer = comp.decompress(compressed_stream.string().begin(), compressed_stream.string().size());
-
-        if(test_string.size() != decompressed_buffer.size()) {
+        if(!comp.decompress(compressed_stream.string().begin(), compressed_stream.string().size(), decompressed_buffer)) {
+          log("test_compression: [%d] failed to decompress", i);
+          success = false;
+        } else if(test_string.size() != decompressed_buffer.size()) {
           log("test_compression: [%d] failed with different size (%d to %d)", i, test_string.size(), decompressed_buffer.size());
           success = false;
-        } else if(memcmp(test_string.begin(), decompressed_buffer.data(), test_string.size())) {
+        } else if(test_string.size() > 0 && memcmp(test_string.begin(), decompressed_buffer.data(), test_string.size())) { // Empty buffers may be null
           log("test_compression: [%d] failed with different values for", i);
           success = false;
         } else {
@@ -45,4 +277,8 @@ void test_compression_module_init() {
   };
 
   add_test(test_compression);
+  add_test(Test {"compression_benchmark", compression_benchmark});
+  add_test(Test {"lz_stream", lz_stream});
+  add_test(Test {"chunked_compression", chunked_compression});
+  add_test(Test {"compression_tag", compression_tag});
 }
@@ -0,0 +1,4 @@
+add_module(
+  test_culling
+  CONDITION ${DEV_DBG}
+)
@@ -0,0 +1,144 @@
+#include <L/src/container/Array.h>
+#include <L/src/container/IntervalTree.h>
+#include <L/src/dev/test.h>
+#include <L/src/engine/CullVolume.h>
+#include <L/src/math/Rand.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uint32_t volume_count = 100000;
+constexpr uint32_t camera_count = 8; // Main view, shadows, mirrors...
+constexpr float world_size = 1000.f;
+
+struct Frustum {
+  Vector4f planes[6];
+};
+
+static Vector4f plane(const Vector3f& normal, const Vector3f& point) {
+  return Vector4f(normal.x(), normal.y(), normal.z(), -normal.dot(point));
+}
+
+// Perspective frustum looking in a random direction from a random point
+static Frustum make_frustum() {
+  const Vector3f position(Rand::next(0.f, world_size), Rand::next(0.f, world_size), Rand::next(0.f, world_size));
+  const Vector3f forward = Vector3f(Rand::next(-1.f, 1.f), Rand::next(-1.f, 1.f), Rand::next(-1.f, 1.f)).normalized();
+  const Vector3f right = forward.cross(abs(forward.z()) < .9f ? Vector3f(0.f, 0.f, 1.f) : Vector3f(1.f, 0.f, 0.f)).normalized();
+  const Vector3f up = right.cross(forward);
+  Frustum frustum;
+  frustum.planes[0] = plane((forward + right).normalized(), position);
+  frustum.planes[1] = plane((forward - right).normalized(), position);
+  frustum.planes[2] = plane((forward + up).normalized(), position);
+  frustum.planes[3] = plane((forward - up).normalized(), position);
+  frustum.planes[4] = plane(forward, position + forward * .1f);
+  frustum.planes[5] = plane(-forward, position + forward * (world_size * .5f));
+  return frustum;
+}
+
+static bool outside(const Interval3f& box, const Vector4f& plane) {
+  const float x = plane.x() > 0.f ? box.max().x() : box.min().x();
+  const float y = plane.y() > 0.f ? box.max().y() : box.min().y();
+  const float z = plane.z() > 0.f ? box.max().z() : box.min().z();
+  return x * plane.x() + (y * plane.y() + (z * plane.z() + plane.w())) < 0.f;
+}
+
+// Previous implementation: single threaded, scalar, and a second pass to mark invisible leaves
+static void tree_cull(const Interval3fTree<uint32_t>& tree, const Frustum& frustum, Array<bool>& visible) {
+  typedef Interval3fTree<uint32_t>::Node Node;
+  Array<const Node*> stack, invisible;
+  if(tree.root()) {
+    stack.push(tree.root());
+  }
+  while(!stack.empty()) {
+    const Node* node = stack.back();
+    stack.pop();
+    bool node_visible = true;
+    for(uintptr_t i = 0; i < 6 && node_visible; i++) {
+      node_visible = !outside(node->key(), frustum.planes[i]);
+    }
+    if(!node_visible) {
+      invisible.push(node);
+    } else if(node->branch()) {
+      stack.push(node->left());
+      stack.push(node->right());
+    } else {
+      visible[node->value()] = true;
+    }
+  }
+  while(!invisible.empty()) {
+    const Node* node = invisible.back();
+    invisible.pop();
+    if(node->branch()) {
+      invisible.push(node->left());
+      invisible.push(node->right());
+    } else {
+      visible[node->value()] = false;
+    }
+  }
+}
+
+static bool culling() {
+  Array<Interval3f> boxes;
+  for(uint32_t i = 0; i < volume_count; i++) {
+    const Vector3f center(Rand::next(0.f, world_size), Rand::next(0.f, world_size), Rand::next(0.f, world_size));
+    const Vector3f radius(Rand::next(.5f, 4.f), Rand::next(.5f, 4.f), Rand::next(.5f, 4.f));
+    boxes.push(center - radius, center + radius);
+  }
+  Array<Frustum> frustums;
+  for(uint32_t i = 0; i < camera_count; i++) {
+    frustums.push(make_frustum());
+  }
+
+  bool success = true;
+  Time volume_time, tree_time;
+  { // Flat tree with plane masks, SIMD tests and threads
+    Array<CullVolume> volumes;
+    volumes.size(volume_count);
+    for(uint32_t i = 0; i < volume_count; i++) {
+      volumes[i].update_bounds(boxes[i]);
+    }
+    for(const Frustum& frustum : frustums) {
+      Timer timer;
+      CullVolume::cull(frustum.planes);
+      volume_time += timer.since();
+
+      uint32_t visible_count = 0;
+      for(uint32_t i = 0; i < volume_count; i++) {
+        bool expected = true;
+        for(uintptr_t j = 0; j < 6 && expected; j++) {
+          expected = !outside(boxes[i], frustum.planes[j]);
+        }
+        if(volumes[i].visible() != expected) {
+          warning("test_culling: volume %d is %s instead of %s", i, volumes[i].visible() ? "visible" : "invisible", expected ? "visible" : "invisible");
+          success = false;
+          break;
+        }
+        visible_count += expected;
+      }
+      log("test_culling: %d/%d volumes visible", visible_count, volume_count);
+    }
+  }
+  { // Interval tree
+    Interval3fTree<uint32_t> tree;
+    Array<bool> visible;
+    visible.size(volume_count, false);
+    for(uint32_t i = 0; i < volume_count; i++) {
+      tree.insert(boxes[i], i);
+    }
+    for(const Frustum& frustum : frustums) {
+      Timer timer;
+      tree_cull(tree, frustum, visible);
+      tree_time += timer.since();
+    }
+  }
+
+  const String volume_str = to_string(volume_time / camera_count), tree_str = to_string(tree_time / camera_count);
+  log("test_culling: %d volumes: %s per camera with CullVolume, %s with IntervalTree", volume_count, volume_str.begin(), tree_str.begin());
+  return success;
+}
+
+void test_culling_module_init() {
+  add_test(Test {"culling", culling});
+}
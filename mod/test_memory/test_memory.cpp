@@ -1,6 +1,9 @@
+#include <atomic>
+
 #include <L/src/container/Array.h>
 #include <L/src/dev/test.h>
 #include <L/src/math/Rand.h>
+#include <L/src/parallelism/TaskSystem.h>
 #include <L/src/stream/StringStream.h>
 #include <L/src/text/String.h>
 #include <L/src/time/Timer.h>
@@ -10,6 +13,45 @@ using namespace L;
 constexpr uintptr_t iterations = 1 << 20;
 constexpr size_t max_block_size = 1 << 18;
 constexpr size_t max_allocated_limit = 1 << 29;
+constexpr uint32_t thread_iterations = 1 << 18;
+constexpr uint32_t thread_block_count = 256;
+constexpr size_t thread_task_record_size = 256; // Upper bound for the record of each pushed task, which workers keep for reuse
+constexpr uint32_t frame_element_count = 1 << 18;
+
+static std::atomic<uint32_t> thread_alloc_errors;
+
+// Checks a block still holds the pattern of the thread and slot that allocated it
+static void thread_check_free(void* block, size_t size, uint8_t pattern) {
+  for(size_t i = 0; i < size; i++) {
+    if(((const uint8_t*)block)[i] != pattern) {
+      thread_alloc_errors++;
+      break;
+    }
+  }
+  Memory::free(block, size);
+}
+
+// Keeps a window of live blocks, replacing one at each iteration
+// Blocks are filled with a pattern unique to the thread so that blocks shared between thread caches get noticed
+static void thread_alloc_work(void* p) {
+  void* blocks[thread_block_count] = {};
+  size_t sizes[thread_block_count];
+  const uint8_t thread_pattern = uint8_t(uintptr_t(p) * 37);
+  uint32_t seed = uint32_t(uintptr_t(p));
+  for(uint32_t i = 0; i < thread_iterations; i++) {
+    const uint32_t slot = i % thread_block_count;
+    if(blocks[slot]) {
+      thread_check_free(blocks[slot], sizes[slot], uint8_t(thread_pattern + slot));
+    }
+    seed = seed * 1664525u + 1013904223u;
+    sizes[slot] = 8 + (seed >> 16) % 1024;
+    blocks[slot] = Memory::alloc(sizes[slot]);
+    memset(blocks[slot], uint8_t(thread_pattern + slot), sizes[slot]);
+  }
+  for(uint32_t slot = 0; slot < thread_block_count; slot++) {
+    thread_check_free(blocks[slot], sizes[slot], uint8_t(thread_pattern + slot));
+  }
+}
 
 void test_memory_module_init() {
   Test test_memory{};
@@ -74,8 +116,92 @@ void test_memory_module_init() {
     log("test_memory: %d alloc (avg %s, total %s)", alloc_count, alloc_time_avg_str.begin(), alloc_time_total_str.begin());
     log("test_memory: %d free (avg %s, total %s)", free_count, free_time_avg_str.begin(), free_time_total_str.begin());
 
+    const Memory::Stats stats_before_trim = Memory::stats();
+    Memory::trim();
+    const Memory::Stats stats_after_trim = Memory::stats();
+    log("test_memory: trimming brought unused memory from %d to %d bytes (%d bytes reserved)",
+      stats_before_trim.unused, stats_after_trim.unused, stats_after_trim.reserved);
+
     return success;
   };
 
   add_test(test_memory);
+
+  Test test_memory_threads{};
+  test_memory_threads.name = "memory_threads";
+  test_memory_threads.func = []() {
+    bool success = true;
+    for(uint32_t task_count = 1; task_count <= TaskSystem::thread_count(); task_count++) {
+      thread_alloc_errors = 0;
+      const Memory::Stats stats_before = Memory::stats();
+      Timer timer;
+      for(uintptr_t t = 0; t < task_count; t++) {
+        TaskSystem::push(thread_alloc_work, (void*)(t + 1));
+      }
+      TaskSystem::join();
+      const Time time = timer.since();
+      const Memory::Stats stats_after = Memory::stats();
+
+      if(thread_alloc_errors > 0) {
+        warning("test_memory: %d blocks were overwritten with %d threads", thread_alloc_errors.load(), task_count);
+        success = false;
+      }
+      // Every block was freed, only task records recycled by workers may still be allocated
+      if(stats_after.allocated < stats_before.allocated
+         || stats_after.allocated - stats_before.allocated > task_count * thread_task_record_size) {
+        warning("test_memory: %d threads went from %d to %d bytes allocated", task_count, stats_before.allocated, stats_after.allocated);
+        success = false;
+      }
+
+      const String time_str = to_string(time);
+      const uint64_t alloc_count = uint64_t(task_count) * thread_iterations;
+      log("test_memory: %d threads: %d allocs in %s (%d allocs/s)",
+        task_count, alloc_count, time_str.begin(), uint32_t(alloc_count * 1000000ll / max<int64_t>(1, time.microseconds())));
+    }
+
+    const Memory::Stats stats = Memory::stats();
+    log("test_memory: %d bytes allocated, %d unused, %d wasted", stats.allocated, stats.unused, stats.wasted);
+    return success;
+  };
+
+  add_test(test_memory_threads);
+
+  Test test_frame_memory{};
+  test_frame_memory.name = "frame_memory";
+  test_frame_memory.func = []() {
+    bool success = true;
+
+    // Growing past chunk size forces reallocation outside of the last block
+    Array<uint32_t, FrameAllocator> previous, current;
+    for(uint32_t i = 0; i < frame_element_count; i++) {
+      previous.push(i);
+    }
+    Memory::end_frame();
+
+    // Memory from previous frame must still be valid
+    for(uint32_t i = 0; i < frame_element_count; i++) {
+      current.push(~i);
+    }
+    for(uint32_t i = 0; i < frame_element_count; i++) {
+      if(previous[i] != i || current[i] != ~i) {
+        warning("test_memory: frame memory corrupted at %d", i);
+        success = false;
+        break;
+      }
+    }
+    Memory::end_frame();
+
+    Timer timer;
+    for(uint32_t i = 0; i < frame_element_count; i++) {
+      Memory::frame_alloc(64);
+    }
+    const Time time = timer.since();
+    Memory::end_frame();
+
+    const String time_str = to_string(time);
+    log("test_memory: %d frame allocs in %s", frame_element_count, time_str.begin());
+    return success;
+  };
+
+  add_test(test_frame_memory);
 }
@@ -0,0 +1,4 @@
+add_module(
+  test_physics
+  CONDITION ${DEV_DBG}
+)
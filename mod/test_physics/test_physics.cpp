@@ -0,0 +1,365 @@
+#include <L/src/component/Collider.h>
+#include <L/src/component/ContactSolver.h>
+#include <L/src/component/ComponentPool.h>
+#include <L/src/component/Entity.h>
+#include <L/src/component/RigidBody.h>
+#include <L/src/component/Transform.h>
+#include <L/src/container/Array.h>
+#include <L/src/dev/test.h>
+#include <L/src/engine/Engine.h>
+#include <L/src/math/Rand.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uint32_t collider_count = 2048;
+constexpr uint32_t ray_count = 8192;
+constexpr float world_size = 64.f;
+
+static Vector3f random_vector(float min, float max) {
+  return Vector3f(Rand::next(min, max), Rand::next(min, max), Rand::next(min, max));
+}
+
+static void destroy_entities(Array<Handle<Entity>>& entities) {
+  for(Handle<Entity> entity : entities) {
+    Entity::destroy(entity);
+  }
+  Entity::flush_destroy_queue();
+  entities.clear();
+}
+
+static void step_physics() {
+  ComponentPool<RigidBody>::iterate([](RigidBody& rigidbody) { rigidbody.update(); });
+  ComponentPool<RigidBody>::iterate([](RigidBody& rigidbody) { rigidbody.sub_update(); });
+  Collider::custom_sub_update_all();
+}
+
+static bool raycast_batch() {
+  Array<Handle<Entity>> entities;
+  Array<Collider*> colliders;
+  for(uint32_t i = 0; i < collider_count; i++) {
+    Handle<Entity> entity = Entity::create();
+    entity->require_component<Transform>()->position(random_vector(0.f, world_size));
+    Collider* collider = entity->add_component<Collider>();
+    if(i % 2) {
+      collider->box(random_vector(.25f, 1.f));
+    } else {
+      collider->sphere(Rand::next(.25f, 1.f));
+    }
+    entities.push(entity);
+    colliders.push(collider);
+  }
+
+  Array<Collider::Raycast> rays;
+  for(uint32_t i = 0; i < ray_count; i++) {
+    const Vector3f origin = random_vector(0.f, world_size);
+    // Rays of a packet start from the same area like they would for a camera or an explosion
+    const Vector3f direction = (i % 4 == 0 ? random_vector(-1.f, 1.f) : rays[i - i % 4].direction + random_vector(-.1f, .1f)).normalized();
+    rays.push(Collider::Raycast {i % 4 == 0 ? origin : rays[i - i % 4].origin, direction, world_size, nullptr, 0.f});
+  }
+
+  bool success = true;
+  Timer timer;
+  Collider::raycast(rays.begin(), rays.size());
+  const Time batch_time = timer.since();
+
+  // Brute force is slow so only part of the rays are checked
+  for(uint32_t i = 0; i < ray_count; i += 7) {
+    const Collider::Raycast& ray = rays[i];
+    Collider* expected = nullptr;
+    float expected_t = ray.max_t;
+    for(Collider* collider : colliders) {
+      float t;
+      if(collider->raycast_single(ray.origin, ray.direction, t) && t >= 0.f && t < expected_t) {
+        expected = collider;
+        expected_t = t;
+      }
+    }
+    if(expected != ray.collider || (expected && abs(expected_t - ray.t) > 1e-3f)) {
+      warning("test_physics: batched ray hit %p at %f instead of %p at %f", ray.collider, ray.t, expected, expected_t);
+      success = false;
+      break;
+    }
+  }
+
+  timer.setoff();
+  for(const Collider::Raycast& ray : rays) {
+    float t;
+    Collider::raycast(ray.origin, ray.direction, t);
+  }
+  const Time single_time = timer.since();
+
+  const String batch_str = to_string(batch_time), single_str = to_string(single_time);
+  log("test_physics: %d rays against %d colliders: %s batched, %s one by one", ray_count, collider_count, batch_str.begin(), single_str.begin());
+
+  destroy_entities(entities);
+  return success;
+}
+
+// Travels farther than its own size each sub-step toward a thin wall
+static float fast_sphere(bool continuous) {
+  Array<Handle<Entity>> entities;
+  Handle<Entity> wall = Entity::create();
+  wall->require_component<Transform>()->position(Vector3f(5.f, 0.f, 0.f));
+  wall->add_component<Collider>()->box(Vector3f(.05f, 5.f, 5.f));
+  entities.push(wall);
+
+  Handle<Entity> sphere = Entity::create();
+  sphere->require_component<Transform>()->position(Vector3f(0.f, 0.f, 0.f));
+  RigidBody* rigidbody = sphere->add_component<RigidBody>();
+  sphere->add_component<Collider>()->sphere(.25f);
+  rigidbody->continuous(continuous);
+  rigidbody->add_velocity(Vector3f(100.f, 0.f, 0.f));
+  entities.push(sphere);
+
+  for(uint32_t i = 0; i < 32; i++) {
+    step_physics();
+  }
+  const float x = rigidbody->center().x();
+  destroy_entities(entities);
+  return x;
+}
+
+static bool continuous_collision() {
+  const Vector3f gravity = RigidBody::gravity();
+  RigidBody::gravity(Vector3f(0.f, 0.f, 0.f));
+  const float discrete_x = fast_sphere(false);
+  const float continuous_x = fast_sphere(true);
+  RigidBody::gravity(gravity);
+
+  log("test_physics: fast sphere ended at %f without and %f with continuous collision", discrete_x, continuous_x);
+  if(continuous_x > 5.f) {
+    warning("test_physics: fast sphere went through the wall");
+    return false;
+  }
+  return true;
+}
+
+static Collider* create_box(Array<Handle<Entity>>& entities, const Vector3f& position, const Vector3f& radius, bool dynamic) {
+  Handle<Entity> entity = Entity::create();
+  entity->require_component<Transform>()->position(position);
+  if(dynamic) {
+    entity->add_component<RigidBody>();
+  }
+  Collider* collider = entity->add_component<Collider>();
+  collider->box(radius);
+  entities.push(entity);
+  return collider;
+}
+static RigidBody* rigidbody(Collider* collider) {
+  return collider->entity()->get_component<RigidBody>();
+}
+// Bodies fall along -Z like in the samples, gravity is restored once out of scope
+struct ScopedGravity {
+  const Vector3f previous = RigidBody::gravity();
+  ScopedGravity() { RigidBody::gravity(Vector3f(0.f, 0.f, -9.8f)); }
+  ~ScopedGravity() { RigidBody::gravity(previous); }
+};
+static float energy(const Array<Collider*>& boxes) {
+  float energy = 0.f;
+  for(Collider* box : boxes) {
+    const RigidBody* body = rigidbody(box);
+    energy += .5f * body->mass() * body->velocity().length_squared() - body->mass() * RigidBody::gravity().dot(body->center());
+  }
+  return energy;
+}
+
+// Boxes stacked on the ground should come to rest where they were put
+static bool box_stack() {
+  const ScopedGravity gravity;
+  constexpr uint32_t stack_height = 6;
+  Array<Handle<Entity>> entities;
+  create_box(entities, Vector3f(0.f, 0.f, -1.f), Vector3f(10.f, 10.f, 1.f), false);
+  Array<Collider*> boxes;
+  for(uint32_t i = 0; i < stack_height; i++) {
+    boxes.push(create_box(entities, Vector3f(0.f, 0.f, .5f + i), Vector3f(.5f), true));
+  }
+
+  // Resolving overlaps should never push the stack higher than it started
+  const float start_energy = energy(boxes);
+  float max_energy_gain = 0.f, max_jitter = 0.f;
+  Vector3f rest_position;
+  for(uint32_t i = 0; i < 300; i++) {
+    step_physics();
+    max_energy_gain = max(max_energy_gain, energy(boxes) - start_energy);
+    const Vector3f top = rigidbody(boxes.back())->center();
+    if(i == 30) { // Settled but not asleep yet
+      rest_position = top;
+    } else if(i > 30) {
+      max_jitter = max(max_jitter, top.dist(rest_position));
+    }
+  }
+  const Vector3f top = rigidbody(boxes.back())->center();
+  const Vector3f expected_top(0.f, 0.f, stack_height - .5f);
+  destroy_entities(entities);
+
+  log("test_physics: %d box stack: top off by %f, energy gain %f, jitter %f", stack_height, top.dist(expected_top), max_energy_gain, max_jitter);
+  // Overlap correction may lift the stack by a hair, bouncing would add way more
+  if(top.dist(expected_top) > .1f || max_energy_gain > abs(start_energy) * 1e-3f || max_jitter > .01f) {
+    warning("test_physics: box stack did not settle");
+    return false;
+  }
+  return true;
+}
+
+// Resting islands fall asleep together and wake up from forces or awake bodies touching them
+static bool sleeping_islands() {
+  const ScopedGravity gravity;
+  Array<Handle<Entity>> entities;
+  create_box(entities, Vector3f(0.f, 0.f, -1.f), Vector3f(10.f, 10.f, 1.f), false);
+  RigidBody* bottom = rigidbody(create_box(entities, Vector3f(0.f, 0.f, .5f), Vector3f(.5f), true));
+  RigidBody* top = rigidbody(create_box(entities, Vector3f(0.f, 0.f, 1.5f), Vector3f(.5f), true));
+
+  auto steps_until_asleep = [&]() {
+    uint32_t steps = 0;
+    while(!(bottom->sleeping() && top->sleeping()) && steps < 1000) {
+      step_physics();
+      steps++;
+      if(bottom->sleeping() != top->sleeping()) {
+        return uint32_t(-1); // Island bodies are put to sleep together
+      }
+    }
+    return steps;
+  };
+
+  bool success = true;
+  // Bodies rest for half a second of 10ms steps before sleeping
+  const uint32_t first_sleep_steps = steps_until_asleep();
+  log("test_physics: two box island fell asleep after %d steps", first_sleep_steps);
+  if(first_sleep_steps < 50 || first_sleep_steps >= 1000) {
+    warning("test_physics: island fell asleep after %d steps", first_sleep_steps);
+    success = false;
+  }
+
+  // A force wakes its body, which wakes the rest of its island
+  top->add_force(Vector3f(0.f, 0.f, 1.f));
+  const bool force_woke = !top->sleeping();
+  step_physics();
+  const bool island_woke = !bottom->sleeping();
+  if(!force_woke || !island_woke) {
+    warning("test_physics: force did not wake island");
+    success = false;
+  }
+
+  // An awake body landing on the island wakes it up
+  const uint32_t second_sleep_steps = steps_until_asleep();
+  Collider* falling = create_box(entities, Vector3f(0.f, 0.f, 3.f), Vector3f(.25f), true);
+  bool landing_woke = false;
+  for(uint32_t i = 0; i < 100 && !landing_woke; i++) {
+    step_physics();
+    landing_woke = !top->sleeping();
+  }
+  if(!landing_woke || second_sleep_steps >= 1000 || rigidbody(falling)->center().z() < 2.f) {
+    warning("test_physics: falling box did not wake island");
+    success = false;
+  }
+  destroy_entities(entities);
+  return success;
+}
+
+// Contact points are kept between steps and their impulses warm start the solver
+static bool contact_persistence() {
+  const ScopedGravity gravity;
+  Array<Handle<Entity>> entities;
+  Collider* ground = create_box(entities, Vector3f(0.f, 0.f, -1.f), Vector3f(10.f, 10.f, 1.f), false);
+  Collider* box = create_box(entities, Vector3f(0.f, 0.f, .5f), Vector3f(.5f), true);
+  RigidBody* body = rigidbody(box);
+
+  bool success = true;
+  ContactPoint previous_points[ContactManifold::max_point_count];
+  for(uint32_t i = 0; i < 20; i++) {
+    step_physics();
+    if(i < 5) { // Let the box sink into the ground first
+      continue;
+    }
+    const ContactManifold* manifold = ContactSolver::find(box, ground);
+    if(!manifold || manifold->point_count != ContactManifold::max_point_count) {
+      warning("test_physics: resting box has %d contact points", manifold ? manifold->point_count : 0);
+      success = false;
+      break;
+    }
+
+    // Once settled, the accumulated impulses carry the box's weight for the whole step
+    float normal_impulse = 0.f;
+    for(uint32_t p = 0; p < manifold->point_count; p++) {
+      normal_impulse += manifold->points[p].normal_impulse;
+    }
+    const float weight_impulse = body->mass() * RigidBody::gravity().length() * Engine::sub_delta_seconds();
+    if(i >= 10 && abs(normal_impulse - weight_impulse) > weight_impulse * .1f) {
+      warning("test_physics: contact impulse %f instead of %f", normal_impulse, weight_impulse);
+      success = false;
+      break;
+    }
+
+    // Points are anchored to the colliders and don't move while resting
+    if(i >= 10) {
+      for(uint32_t p = 0; p < manifold->point_count; p++) {
+        bool found = false;
+        for(const ContactPoint& previous : previous_points) {
+          found = found || previous.local_a.dist(manifold->points[p].local_a) < .01f;
+        }
+        if(!found) {
+          warning("test_physics: contact point %d moved", p);
+          success = false;
+        }
+      }
+    }
+    memcpy(previous_points, manifold->points, sizeof(previous_points));
+  }
+  destroy_entities(entities);
+  return success;
+}
+
+// Steps a scene of stacks while it is awake and once it is asleep
+static bool sleep_benchmark() {
+  const ScopedGravity gravity;
+  constexpr uint32_t stack_count = 50, stack_height = 10, step_count = 100;
+  Array<Handle<Entity>> entities;
+  create_box(entities, Vector3f(0.f, 0.f, -1.f), Vector3f(64.f, 64.f, 1.f), false);
+  Array<Collider*> boxes;
+  for(uint32_t i = 0; i < stack_count; i++) {
+    for(uint32_t j = 0; j < stack_height; j++) {
+      boxes.push(create_box(entities, Vector3f(float(i % 10) * 4.f, float(i / 10) * 4.f, .5f + j), Vector3f(.5f), true));
+    }
+  }
+
+  Timer timer;
+  for(uint32_t i = 0; i < step_count; i++) {
+    step_physics();
+  }
+  const Time awake_time = timer.since() / step_count;
+
+  auto asleep_count = [&]() {
+    uint32_t count = 0;
+    for(Collider* box : boxes) {
+      count += rigidbody(box)->sleeping();
+    }
+    return count;
+  };
+  for(uint32_t i = 0; i < 1000 && asleep_count() < boxes.size(); i++) {
+    step_physics();
+  }
+
+  timer.setoff();
+  for(uint32_t i = 0; i < step_count; i++) {
+    step_physics();
+  }
+  const Time asleep_time = timer.since() / step_count;
+  const uint32_t final_asleep_count = asleep_count();
+  destroy_entities(entities);
+
+  const String awake_str = to_string(awake_time), asleep_str = to_string(asleep_time);
+  log("test_physics: %d boxes: %s per step awake, %s per step asleep (%d asleep)", boxes.size(), awake_str.begin(), asleep_str.begin(), final_asleep_count);
+  return final_asleep_count == boxes.size();
+}
+
+void test_physics_module_init() {
+  add_test(Test {"raycast_batch", raycast_batch});
+  add_test(Test {"continuous_collision", continuous_collision});
+  add_test(Test {"box_stack", box_stack});
+  add_test(Test {"sleeping_islands", sleeping_islands});
+  add_test(Test {"contact_persistence", contact_persistence});
+  add_test(Test {"sleep_benchmark", sleep_benchmark});
+}
@@ -0,0 +1,5 @@
+add_module(
+  test_script
+  CONDITION ${DEV_DBG}
+  MOD_DEPENDENCIES ls script_optimize
+)
@@ -0,0 +1,134 @@
+#include <L/src/dev/test.h>
+#include <L/src/engine/Resource.h>
+#include <L/src/parallelism/TaskSystem.h>
+#include <L/src/script/ScriptContext.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/time/Timer.h>
+#include "../ls/LSCompiler.h"
+
+using namespace L;
+
+extern void script_optimize_transformer(const ResourceSlot&, ScriptFunction::Intermediate&);
+
+struct ScriptBenchmark {
+  const char* name;
+  const char* source;
+  float expected;
+};
+
+static const ScriptBenchmark benchmarks[] = {
+  {"fib", "(do (set fib (fn n (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))) (fib 22))", 17711.f},
+  {"loop", "(do (local i 0) (local sum 0) (while (< i 200000) (do (set sum (+ sum (/ 3 2))) (set i (+ i 1)))) sum)", 300000.f},
+  {"table", "(do (local o {'x 0 'y 1}) (local i 0) (while (< i 100000) (do (set o.x (+ o.x o.y)) (set i (+ i 1)))) o.x)", 100000.f},
+};
+
+static Ref<ScriptFunction> compile(const char* name, const char* source) {
+  LSCompiler compiler;
+  compiler.set_context(name);
+  ScriptFunction function;
+  if(compiler.read(source, strlen(source)) && compiler.compile(function)) {
+    script_optimize_transformer(ResourceSlot(Symbol("ScriptFunction"), name), function);
+    return ref<ScriptFunction>(function);
+  }
+  return Ref<ScriptFunction>();
+}
+
+static bool script_benchmark() {
+  bool success = true;
+  for(const ScriptBenchmark& benchmark : benchmarks) {
+    Ref<ScriptFunction> function = compile(benchmark.name, benchmark.source);
+    if(!function.is_valid()) {
+      warning("test_script: could not compile %s", benchmark.name);
+      success = false;
+      continue;
+    }
+    // First run quickens instructions, second one shows steady state
+    ScriptContext context;
+    Time times[2];
+    for(uint32_t i = 0; i < 2; i++) {
+      Timer timer;
+      const Var result = context.execute(function);
+      times[i] = timer.since();
+      if(!result.is<float>() || result.as<float>() != benchmark.expected) {
+        warning("test_script: %s returned %s instead of %f", benchmark.name, (const char*)to_string(result), benchmark.expected);
+        success = false;
+      }
+    }
+    const String cold_str = to_string(times[0]), warm_str = to_string(times[1]);
+    log("test_script: %s: %s cold, %s warm", benchmark.name, cold_str.begin(), warm_str.begin());
+  }
+  return success;
+}
+
+// Quickened instructions must still handle operands that aren't floats
+static bool script_quickening() {
+  ScriptContext context;
+  const Var add = context.execute(compile("add", "(fn a b (+ a b))"));
+  const Var less = context.execute(compile("less", "(fn a b (< a b))"));
+  bool success = true;
+  if(context.execute(add.as<Ref<ScriptFunction>>(), {1.f, 2.f}).get<float>() != 3.f) {
+    warning("test_script: float addition failed");
+    success = false;
+  }
+  const Var string_sum = context.execute(add.as<Ref<ScriptFunction>>(), {String("a"), String("b")});
+  if(!string_sum.is<String>() || string_sum.as<String>() != "ab") {
+    warning("test_script: string addition after quickening returned %s", (const char*)to_string(string_sum));
+    success = false;
+  }
+  if(!context.execute(less.as<Ref<ScriptFunction>>(), {1.f, 2.f}).get<bool>()
+     || context.execute(less.as<Ref<ScriptFunction>>(), {String("b"), String("a")}).get<bool>()) {
+    warning("test_script: comparison after quickening failed");
+    success = false;
+  }
+  return success;
+}
+
+// Cached slots of item accesses must not be trusted for tables with another layout
+static bool script_item_cache() {
+  ScriptContext context;
+  const Var increment = context.execute(compile("increment", "(fn o (do (set o.x (+ o.x 1)) o.x))"));
+  const Var small = context.execute(compile("small", "{'x 1 'y 2}"));
+  const Var large = context.execute(compile("large", "{'a 0 'b 0 'c 0 'd 0 'e 0 'f 0 'g 0 'y 2 'x 5}"));
+  bool success = true;
+  for(uint32_t i = 0; i < 4; i++) {
+    const float small_x = context.execute(increment.as<Ref<ScriptFunction>>(), {small}).get<float>();
+    const float large_x = context.execute(increment.as<Ref<ScriptFunction>>(), {large}).get<float>();
+    if(small_x != 2.f + i || large_x != 6.f + i) {
+      warning("test_script: cached item access returned %f and %f instead of %f and %f", small_x, large_x, 2.f + i, 6.f + i);
+      success = false;
+    }
+  }
+  return success;
+}
+
+// Scripts are shared between contexts on different threads, which quicken and cache slots concurrently
+static bool script_shared() {
+  ScriptContext context;
+  const Ref<ScriptFunction> increment = context.execute(compile("shared_increment", "(fn o (do (set o.x (+ o.x 1)) o.x))")).as<Ref<ScriptFunction>>();
+  const Ref<ScriptFunction> small = compile("shared_small", "{'x 1 'y 2}");
+  const Ref<ScriptFunction> large = compile("shared_large", "{'a 0 'b 0 'c 0 'd 0 'e 0 'f 0 'g 0 'y 2 'x 5}");
+  std::atomic<uint32_t> failures {0};
+  TaskSystem::parallel_for(0, 256, 1, [&](uintptr_t i) {
+    ScriptContext task_context;
+    const Var object = task_context.execute((i % 2) ? small : large);
+    const float expected = (i % 2) ? 2.f : 6.f;
+    for(uint32_t j = 0; j < 16; j++) {
+      if(task_context.execute(increment, {object}).get<float>() != expected + j) {
+        failures++;
+      }
+    }
+  });
+  if(failures > 0) {
+    warning("test_script: %d shared script executions returned wrong values", failures.load());
+    return false;
+  }
+  return true;
+}
+
+void test_script_module_init() {
+  add_test(Test {"script_benchmark", script_benchmark});
+  add_test(Test {"script_quickening", script_quickening});
+  add_test(Test {"script_item_cache", script_item_cache});
+  add_test(Test {"script_shared", script_shared});
+}
@@ -0,0 +1,4 @@
+add_module(
+  test_symbol
+  CONDITION ${DEV_DBG}
+)
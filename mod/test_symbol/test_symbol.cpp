@@ -0,0 +1,110 @@
+#include <atomic>
+#include <cstdio>
+
+#include <L/src/container/Array.h>
+#include <L/src/dev/test.h>
+#include <L/src/parallelism/TaskSystem.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/text/Symbol.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uint32_t word_count = 1 << 12;
+constexpr uint32_t thread_iterations = 1 << 16;
+constexpr uint32_t new_symbol_period = 64;
+
+static Array<String> words;
+static Array<Symbol> thread_symbols[TaskSystem::max_thread_count];
+static std::atomic<uint32_t> new_symbol_index;
+
+static uint32_t word_index_for(uintptr_t thread, uint32_t i) {
+  return (i * 7 + uint32_t(thread) * 13) % word_count;
+}
+
+// Mostly looks up existing symbols, sometimes creates a new one
+static void thread_symbol_work(void* p) {
+  uint32_t seed = uint32_t(uintptr_t(p));
+  char buffer[32];
+  for(uint32_t i = 0; i < thread_iterations; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    if(i % new_symbol_period == 0) {
+      const int length = snprintf(buffer, sizeof(buffer), "new_symbol_%u", new_symbol_index++);
+      Symbol(buffer, length);
+    } else {
+      const String& word = words[(seed >> 16) % word_count];
+      Symbol(word.begin(), word.size());
+    }
+  }
+}
+
+void test_symbol_module_init() {
+  for(uint32_t i = 0; i < word_count; i++) {
+    words.push(to_string(i * 2654435761u));
+  }
+
+  Test test_symbol{};
+  test_symbol.name = "symbol";
+  test_symbol.func = []() {
+    bool success = true;
+
+    const Symbol a("symbol_a"), b("symbol_b");
+    if(a == b || a != Symbol("symbol_a") || strcmp(a, "symbol_a") || !Symbol("")) {
+      warning("test_symbol: wrong interning");
+      success = false;
+    }
+    if(L_SYMBOL("symbol_a") != a || L_SYMBOL("symbol_c") != Symbol(String("symbol_c"))) {
+      warning("test_symbol: pre-hashed symbols differ from runtime ones");
+      success = false;
+    }
+
+    // All threads intern the same words in different orders
+    for(uintptr_t t = 0; t < TaskSystem::thread_count(); t++) {
+      TaskSystem::push([](void* p) {
+        const uintptr_t t = uintptr_t(p);
+        for(uint32_t i = 0; i < word_count; i++) {
+          const String& word = words[word_index_for(t, i)];
+          thread_symbols[t].push(Symbol(word.begin(), word.size()));
+        }
+      }, (void*)t);
+    }
+    TaskSystem::join();
+    for(uintptr_t t = 0; t < TaskSystem::thread_count(); t++) {
+      for(uint32_t i = 0; i < word_count; i++) {
+        const String& word = words[word_index_for(t, i)];
+        if(thread_symbols[t][i] != Symbol(word.begin()) || strcmp(thread_symbols[t][i], word.begin())) {
+          warning("test_symbol: thread %d got wrong symbol for %s", t, word.begin());
+          success = false;
+          break;
+        }
+      }
+      thread_symbols[t].clear();
+    }
+
+    return success;
+  };
+
+  add_test(test_symbol);
+
+  Test test_symbol_threads{};
+  test_symbol_threads.name = "symbol_threads";
+  test_symbol_threads.func = []() {
+    for(uint32_t task_count = 1; task_count <= TaskSystem::thread_count(); task_count++) {
+      Timer timer;
+      for(uintptr_t t = 0; t < task_count; t++) {
+        TaskSystem::push(thread_symbol_work, (void*)(t + 1));
+      }
+      TaskSystem::join();
+      const Time time = timer.since();
+
+      const String time_str = to_string(time);
+      const uint64_t symbol_count = uint64_t(task_count) * thread_iterations;
+      log("test_symbol: %d threads: %d symbols in %s (%d symbols/s)",
+        task_count, symbol_count, time_str.begin(), uint32_t(symbol_count * 1000000ll / max<int64_t>(1, time.microseconds())));
+    }
+    return true;
+  };
+
+  add_test(test_symbol_threads);
+}
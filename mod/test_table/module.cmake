@@ -0,0 +1,4 @@
+add_module(
+  test_table
+  CONDITION ${DEV_DBG}
+)
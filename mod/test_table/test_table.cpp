@@ -0,0 +1,184 @@
+#include <L/src/container/Array.h>
+#include <L/src/container/Table.h>
+#include <L/src/dev/test.h>
+#include <L/src/dynamic/Variable.h>
+#include <L/src/math/Rand.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/text/Symbol.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uint32_t element_count = 1 << 16;
+constexpr uint32_t benchmark_element_count = 1 << 18;
+constexpr uint32_t benchmark_symbol_count = 1 << 14;
+constexpr uint32_t benchmark_lookup_rounds = 16;
+
+// Only a handful of distinct hashes, so entries have to be told apart by key
+struct CollidingKey {
+  uint32_t value;
+  inline bool operator==(const CollidingKey& other) const { return value == other.value; }
+};
+inline uint32_t hash(const CollidingKey& key) { return 1 + key.value % 5; }
+
+static uint32_t scramble(uint32_t i) {
+  return i * 2654435761u;
+}
+
+static void log_benchmark(const char* name, uint64_t op_count, const Time& time) {
+  const String time_str = to_string(time);
+  log("test_table: %s: %d ops in %s (%d ops/s)",
+    name, op_count, time_str.begin(), uint32_t(op_count * 1000000ll / max<int64_t>(1, time.microseconds())));
+}
+
+void test_table_module_init() {
+  Test test_table{};
+  test_table.name = "table";
+  test_table.func = []() {
+    bool success = true;
+
+    { // Integer keys with removal
+      Table<uint32_t, uint32_t> table;
+      for(uint32_t i = 0; i < element_count; i++) {
+        table[scramble(i)] = i;
+      }
+      for(uint32_t i = 0; i < element_count; i += 2) {
+        table.remove(scramble(i));
+      }
+      for(uint32_t i = 0; i < element_count; i++) {
+        const uint32_t* value = table.find(scramble(i));
+        if((i % 2) ? (!value || *value != i) : (value != nullptr)) {
+          warning("test_table: wrong lookup for key %d", i);
+          success = false;
+          break;
+        }
+      }
+      uint32_t iterated = 0;
+      for(const auto& slot : table) {
+        iterated += (slot.value() % 2) && slot.key() == scramble(slot.value());
+      }
+      if(table.count() != element_count / 2 || iterated != table.count()) {
+        warning("test_table: iterated %d entries out of %d", iterated, table.count());
+        success = false;
+      }
+    }
+
+    { // Keys sharing the same hash
+      Table<CollidingKey, uint32_t> table;
+      for(uint32_t i = 0; i < 64; i++) {
+        table[CollidingKey{i}] = i * 3;
+      }
+      table.remove(CollidingKey{7});
+      for(uint32_t i = 0; i < 64; i++) {
+        const uint32_t* value = table.find(CollidingKey{i});
+        if(i == 7 ? value != nullptr : (!value || *value != i * 3)) {
+          warning("test_table: wrong lookup for colliding key %d", i);
+          success = false;
+          break;
+        }
+      }
+      if(table.count() != 63) {
+        warning("test_table: %d colliding entries instead of 63", table.count());
+        success = false;
+      }
+    }
+
+    { // Copy and variable keys
+      Table<Var, Var> table;
+      table[Var(Symbol("a"))] = 1.f;
+      table[Var(String("b"))] = 2.f;
+      table[Var(3.f)] = Symbol("c");
+      const Table<Var, Var> copy(table);
+      table.clear();
+      if(copy.count() != 3 || table.count() != 0
+        || copy.get(Var(Symbol("a")), 0.f).get<float>() != 1.f
+        || copy.get(Var(String("b")), 0.f).get<float>() != 2.f
+        || copy.get(Var(3.f), Symbol()).get<Symbol>() != Symbol("c")) {
+        warning("test_table: variable keys lookup failed");
+        success = false;
+      }
+    }
+
+    return success;
+  };
+
+  add_test(test_table);
+
+  Test test_table_benchmark{};
+  test_table_benchmark.name = "table_benchmark";
+  test_table_benchmark.func = []() {
+    uint64_t checksum = 0;
+
+    { // Integer keys
+      Table<uint32_t, uint32_t> table;
+      Timer timer;
+      for(uint32_t i = 0; i < benchmark_element_count; i++) {
+        table[scramble(i)] = i;
+      }
+      log_benchmark("uint32 insert", benchmark_element_count, timer.since());
+
+      timer.setoff();
+      for(uint32_t i = 0; i < benchmark_element_count; i++) {
+        checksum += *table.find(scramble(i));
+      }
+      log_benchmark("uint32 hit", benchmark_element_count, timer.since());
+
+      timer.setoff();
+      for(uint32_t i = benchmark_element_count; i < benchmark_element_count * 2; i++) {
+        checksum += table.find(scramble(i)) != nullptr;
+      }
+      log_benchmark("uint32 miss", benchmark_element_count, timer.since());
+
+      timer.setoff();
+      for(uint32_t i = 0; i < benchmark_element_count; i++) {
+        table.remove(scramble(i));
+      }
+      log_benchmark("uint32 remove", benchmark_element_count, timer.since());
+    }
+
+    { // Symbol keys, like most engine lookups
+      Array<Symbol> symbols;
+      for(uint32_t i = 0; i < benchmark_symbol_count; i++) {
+        symbols.push(Symbol(to_string(scramble(i))));
+      }
+      Table<Symbol, uint32_t> table;
+      for(uint32_t i = 0; i < benchmark_symbol_count; i++) {
+        table[symbols[i]] = i;
+      }
+      Timer timer;
+      for(uint32_t round = 0; round < benchmark_lookup_rounds; round++) {
+        for(const Symbol& symbol : symbols) {
+          checksum += *table.find(symbol);
+        }
+      }
+      log_benchmark("symbol hit", benchmark_symbol_count * benchmark_lookup_rounds, timer.since());
+    }
+
+    { // Variable keys, like script objects
+      Array<Var> keys;
+      for(uint32_t i = 0; i < benchmark_symbol_count; i++) {
+        keys.push(Var(Symbol(to_string(scramble(i)))));
+      }
+      Table<Var, Var> table;
+      Timer timer;
+      for(uint32_t i = 0; i < benchmark_symbol_count; i++) {
+        table[keys[i]] = float(i);
+      }
+      log_benchmark("var insert", benchmark_symbol_count, timer.since());
+
+      timer.setoff();
+      for(uint32_t round = 0; round < benchmark_lookup_rounds; round++) {
+        for(const Var& key : keys) {
+          checksum += table.find(key) != nullptr;
+        }
+      }
+      log_benchmark("var hit", benchmark_symbol_count * benchmark_lookup_rounds, timer.since());
+    }
+
+    log("test_table: checksum %d", uint32_t(checksum));
+    return true;
+  };
+
+  add_test(test_table_benchmark);
+}
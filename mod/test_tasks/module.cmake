@@ -0,0 +1,4 @@
+add_module(
+  test_tasks
+  CONDITION ${DEV_DBG}
+)
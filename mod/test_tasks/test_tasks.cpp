@@ -0,0 +1,187 @@
+#include <atomic>
+
+#include <L/src/container/Array.h>
+#include <L/src/dev/test.h>
+#include <L/src/parallelism/TaskSystem.h>
+#include <L/src/stream/StringStream.h>
+#include <L/src/text/String.h>
+#include <L/src/time/Timer.h>
+
+using namespace L;
+
+constexpr uintptr_t element_count = 1 << 16;
+constexpr uintptr_t benchmark_element_count = 1 << 14;
+constexpr uintptr_t benchmark_iterations = 8;
+constexpr uint32_t yield_iterations = 1 << 18;
+
+static Array<uint32_t> values;
+
+// First eighth of the elements is a hundred times costlier than the rest
+static void skewed_work(uintptr_t i) {
+  const uint32_t work = i < benchmark_element_count / 8 ? 20000 : 200;
+  uint32_t value = uint32_t(i);
+  for(uint32_t j = 0; j < work; j++) {
+    value = value * 1664525u + 1013904223u;
+  }
+  values[i] = value;
+}
+
+static Time static_split_benchmark() {
+  Timer timer;
+  for(uintptr_t iteration = 0; iteration < benchmark_iterations; iteration++) {
+    const uint32_t task_count = TaskSystem::thread_count();
+    for(uintptr_t t = 0; t < task_count; t++) {
+      TaskSystem::push([](void* p) {
+        const uintptr_t t = uintptr_t(p);
+        const uintptr_t count = benchmark_element_count / TaskSystem::thread_count();
+        const uintptr_t end = t == TaskSystem::thread_count() - 1 ? benchmark_element_count : (t + 1) * count;
+        for(uintptr_t i = t * count; i < end; i++) {
+          skewed_work(i);
+        }
+      }, (void*)t);
+    }
+    TaskSystem::join();
+  }
+  return timer.since();
+}
+
+static Time adaptive_split_benchmark() {
+  Timer timer;
+  for(uintptr_t iteration = 0; iteration < benchmark_iterations; iteration++) {
+    TaskSystem::parallel_for(0, benchmark_element_count, 0, skewed_work);
+  }
+  return timer.since();
+}
+
+void test_tasks_module_init() {
+  Test test_parallel_for{};
+  test_parallel_for.name = "parallel_for";
+  test_parallel_for.func = []() {
+    bool success = true;
+
+    values.size(element_count, 0u);
+    TaskSystem::parallel_for(0, element_count, 0, [](uintptr_t i) {
+      values[i] += 1;
+    });
+    for(uintptr_t i = 0; i < element_count; i++) {
+      if(values[i] != 1) {
+        warning("test_tasks: element %d was visited %d times", i, values[i]);
+        success = false;
+        break;
+      }
+    }
+
+    const uint64_t sum = TaskSystem::parallel_reduce(0, element_count, 0, uint64_t(0),
+      [](uintptr_t i) { return uint64_t(i); },
+      [](uint64_t a, uint64_t b) { return a + b; });
+    if(sum != uint64_t(element_count) * (element_count - 1) / 2) {
+      warning("test_tasks: parallel_reduce returned wrong sum %llu", sum);
+      success = false;
+    }
+
+    values.size(benchmark_element_count);
+    const String static_time = to_string(static_split_benchmark());
+    const String adaptive_time = to_string(adaptive_split_benchmark());
+    log("test_tasks: skewed workload on %d threads: static split %s, adaptive split %s",
+      TaskSystem::thread_count(), static_time.begin(), adaptive_time.begin());
+
+    values.clear();
+    return success;
+  };
+
+  add_test(test_parallel_for);
+
+  Test test_yield{};
+  test_yield.name = "yield";
+  test_yield.func = []() {
+    static uint32_t yield_count;
+    yield_count = 0;
+
+    Timer timer;
+    TaskSystem::push([](void*) {
+      for(uint32_t i = 0; i < yield_iterations; i++) {
+        TaskSystem::yield();
+        yield_count++;
+      }
+    });
+    TaskSystem::join();
+    const Time time = timer.since();
+
+    const String time_str = to_string(time);
+    log("test_tasks: %d yields in %s (%d yields/s)",
+      yield_iterations, time_str.begin(), uint32_t(yield_iterations * 1000000ll / max<int64_t>(1, time.microseconds())));
+
+    return yield_count == yield_iterations;
+  };
+
+  add_test(test_yield);
+
+  Test test_wait{};
+  test_wait.name = "wait";
+  test_wait.func = []() {
+    static TaskSystem::Event event;
+    static TaskSystem::Counter counter;
+    static std::atomic<uint32_t> woken_count;
+    // More waiters than fibers so some are suspended while others still need a fiber to start
+    const uint32_t waiter_count = TaskSystem::fiber_count() + 64;
+    event.reset();
+    woken_count = 0;
+
+    // Waiters are suspended until the event is set, then count down
+    counter.increment(waiter_count);
+    for(uint32_t i = 0; i < waiter_count; i++) {
+      TaskSystem::push([](void*) {
+        event.wait();
+        woken_count++;
+        counter.decrement();
+      }, nullptr, uint32_t(-1), TaskSystem::NoParent);
+    }
+    TaskSystem::push([](void*) {
+      for(uint32_t i = 0; i < 16; i++) {
+        TaskSystem::yield();
+      }
+      event.set();
+    }, nullptr, uint32_t(-1), TaskSystem::NoParent);
+
+    counter.wait();
+    return woken_count == waiter_count && counter.value() == 0;
+  };
+
+  add_test(test_wait);
+
+  Test test_fiber_growth{};
+  test_fiber_growth.name = "fiber_growth";
+  test_fiber_growth.func = []() {
+    static TaskSystem::Event event;
+    static TaskSystem::Counter counter;
+    static std::atomic<uint32_t> started_count, sum;
+    static uint32_t blocked_count;
+    // Each waiting task holds a fiber, more of them wait at once than there are fibers yet
+    blocked_count = TaskSystem::fiber_count() * 2 + 256;
+    event.reset();
+    started_count = 0;
+    sum = 0;
+
+    counter.increment(blocked_count);
+    for(uint32_t i = 0; i < blocked_count; i++) {
+      TaskSystem::push([](void*) {
+        started_count++;
+        event.wait();
+        TaskSystem::parallel_for(0, 64, 8, [](uintptr_t i) {
+          sum += uint32_t(i);
+        });
+        counter.decrement();
+      }, nullptr, uint32_t(-1), TaskSystem::NoParent);
+    }
+    TaskSystem::push([](void*) {
+      TaskSystem::yield_until([](void*) { return started_count == blocked_count; });
+      event.set();
+    }, nullptr, uint32_t(-1), TaskSystem::NoParent);
+
+    counter.wait();
+    log("test_tasks: %d tasks waiting at once, %d fibers", blocked_count, TaskSystem::fiber_count());
+    return sum == blocked_count * (63 * 64 / 2) && TaskSystem::fiber_count() > blocked_count;
+  };
+
+  add_test(test_fiber_growth);
+}
@@ -177,7 +177,7 @@ bool VulkanRenderer::init(GenericWindowData* generic_window_data) {
     L_ASSERT(surface);
   }
 
-  uint32_t queue_family_index(UINT32_MAX);
+  queue_family_index = UINT32_MAX;
   { // Fetch queue family index
     uint32_t count(0);
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
@@ -234,36 +234,10 @@ bool VulkanRenderer::init(GenericWindowData* generic_window_data) {
         surface_format = surface_formats[i];
   }
 
-  { // Create command pools
-    const uint32_t command_pool_count(TaskSystem::fiber_count());
-    command_pool = Memory::alloc_type<VkCommandPool>(command_pool_count);
-
-    VkCommandPoolCreateInfo create_info = {};
-    create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    create_info.queueFamilyIndex = queue_family_index;
-    create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-    for(uint32_t i(0); i < command_pool_count; i++) {
-      L_VK_CHECKED(vkCreateCommandPool(_device, &create_info, nullptr, command_pool + i));
-    }
-  }
-
-  { // Create command fences
-    const uint32_t command_fence_count(TaskSystem::fiber_count());
-    command_fence = Memory::alloc_type<VkFence>(command_fence_count);
-
-    VkFenceCreateInfo create_info {};
-    create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-
-    for(uint32_t i(0); i < command_fence_count; i++) {
-      L_VK_CHECKED(vkCreateFence(_device, &create_info, nullptr, command_fence + i));
-    }
-  }
-
   { // Create command buffers
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = *command_pool;
+    allocInfo.commandPool = get_fiber_commands(0).pool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = (uint32_t)L_COUNT_OF(render_command_buffers);
 
@@ -618,11 +592,33 @@ uint32_t VulkanRenderer::find_memory_type(uint32_t type_bits, VkMemoryPropertyFl
   return 0;
 }
 
+VulkanRenderer::FiberCommands& VulkanRenderer::get_fiber_commands(uint32_t fiber_id) {
+  L_SCOPED_LOCK(fiber_commands_lock);
+  while(fiber_commands.size() <= fiber_id) {
+    fiber_commands.push(nullptr);
+  }
+  FiberCommands*& commands(fiber_commands[fiber_id]);
+  if(commands == nullptr) {
+    commands = Memory::new_type<FiberCommands>();
+
+    VkCommandPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.queueFamilyIndex = queue_family_index;
+    pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    L_VK_CHECKED(vkCreateCommandPool(_device, &pool_create_info, nullptr, &commands->pool));
+
+    VkFenceCreateInfo fence_create_info {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    L_VK_CHECKED(vkCreateFence(_device, &fence_create_info, nullptr, &commands->fence));
+  }
+  return *commands;
+}
+
 VkCommandBuffer VulkanRenderer::begin_command_buffer() {
   VkCommandBufferAllocateInfo allocInfo = {};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandPool = command_pool[TaskSystem::fiber_id()];
+  allocInfo.commandPool = get_fiber_commands(TaskSystem::fiber_id()).pool;
   allocInfo.commandBufferCount = 1;
 
   VkCommandBuffer commandBuffer;
@@ -648,7 +644,7 @@ void VulkanRenderer::end_command_buffer(VkCommandBuffer commandBuffer) {
   {
     L_SCOPE_MARKER("Command buffer fence");
     L_SCOPED_LOCK(queue_lock);
-    VkFence fence(command_fence[TaskSystem::fiber_id()]);
+    VkFence fence(get_fiber_commands(TaskSystem::fiber_id()).fence);
     vkQueueSubmit(queue, 1, &submitInfo, fence);
     TaskSystem::yield_until([](void* fence) {
       return vkGetFenceStatus(VulkanRenderer::get()->device(), *(VkFence*)fence) == VK_SUCCESS;
@@ -656,7 +652,7 @@ void VulkanRenderer::end_command_buffer(VkCommandBuffer commandBuffer) {
     vkResetFences(_device, 1, &fence);
   }
 
-  vkFreeCommandBuffers(_device, command_pool[TaskSystem::fiber_id()], 1, &commandBuffer);
+  vkFreeCommandBuffers(_device, get_fiber_commands(TaskSystem::fiber_id()).pool, 1, &commandBuffer);
 }
 
 bool VulkanRenderer::find_buffer(VkDeviceSize size, VkBufferUsageFlagBits usage, VkBuffer& buffer, VkDeviceMemory& memory) {
@@ -68,6 +68,7 @@ protected:
   VkPhysicalDeviceFeatures physical_device_features;
   VkDevice _device;
   VkQueue queue;
+  uint32_t queue_family_index;
   VkSurfaceKHR surface = nullptr;
   VkSurfaceCapabilitiesKHR surface_capabilities;
   VkSurfaceFormatKHR surface_format;
@@ -76,8 +77,12 @@ protected:
   VkImage swapchain_images[2];
   VkImageView swapchain_image_views[2];
   VkFramebuffer framebuffers[2];
-  VkCommandPool* command_pool;
-  VkFence* command_fence;
+  struct FiberCommands { // Command pools can't be shared so each fiber gets its own
+    VkCommandPool pool;
+    VkFence fence;
+  };
+  L::Array<FiberCommands*> fiber_commands; // Created once a fiber records commands, fibers can be added at any time
+  L::Lock fiber_commands_lock;
   VkCommandBuffer render_command_buffers[2];
   VkDescriptorPool _descriptor_pool;
   VkSampler _sampler;
@@ -191,6 +196,7 @@ public:
   VkFormat find_supported_format(VkFormat* candidates, size_t candidate_count, VkFormatFeatureFlags features);
   uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags property_flags);
 
+  FiberCommands& get_fiber_commands(uint32_t fiber_id);
   VkCommandBuffer begin_command_buffer();
   void end_command_buffer(VkCommandBuffer);
 
@@ -32,7 +32,7 @@ static void zlib_compress(const void* in_data_void, size_t in_size, Stream& out_
   deflateEnd(&stream);
 }
 
-static Buffer zlib_decompress(const void* in_data_void, size_t in_size) {
+static bool zlib_decompress(const void* in_data_void, size_t in_size, Buffer& out) {
   Buffer buffer(16);
   z_stream stream{};
   int init_result = inflateInit(&stream);
@@ -46,15 +46,17 @@ static Buffer zlib_decompress(const void* in_data_void, size_t in_size) {
     stream.next_out = ((Bytef*)buffer.data()) + stream.total_out;
     stream.avail_out = (uInt)(buffer.size() - stream.total_out);
     inflate_result = inflate(&stream, Z_FINISH);
-    L_ASSERT(inflate_result == Z_OK || inflate_result == Z_STREAM_END || inflate_result == Z_BUF_ERROR);
-  } while(stream.avail_out == 0);
-  L_ASSERT(stream.total_in == in_size);
-
-  buffer.size(stream.total_out);
+  } while(stream.avail_out == 0 && (inflate_result == Z_OK || inflate_result == Z_BUF_ERROR));
 
   inflateEnd(&stream);
 
-  return buffer;
+  if(inflate_result != Z_STREAM_END || stream.total_in != in_size) {
+    warning("zlib: Couldn't decompress %d bytes", in_size);
+    return false;
+  }
+  buffer.size(stream.total_out);
+  out = static_cast<Buffer&&>(buffer);
+  return true;
 }
 
 void zlib_module_init() {
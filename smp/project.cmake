@@ -4,6 +4,7 @@ add_project(
   # This project purposefully depends on a lot of modules because it tries to showcase as many of them as possible
   MOD_DEPENDENCIES
     alsa # Audio on Linux
+    animation_reduce # Remove animation keys that can be interpolated
     assimp # .glb files
     audio_win # Audio on Windows
     cro_mipmap # Generate mipmaps for textures
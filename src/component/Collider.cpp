@@ -1,19 +1,43 @@
 #include "Collider.h"
 
+#include <limits>
+
 #include "../engine/Engine.h"
 #include "../math/geometry.h"
+#include "../math/simd.h"
 #include "../parallelism/TaskSystem.h"
+#include "ContactSolver.h"
 #include "RigidBody.h"
 #include "ScriptComponent.h"
 #include "Transform.h"
 
 using namespace L;
 
-Interval3fTree<Collider*> Collider::tree;
+BVH<Collider*> Collider::tree;
+Array<Collider::ContactEvent> Collider::contact_events;
+
+static const Symbol collider_symbol("collider"), t_symbol("t"), position_symbol("position");
+static const Symbol type_symbol("type"), enter_symbol("CollisionEnter"), stay_symbol("CollisionStay"), exit_symbol("CollisionExit"),
+  point_symbol("point"), overlap_symbol("overlap"), other_symbol("other"), normal_symbol("normal");
+
+// Pairs touching with a script on either side, kept from frame to frame to detect enter and exit
+struct ContactPair {
+  Handle<Collider> a, b;
+  inline bool operator==(const ContactPair& other) const { return a == other.a && b == other.b; }
+};
+struct ContactState {
+  Vector3f point, normal;
+  float overlap;
+  uint32_t first_frame, last_frame;
+};
+static Table<ContactPair, ContactState> contact_states;
+static const float continuous_skin(.02f); // Overlap left after continuous collision
+static uint32_t contact_frame(0);
+static bool sub_updated(false);
 
-Collider::Collider() : _node(nullptr),_center(0.f),_radius(1.f),_type(Sphere){}
+Collider::Collider() : _node(BVH<Collider*>::null),_center(0.f),_radius(1.f),_type(Sphere),_stay_events(false){}
 Collider::~Collider(){
-  if(_node)
+  if(_node != BVH<Collider*>::null)
     tree.remove(_node);
 }
 
@@ -21,7 +45,7 @@ void Collider::update_components(){
   _transform = entity()->require_component<Transform>();
   _rigidbody = entity()->get_component<RigidBody>();
   _script = entity()->get_component<ScriptComponent>();
-  if(!_node) {
+  if(_node == BVH<Collider*>::null) {
     update_bounding_box();
     _node = tree.insert(_bounding_box,this);
   }
@@ -31,102 +55,224 @@ void Collider::script_registration() {
   L_SCRIPT_METHOD(Collider, "center", 1, center(c.param(0).get<Vector3f>()));
   L_SCRIPT_METHOD(Collider, "box", 1, box(c.param(0).get<Vector3f>()));
   L_SCRIPT_METHOD(Collider, "sphere", 1, sphere(c.param(0)));
+  L_SCRIPT_METHOD(Collider, "stay_events", 1, stay_events(c.param(0).get<bool>()));
   ScriptGlobal(Symbol("raycast")) = (ScriptNativeFunction)([](ScriptContext& c) {
     if(c.param_count()==2 && c.param(0).is<Vector3f>() && c.param(1).is<Vector3f>()) {
       auto wtr(ref<Table<Var, Var>>());
       float t;
       Collider* collider = Collider::raycast(c.param(0).as<Vector3f>(), c.param(1).as<Vector3f>(), t);
-      (*wtr)[Symbol("collider")] = collider ? collider->handle() : Handle<Collider>();
-      (*wtr)[Symbol("t")] = t;
-      (*wtr)[Symbol("position")] = c.param(0).as<Vector3f>()+c.param(1).as<Vector3f>()*t;
+      (*wtr)[collider_symbol] = collider ? collider->handle() : Handle<Collider>();
+      (*wtr)[t_symbol] = t;
+      (*wtr)[position_symbol] = c.param(0).as<Vector3f>()+c.param(1).as<Vector3f>()*t;
+      c.return_value() = wtr;
+    }
+  });
+  ScriptGlobal(Symbol("raycast_batch")) = (ScriptNativeFunction)([](ScriptContext& c) {
+    // Takes an array of origins and an array of directions, returns an array of raycast results
+    const Ref<Array<Var>>* origins(c.param(0).try_as<Ref<Array<Var>>>());
+    const Ref<Array<Var>>* directions(c.param(1).try_as<Ref<Array<Var>>>());
+    if(c.param_count()==2 && origins && directions && (*origins)->size()==(*directions)->size()) {
+      static Array<Raycast> rays;
+      rays.size((*origins)->size());
+      for(uintptr_t i(0); i<rays.size(); i++) {
+        rays[i].origin = (*origins)->operator[](i).get<Vector3f>();
+        rays[i].direction = (*directions)->operator[](i).get<Vector3f>();
+        rays[i].max_t = std::numeric_limits<float>::max();
+      }
+      raycast(rays.begin(), rays.size());
+      auto wtr(ref<Array<Var>>());
+      wtr->size(rays.size());
+      for(uintptr_t i(0); i<rays.size(); i++) {
+        auto result(ref<Table<Var, Var>>());
+        (*result)[collider_symbol] = rays[i].collider ? rays[i].collider->handle() : Handle<Collider>();
+        (*result)[t_symbol] = rays[i].t;
+        (*result)[position_symbol] = rays[i].origin+rays[i].direction*rays[i].t;
+        (*wtr)[i] = result;
+      }
       c.return_value() = wtr;
     }
   });
 
   Engine::add_sub_update(custom_sub_update_all);
+  Engine::add_late_update(dispatch_events);
 }
 
 void Collider::custom_sub_update_all() {
   const uintptr_t thread_count = TaskSystem::thread_count();
+  // Update bounding boxes, only colliders leaving their tree box need to update the tree
+  typedef Array<Collider*> ColliderArray;
+  static ColliderArray* thread_moved = Memory::alloc_type_zero<ColliderArray>(TaskSystem::thread_count());
+  static ColliderArray* thread_continuous = Memory::alloc_type_zero<ColliderArray>(TaskSystem::thread_count());
+  for(uintptr_t t(0); t<thread_count; t++) {
+    thread_moved[t].clear();
+    thread_continuous[t].clear();
+  }
+  ComponentPool<Collider>::async_iterate([](Collider& c, uint32_t t) {
+    if(c._rigidbody && c._rigidbody->sleeping())
+      return; // Sleeping bodies do not move
+    c.update_bounding_box();
+    if(!tree.box(c._node).contains(c._bounding_box))
+      thread_moved[t].push(&c);
+    if(c._rigidbody && c._rigidbody->continuous() && !c._rigidbody->kinematic())
+      thread_continuous[t].push(&c);
+  });
+
   // Update tree nodes
   {
     L_SCOPE_MARKER("Update collision tree");
-    ComponentPool<Collider>::iterate([](Collider& c) {
-      c.update_bounding_box();
-      const Interval3f& bb(c._bounding_box);
-      if(!c._node->key().contains(bb))
-        tree.update(c._node, bb.extended(c._radius.x()));
-    });
+    for(uintptr_t t(0); t<thread_count; t++)
+      for(Collider* c : thread_moved[t])
+        tree.update(c->_node, c->_bounding_box.extended(c->_radius.x()));
+    tree.refit();
+  }
+
+  // Continuous collision: fast bodies are brought back to the first collider they went through
+  // They are left slightly overlapping it so the narrow phase and the solver handle the contact
+  {
+    L_SCOPE_MARKER("Continuous collision");
+    bool moved_back(false);
+    for(uintptr_t t(0); t<thread_count; t++) {
+      for(Collider* c : thread_continuous[t]) {
+        Vector3f direction(c->_transform->position()-c->_rigidbody->sub_start());
+        const float distance(direction.length());
+        const float radius(c->inner_radius());
+        if(distance<=radius)
+          continue; // Cannot have gone through anything the narrow phase would miss
+        direction /= distance;
+        const Vector3f origin(c->_transform->to_absolute(c->_center)-direction*distance);
+        float hit_t;
+        if(sweep(origin, direction, radius, distance, c->entity(), hit_t)) {
+          c->_transform->move_absolute(direction*(min(hit_t+continuous_skin, distance)-distance));
+          c->update_bounding_box();
+          tree.update(c->_node, c->_bounding_box.extended(c->_radius.x()));
+          moved_back = true;
+        }
+      }
+    }
+    if(moved_back)
+      tree.refit();
   }
 
   // Collision: broad phase
-  typedef Array<Interval3fTree<Collider*>::Node*> NodeArray;
-  static NodeArray* pairs = Memory::alloc_type_zero<NodeArray>(TaskSystem::thread_count());
-  static NodeArray* tmp = Memory::alloc_type_zero<NodeArray>(TaskSystem::thread_count());
-  for(uintptr_t t(0); t<thread_count; t++)
-    pairs[t].clear();
-  ComponentPool<Collider>::async_iterate([](Collider& c, uint32_t t) {
-    tree.query(c._bounding_box, tmp[t]);
-    for(auto e : tmp[t])
-      if(e!=c._node && e < c._node)
-        pairs[t].push_multiple(c._node, e);
-  });
+  static ColliderArray& pairs = *Memory::new_type<ColliderArray>();
+  {
+    L_SCOPE_MARKER("Collision broad phase");
+    tree.pairs(pairs);
+  }
 
   // Collision: narrow phase
-  static Array<Collision>* collisions = Memory::alloc_type_zero<Array<Collision>>(TaskSystem::thread_count());
-  for(uintptr_t i(0); i<thread_count; i++)
-    collisions[i].size(pairs[i].size()/2);
-  for(uintptr_t t(0); t<thread_count; t++) {
-    TaskSystem::push([](void* p) {
-      L_SCOPE_MARKER("Collision narrow phase");
-      const uintptr_t t((uintptr_t)p);
-      for(uintptr_t i(0), j(0); i<collisions[t].size(); i++, j += 2) {
-        auto &a(pairs[t][j]), &b(pairs[t][j+1]);
-        if(!a->value()->_rigidbody)
-          swap(a, b); // Rigidbody is always first argument
-        check_collision(*a->value(), *b->value(), collisions[t][i]);
-      }
-    }, (void*)t);
-  }
-  TaskSystem::join();
+  static Array<Collision>& collisions = *Memory::new_type<Array<Collision>>();
+  static Array<uint8_t>& resting = *Memory::new_type<Array<uint8_t>>();
+  collisions.size(pairs.size()/2);
+  resting.size(pairs.size()/2);
+  TaskSystem::parallel_for(0, collisions.size(), 0, [](uintptr_t begin, uintptr_t end, void*) {
+    L_SCOPE_MARKER("Collision narrow phase");
+    for(uintptr_t i(begin); i<end; i++) {
+      Collider *&a(pairs[i*2]), *&b(pairs[i*2+1]);
+      if(!a->_rigidbody || (b->_rigidbody && b<a))
+        swap(a, b); // Rigidbody is always first argument, order is stable for contact manifolds
+      resting[i] = resting_pair(*a, *b);
+      if(resting[i])
+        collisions[i].colliding = false;
+      else
+        check_collision(*a, *b, collisions[i]);
+    }
+  }, nullptr);
 
   {
     L_SCOPE_MARKER("Apply all collisions");
-    for(uintptr_t t(0); t<thread_count; t++)
-      for(uintptr_t i(0); i<collisions[t].size(); i++) {
-        const Collision& collision(collisions[t][i]);
-        if(!collision.colliding)
-          continue;
-        Collider *a(pairs[t][i*2]->value()), *b(pairs[t][i*2+1]->value());
+    ContactSolver::begin();
+    for(uintptr_t i(0); i<collisions.size(); i++) {
+      Collider *a(pairs[i*2]), *b(pairs[i*2+1]);
+      if(resting[i]) {
+        ContactSolver::keep(a, b);
+        continue;
+      }
+      const Collision& collision(collisions[i]);
+      if(!collision.colliding)
+        continue;
+      for(uintptr_t j(0); j<collision.contact_count; j++)
+        ContactSolver::add_point(a, b, collision.contact_points[j], collision.normal, collision.contact_overlaps[j]);
 
-        // Resolve interpenetration
-        if(b->_rigidbody) {
-          a->_transform->move_absolute(collision.normal*(collision.overlap*.5f));
-          b->_transform->move_absolute(collision.normal*(collision.overlap*-.5f));
-        } else a->_transform->move_absolute(collision.normal*collision.overlap);
+      // Script events are sent once per frame after all sub-updates
+      if(a->_script || b->_script)
+        contact_events.push(ContactEvent {a->handle(), b->handle(), collision.point, collision.normal, collision.overlap});
+    }
+  }
 
-        // Send collision events to scripts
-        if(a->_script || b->_script) {
-          auto e(ref<Table<Var, Var>>());
-          (*e)[Symbol("type")] = Symbol("Collision");
-          (*e)[Symbol("point")] = collision.point;
-          (*e)[Symbol("overlap")] = collision.overlap;
-          if(a->_script) {
-            (*e)[Symbol("other")] = b->handle();
-            (*e)[Symbol("normal")] = collision.normal;
-            a->_script->event(e);
-          }
-          if(b->_script) {
-            (*e)[Symbol("other")] = a->handle();
-            (*e)[Symbol("normal")] = -collision.normal;
-            b->_script->event(e);
-          }
-        }
+  ContactSolver::solve(Engine::sub_delta_seconds());
+  sub_updated = true;
+}
+struct ScriptEvent {
+  ContactPair pair;
+  ContactState state;
+  const Symbol* type;
+};
+static void send_event(const ScriptEvent& event) {
+  const Collider *a(event.pair.a), *b(event.pair.b);
+  const bool stay(event.type == &stay_symbol);
+  ScriptComponent* a_script(a && (!stay || a->_stay_events) ? a->_script : nullptr);
+  ScriptComponent* b_script(b && (!stay || b->_stay_events) ? b->_script : nullptr);
+  if(!a_script && !b_script)
+    return;
+  auto e(ref<Table<Var, Var>>());
+  (*e)[type_symbol] = *event.type;
+  (*e)[point_symbol] = event.state.point;
+  (*e)[overlap_symbol] = event.state.overlap;
+  if(a_script) {
+    (*e)[other_symbol] = event.pair.b;
+    (*e)[normal_symbol] = event.state.normal;
+    a_script->event(e);
+  }
+  if(b_script) {
+    (*e)[other_symbol] = event.pair.a;
+    (*e)[normal_symbol] = -event.state.normal;
+    b_script->event(e);
+  }
+}
+void Collider::dispatch_events() {
+  if(!sub_updated)
+    return; // Contacts cannot have changed
+  L_SCOPE_MARKER("Collision events");
+  sub_updated = false;
+  contact_frame++;
 
-        // Physically resolve collision
-        RigidBody::collision(a->_rigidbody, b->_rigidbody, collision.point, collision.normal);
-      }
+  // Merge the contacts of all sub-updates, last one wins
+  for(const ContactEvent& contact : contact_events) {
+    bool created;
+    ContactState& state(*contact_states.find_or_create(ContactPair {contact.a, contact.b}, &created));
+    if(created)
+      state.first_frame = contact_frame;
+    state.point = contact.point;
+    state.normal = contact.normal;
+    state.overlap = contact.overlap;
+    state.last_frame = contact_frame;
+  }
+  contact_events.clear();
+
+  // Gather events first, scripts may destroy colliders while they are sent
+  static Array<ScriptEvent> events;
+  events.clear();
+  for(const auto& pair : contact_states) {
+    const ContactState& state(pair.value());
+    const Collider *a(pair.key().a), *b(pair.key().b);
+    if(state.last_frame != contact_frame && (!a || !b || !resting_pair(*a, *b)))
+      events.push(ScriptEvent {pair.key(), state, &exit_symbol});
+    else if(state.first_frame == contact_frame)
+      events.push(ScriptEvent {pair.key(), state, &enter_symbol});
+    else if(a->_stay_events || b->_stay_events)
+      events.push(ScriptEvent {pair.key(), state, &stay_symbol});
   }
+  for(const ScriptEvent& event : events) {
+    if(event.type == &exit_symbol)
+      contact_states.remove(event.pair);
+    send_event(event);
+  }
+}
+bool Collider::resting_pair(const Collider& a, const Collider& b) {
+  // Contacts of sleeping bodies against static or sleeping bodies are kept as is
+  return a._rigidbody && a._rigidbody->sleeping()
+    && (!b._rigidbody || b._rigidbody->sleeping() || b._rigidbody->velocity().length_squared()==0.f);
 }
 void Collider::center(const Vector3f& center){
   _center = center;
@@ -180,6 +326,21 @@ bool Collider::raycast_single(const Vector3f& origin,const Vector3f& direction,f
   }
   return false;
 }
+bool Collider::sweep_single(const Vector3f& origin, const Vector3f& direction, float radius, float& t) const {
+  switch(_type) {
+    case Box: // Rounded corners of the swept volume are approximated by the box
+      return ray_box_intersect(
+        Interval3f(_center-_radius-radius, _center+_radius+radius),
+        _transform->from_absolute(origin),
+        _transform->rotation().inverse().rotate(direction), t) && t>0.f;
+    case Sphere:
+      return ray_sphere_intersect(_transform->to_absolute(_center), _radius.x()+radius, origin, direction, t) && t>0.f;
+  }
+  return false;
+}
+float Collider::inner_radius() const {
+  return _type==Box ? min(min(_radius.x(), _radius.y()), _radius.z()) : _radius.x();
+}
 Matrix33f Collider::inertia_tensor() const{
   Matrix33f wtr(0.f);
   switch(_type){
@@ -250,15 +411,15 @@ bool Collider::check_collision(const Collider& a,const Collider& b, Collision& c
       br(bt->right()),bf(bt->forward()),bu(bt->up());
     const Vector3f axes[] = {
       ar,af,au,br,bf,bu,
-      ar.cross(br).normalized(),
-      ar.cross(bf).normalized(),
-      ar.cross(bu).normalized(),
-      af.cross(br).normalized(),
-      af.cross(bf).normalized(),
-      af.cross(bu).normalized(),
-      au.cross(br).normalized(),
-      au.cross(bf).normalized(),
-      au.cross(bu).normalized()
+      ar.cross(br),
+      ar.cross(bf),
+      ar.cross(bu),
+      af.cross(br),
+      af.cross(bf),
+      af.cross(bu),
+      au.cross(br),
+      au.cross(bf),
+      au.cross(bu)
     };
     const Vector3f apoints[] = {
       at->to_absolute(a._center+Vector3f(-a._radius.x(),-a._radius.y(),-a._radius.z())),
@@ -283,12 +444,14 @@ bool Collider::check_collision(const Collider& a,const Collider& b, Collision& c
     uintptr_t axis(sizeof(axes));
     collision.overlap = 0.f;
     for(uintptr_t i(0); i<sizeof(axes)/sizeof(Vector3f); i++) {
-      if(axes[i].length_squared()>0.00001f) { // The axis is not a null vector (caused by a cross product)
-        Interval1f axis_a(project<8>(axes[i], apoints)), axis_b(project<8>(axes[i], bpoints)), intersection(axis_a, axis_b); // Compute projections and intersection
+      if(axes[i].length_squared()>0.0001f) { // The axis is not a degenerate cross product of near parallel axes
+        const Vector3f axis_vector(axes[i].normalized());
+        Interval1f axis_a(project<8>(axis_vector, apoints)), axis_b(project<8>(axis_vector, bpoints)), intersection(axis_a, axis_b); // Compute projections and intersection
         const float overlap(intersection.size().x());
         if(overlap>0.f) {
-          if(axis==sizeof(axes) || overlap<collision.overlap) { // First or smallest overlap yet
-            collision.normal = (axis_a.center().x()<axis_b.center().x()) ? -axes[i] : axes[i];
+          // Edge axes need a clearly smaller overlap to be preferred to face axes, which give stable contacts
+          if(axis==sizeof(axes) || overlap<collision.overlap-(i<6 ? 0.f : .01f)) { // First or smallest overlap yet
+            collision.normal = (axis_a.center().x()<axis_b.center().x()) ? -axis_vector : axis_vector;
             collision.overlap = overlap;
             axis = i;
           }
@@ -296,9 +459,27 @@ bool Collider::check_collision(const Collider& a,const Collider& b, Collision& c
       }
     }
     // Compute impact point
-    if(axis<6)
+    if(axis<6) {
       collision.point = (axis<3) ? least_to_axis<8>(-collision.normal, bpoints) : least_to_axis<8>(collision.normal, apoints);
-    else{
+
+      // Vertices of the incident box going through the reference face support the face contact
+      // They are clamped to the reference face, which gives its corners when the incident face is larger
+      const Collider& reference(axis<3 ? a : b);
+      const Vector3f* incident(axis<3 ? bpoints : apoints);
+      const uintptr_t face_axis(axis%3);
+      collision.contact_count = 0;
+      for(uintptr_t i(0); i<8 && collision.contact_count<Collision::max_contact_count; i++) {
+        const Vector3f local(reference._transform->from_absolute(incident[i])-reference._center);
+        const float depth(reference._radius[face_axis]-abs(local[face_axis]));
+        if(depth>0.f && depth<collision.overlap+.01f) {
+          collision.contact_points[collision.contact_count] = reference._transform->to_absolute(reference._center+clamp(local, -reference._radius, reference._radius));
+          collision.contact_overlaps[collision.contact_count] = min(depth, collision.overlap);
+          collision.contact_count++;
+        }
+      }
+      if(collision.contact_count>0)
+        return collision.colliding = true;
+    } else {
       Vector3f avertex(least_to_axis<8>(collision.normal, apoints)), bvertex(least_to_axis<8>(-collision.normal, bpoints));
       const Vector3f& aaxis(axes[(axis-6)/3]),baxis(axes[((axis-6)%3)+3]); // Find axes used in cross product
       if(!line_line_intersect(avertex,avertex+aaxis,bvertex,bvertex+baxis,&avertex,&bvertex))
@@ -339,34 +520,124 @@ bool Collider::check_collision(const Collider& a,const Collider& b, Collision& c
       } else return collision.colliding = false; // No collision
     }
   }
+  collision.contact_points[0] = collision.point;
+  collision.contact_overlaps[0] = collision.overlap;
+  collision.contact_count = 1;
   return collision.colliding = true;
 }
+// Four rays traversing the tree together, stored one component per register
+struct RayPacket {
+  Collider::Raycast* rays[4];
+  Float4 ox, oy, oz, ix, iy, iz, max_t;
+  uint32_t active; // Lanes with a ray
+};
+static inline uint32_t packet_box_mask(const RayPacket& packet, const Interval3f& box) {
+  const Float4 x0(f4_mul(f4_sub(f4_splat(box.min().x()), packet.ox), packet.ix));
+  const Float4 x1(f4_mul(f4_sub(f4_splat(box.max().x()), packet.ox), packet.ix));
+  const Float4 y0(f4_mul(f4_sub(f4_splat(box.min().y()), packet.oy), packet.iy));
+  const Float4 y1(f4_mul(f4_sub(f4_splat(box.max().y()), packet.oy), packet.iy));
+  const Float4 z0(f4_mul(f4_sub(f4_splat(box.min().z()), packet.oz), packet.iz));
+  const Float4 z1(f4_mul(f4_sub(f4_splat(box.max().z()), packet.oz), packet.iz));
+  const Float4 tmin(f4_max(f4_max(f4_min(x0, x1), f4_min(y0, y1)), f4_min(z0, z1)));
+  const Float4 tmax(f4_min(f4_min(f4_max(x0, x1), f4_max(y0, y1)), f4_max(z0, z1)));
+  const Float4 miss(f4_or(f4_or(f4_less(tmax, tmin), f4_less(tmax, f4_splat(0.f))), f4_less(packet.max_t, tmin)));
+  return ~f4_mask(miss) & packet.active;
+}
+static void raycast_packet(RayPacket& packet, Array<int32_t>& stack) {
+  float max_t[4];
+  f4_store(max_t, packet.max_t);
+  stack.clear();
+  if(Collider::tree.root() != BVH<Collider*>::null)
+    stack.push(Collider::tree.root());
+  while(!stack.empty()) {
+    const int32_t node(stack.back());
+    stack.pop();
+    uint32_t mask(packet_box_mask(packet, Collider::tree.box(node)));
+    if(!mask)
+      continue;
+    if(!Collider::tree.leaf(node)) {
+      stack.push_multiple(Collider::tree.left(node), Collider::tree.right(node));
+      continue;
+    }
+    Collider* collider(Collider::tree.value(node));
+    for(uint32_t lane(0); lane<4; lane++) {
+      float t;
+      Collider::Raycast& ray(*packet.rays[lane]);
+      if((mask & (1<<lane)) && collider->raycast_single(ray.origin, ray.direction, t) && t<max_t[lane]) {
+        max_t[lane] = t;
+        ray.collider = collider;
+        ray.t = t;
+      }
+    }
+    packet.max_t = f4_load(max_t);
+  }
+}
+static void raycast_range(Collider::Raycast* rays, uintptr_t begin, uintptr_t end, Array<int32_t>& stack) {
+  static Collider::Raycast dummy;
+  for(uintptr_t i(begin); i<end; i += 4) {
+    RayPacket packet;
+    float o[3][4], id[3][4], max_t[4];
+    packet.active = 0;
+    for(uintptr_t lane(0); lane<4; lane++) {
+      const bool active(i+lane<end);
+      Collider::Raycast& ray(active ? rays[i+lane] : dummy);
+      if(active) {
+        ray.direction.normalize();
+        ray.collider = nullptr;
+        ray.t = ray.max_t;
+        packet.active |= 1<<lane;
+      }
+      packet.rays[lane] = &ray;
+      for(uintptr_t axis(0); axis<3; axis++) {
+        o[axis][lane] = active ? ray.origin[axis] : 0.f;
+        id[axis][lane] = active ? 1.f/ray.direction[axis] : 1.f;
+      }
+      max_t[lane] = active ? ray.max_t : 0.f;
+    }
+    packet.ox = f4_load(o[0]), packet.oy = f4_load(o[1]), packet.oz = f4_load(o[2]);
+    packet.ix = f4_load(id[0]), packet.iy = f4_load(id[1]), packet.iz = f4_load(id[2]);
+    packet.max_t = f4_load(max_t);
+    raycast_packet(packet, stack);
+  }
+}
 Collider* Collider::raycast(const Vector3f& origin,Vector3f direction,float& t){
-  typedef Interval3fTree<Collider*>::Node Node;
-  static Array<const Node*> queue;
-  queue.clear();
-  if(tree.root())
-    queue.push(tree.root());
-
-  direction.normalize();
-  const Vector3f inv_dir(1.f/direction.x(),1.f/direction.y(),1.f/direction.z());
+  static Array<int32_t> stack;
+  Raycast ray {origin, direction, std::numeric_limits<float>::max()};
+  raycast_range(&ray, 0, 1, stack);
+  t = ray.t;
+  return ray.collider;
+}
+void Collider::raycast(Raycast* rays, size_t count) {
+  L_SCOPE_MARKER("Batched raycasts");
+  static Array<int32_t> thread_stacks[TaskSystem::max_thread_count];
+  KeyValue<Raycast*, size_t> batch(rays, count);
+  // Ranges are split on packet boundaries
+  TaskSystem::parallel_for(0, (count+3)/4, 0, [](uintptr_t begin, uintptr_t end, void* data) {
+    const KeyValue<Raycast*, size_t>& batch(*(const KeyValue<Raycast*, size_t>*)data);
+    raycast_range(batch.key(), begin*4, min<uintptr_t>(end*4, batch.value()), thread_stacks[TaskSystem::thread_id()]);
+  }, &batch);
+}
+Collider* Collider::sweep(const Vector3f& origin, const Vector3f& direction, float radius, float max_t, Handle<Entity> ignored, float& t) {
+  static Array<int32_t> stack;
+  const Vector3f inv_dir(1.f/direction.x(), 1.f/direction.y(), 1.f/direction.z());
   Collider* wtr(nullptr);
-  while(!queue.empty()){
-    const Node* node(queue.back());
-    queue.pop();
-    float hitT;
-    const Interval3f& aabb(node->leaf() ? node->value()->_bounding_box : node->key());
-    if(ray_box_intersect(aabb,origin,direction,hitT,inv_dir)){
-      if(wtr && t<hitT) // Already have closer hit
-        continue;
-      if(node->leaf()){
-        if(node->value()->raycast_single(origin,direction,hitT)){
-          wtr = node->value();
-          t = hitT;
-        }
-      } else {
-        queue.push(node->left());
-        queue.push(node->right());
+  t = max_t;
+  stack.clear();
+  if(tree.root() != BVH<Collider*>::null)
+    stack.push(tree.root());
+  while(!stack.empty()) {
+    const int32_t node(stack.back());
+    stack.pop();
+    float hit_t;
+    if(!ray_box_intersect(tree.box(node).extended(radius), origin, direction, hit_t, inv_dir) || hit_t>t)
+      continue;
+    if(!tree.leaf(node)) {
+      stack.push_multiple(tree.left(node), tree.right(node));
+    } else {
+      Collider* collider(tree.value(node));
+      if(collider->entity()!=ignored && collider->sweep_single(origin, direction, radius, hit_t) && hit_t<t) {
+        wtr = collider;
+        t = hit_t;
       }
     }
   }
@@ -1,13 +1,29 @@
 #pragma once
 
 #include "Component.h"
-#include "../container/IntervalTree.h"
+#include "../container/BVH.h"
 
 namespace L {
   class Collider : public TComponent<Collider> {
   public:
-    static Interval3fTree<Collider*> tree;
-    Interval3fTree<Collider*>::Node* _node;
+    // Contact involving a collider with a script, buffered during sub-updates
+    struct ContactEvent {
+      Handle<Collider> a, b;
+      Vector3f point, normal;
+      float overlap;
+    };
+
+    // Ray for batched queries, results are written back into it
+    struct Raycast {
+      Vector3f origin, direction;
+      float max_t; // Farthest distance along the normalized direction
+      Collider* collider; // Closest hit, null if nothing was hit
+      float t;
+    };
+
+    static BVH<Collider*> tree;
+    static Array<ContactEvent> contact_events;
+    int32_t _node;
     class Transform* _transform;
     class RigidBody* _rigidbody;
     class ScriptComponent* _script;
@@ -16,10 +32,16 @@ namespace L {
     enum {
       Box, Sphere
     } _type;
+    bool _stay_events; // Receive an event each frame the contact lasts, not only on enter and exit
     struct Collision {
+      static const uint32_t max_contact_count = 4;
       bool colliding;
       Vector3f point, normal;
       float overlap;
+      // Face contacts between boxes have several points, others only have point
+      Vector3f contact_points[max_contact_count];
+      float contact_overlaps[max_contact_count];
+      uint32_t contact_count;
     };
   public:
     Collider();
@@ -29,14 +51,26 @@ namespace L {
     static void script_registration();
 
     static void custom_sub_update_all();
+    // Sends enter, stay and exit events of the frame to scripts, each pair at most once
+    static void dispatch_events();
     void center(const Vector3f& center);
     void box(const Vector3f& radius);
     void sphere(float radius);
+    inline void stay_events(bool enabled) { _stay_events = enabled; }
     void update_bounding_box();
     bool raycast_single(const Vector3f& origin, const Vector3f& direction, float& t) const;
+    // Casts a sphere of the given radius, hits are only reported if the sphere starts outside
+    bool sweep_single(const Vector3f& origin, const Vector3f& direction, float radius, float& t) const;
+    // Radius of a sphere contained in the collider
+    float inner_radius() const;
     Matrix33f inertia_tensor() const;
     void render(const Camera& camera);
     static bool check_collision(const Collider& a, const Collider& b, Collision&);
+    static bool resting_pair(const Collider& a, const Collider& b);
     static Collider* raycast(const Vector3f& origin, Vector3f direction, float& t);
+    // Casts many rays at once, four rays are traversed together and packets are shared between threads
+    static void raycast(Raycast* rays, size_t count);
+    // Finds the first collider hit by a sphere moving from origin, ignoring colliders of an entity
+    static Collider* sweep(const Vector3f& origin, const Vector3f& direction, float radius, float max_t, Handle<Entity> ignored, float& t);
   };
 }
@@ -39,6 +39,7 @@ namespace L {
   class TComponent : public Component {
   public:
     static const ComponentFlag flags = F;
+    static const uintptr_t async_grain = 0; // Components per async iteration chunk (0 for automatic)
 
     inline void* operator new(size_t) { return ComponentPool<T>::allocate(); }
     inline void operator delete(void* p) { ComponentPool<T>::deallocate((T*)p); }
@@ -53,11 +54,11 @@ namespace L {
     template <typename V = void> static typename std::enable_if<F & FLAG, V>::type NAME
 
     L_COMPONENT_OVERLOAD(ComponentFlag::Update, update_all)() { ComponentPool<T>::iterate([](T& c) { c.update(); }); }
-    L_COMPONENT_OVERLOAD(ComponentFlag::UpdateAsync, update_all_async)() { ComponentPool<T>::async_iterate([](T& c, uint32_t) { c.update(); }); }
+    L_COMPONENT_OVERLOAD(ComponentFlag::UpdateAsync, update_all_async)() { ComponentPool<T>::async_iterate([](T& c, uint32_t) { c.update(); }, T::async_grain); }
     L_COMPONENT_OVERLOAD(ComponentFlag::SubUpdate, sub_update_all)() { ComponentPool<T>::iterate([](T& c) { c.sub_update(); }); }
-    L_COMPONENT_OVERLOAD(ComponentFlag::SubUpdateAsync, sub_update_all_async)() { ComponentPool<T>::async_iterate([](T& c, uint32_t) { c.sub_update(); }); }
+    L_COMPONENT_OVERLOAD(ComponentFlag::SubUpdateAsync, sub_update_all_async)() { ComponentPool<T>::async_iterate([](T& c, uint32_t) { c.sub_update(); }, T::async_grain); }
     L_COMPONENT_OVERLOAD(ComponentFlag::LateUpdate, late_update_all)() { ComponentPool<T>::iterate([](T& c) { c.late_update(); }); }
-    L_COMPONENT_OVERLOAD(ComponentFlag::LateUpdateAsync, late_update_all_async)() { ComponentPool<T>::async_iterate([](T& c, uint32_t) { c.late_update(); }); }
+    L_COMPONENT_OVERLOAD(ComponentFlag::LateUpdateAsync, late_update_all_async)() { ComponentPool<T>::async_iterate([](T& c, uint32_t) { c.late_update(); }, T::async_grain); }
     L_COMPONENT_OVERLOAD(ComponentFlag::Render, render_all, const Camera&, const struct RenderPassImpl*)(const Camera& cam, const struct RenderPassImpl* rp) { ComponentPool<T>::iterate([&](T& c) { c.render(cam, rp); }); }
     L_COMPONENT_OVERLOAD(ComponentFlag::AudioRender, audio_render_all, void*, uint32_t)(void* frames, uint32_t fc) { ComponentPool<T>::iterate([&](T& c) { c.audio_render(frames, fc); }); }
     L_COMPONENT_OVERLOAD(ComponentFlag::GUI, gui_all, const Camera&)(const Camera& cam) { ComponentPool<T>::iterate([&](T& c) { c.gui(cam); }); }
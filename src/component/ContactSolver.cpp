@@ -0,0 +1,312 @@
+#include "ContactSolver.h"
+
+#include "Collider.h"
+#include "RigidBody.h"
+#include "Transform.h"
+#include "../parallelism/TaskSystem.h"
+
+using namespace L;
+
+Table<ContactSolver::Key, ContactManifold> ContactSolver::_manifolds;
+Array<ContactManifold*> ContactSolver::_active_manifolds;
+Array<RigidBody*> ContactSolver::_island_bodies;
+Array<uint32_t> ContactSolver::_island_manifold_starts, ContactSolver::_island_body_starts;
+uint32_t ContactSolver::_frame(0);
+
+static const float merge_distance_sqr(sqr(.05f)); // New points closer than this to an existing point replace it
+static const float drift_distance_sqr(sqr(.05f)); // Anchors sliding further apart than this invalidate a point
+static const float baumgarte(.2f), slop(.01f); // Fraction of the overlap resolved each step, overlap left alone
+static const float restitution_threshold(1.f); // Slower impacts do not bounce
+static const float sleep_linear_sqr(sqr(.1f)), sleep_angular_sqr(sqr(.1f)), sleep_delay(.5f);
+
+static Array<RigidBody*> bodies; // Awake dynamic bodies in contact, indexed by RigidBody::_solver_index
+static Array<uint32_t> parents; // Union-find forest over bodies
+static Array<uint32_t> body_islands, island_counts;
+
+bool ContactSolver::dynamic(const RigidBody* body) {
+  return body && !body->_kinematic;
+}
+bool ContactSolver::listed(const RigidBody* body) {
+  return body->_solver_index < bodies.size() && bodies[body->_solver_index] == body;
+}
+static uint32_t find_root(uint32_t i) {
+  while(parents[i] != i) {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+void ContactSolver::add_body(RigidBody* body) {
+  if(dynamic(body) && !body->_sleeping && !listed(body)) {
+    body->_solver_index = uint32_t(bodies.size());
+    parents.push(uint32_t(bodies.size()));
+    bodies.push(body);
+  }
+}
+Vector3f ContactSolver::velocity_at(const RigidBody* body, const Vector3f& offset) {
+  return body ? body->velocity_at(offset) : Vector3f(0.f);
+}
+void ContactSolver::apply_impulse(RigidBody* body, const Vector3f& impulse, const Vector3f& offset) {
+  if(dynamic(body)) {
+    body->_velocity += body->_inv_mass*impulse;
+    body->_rotation += body->_inv_inertia_tensor_world*offset.cross(impulse);
+  }
+}
+float ContactSolver::effective_mass(const RigidBody* a, const RigidBody* b, const ContactPoint& point, const Vector3f& axis) {
+  float inv_mass(0.f);
+  if(dynamic(a)) {
+    inv_mass += a->_inv_mass + axis.dot(Vector3f(a->_inv_inertia_tensor_world*point.offset_a.cross(axis)).cross(point.offset_a));
+  }
+  if(dynamic(b)) {
+    inv_mass += b->_inv_mass + axis.dot(Vector3f(b->_inv_inertia_tensor_world*point.offset_b.cross(axis)).cross(point.offset_b));
+  }
+  return inv_mass > 0.f ? 1.f/inv_mass : 0.f;
+}
+
+void ContactSolver::begin() {
+  _frame++;
+}
+void ContactSolver::add_point(Collider* a, Collider* b, const Vector3f& world_point, const Vector3f& normal, float overlap) {
+  bool created;
+  ContactManifold& manifold(*_manifolds.find_or_create(Key {a, b}, &created));
+  if(created) {
+    manifold.a = a;
+    manifold.b = b;
+    manifold.point_count = 0;
+  }
+  manifold.body_a = a->_rigidbody;
+  manifold.body_b = b->_rigidbody;
+  manifold.normal = normal;
+  manifold.frame = _frame;
+
+  // Refresh points found in previous steps, dropping those that do not hold anymore
+  for(uintptr_t i(0); i < manifold.point_count;) {
+    ContactPoint& point(manifold.points[i]);
+    const Vector3f delta(a->_transform->to_absolute(point.local_a) - b->_transform->to_absolute(point.local_b));
+    point.depth = point.overlap - delta.dot(normal);
+    const Vector3f drift(delta - normal*delta.dot(normal));
+    if(point.depth < -slop || drift.length_squared() > drift_distance_sqr) {
+      manifold.points[i] = manifold.points[--manifold.point_count];
+    } else {
+      i++;
+    }
+  }
+
+  // Replace the nearest point if it is close enough or if the manifold is full
+  uintptr_t index(manifold.point_count);
+  float closest_distance(0.f);
+  for(uintptr_t i(0); i < manifold.point_count; i++) {
+    const float distance(a->_transform->to_absolute(manifold.points[i].local_a).dist_squared(world_point));
+    if(i == 0 || distance < closest_distance) {
+      closest_distance = distance;
+      index = i;
+    }
+  }
+  if(closest_distance > merge_distance_sqr && manifold.point_count < ContactManifold::max_point_count) {
+    index = manifold.point_count;
+  }
+
+  ContactPoint& point(manifold.points[index]);
+  if(index == manifold.point_count) { // New point
+    manifold.point_count++;
+    point.normal_impulse = point.tangent_impulse[0] = point.tangent_impulse[1] = 0.f;
+  }
+  point.local_a = a->_transform->from_absolute(world_point);
+  point.local_b = b->_transform->from_absolute(world_point);
+  point.overlap = point.depth = overlap;
+}
+void ContactSolver::keep(Collider* a, Collider* b) {
+  if(ContactManifold* manifold = _manifolds.find(Key {a, b})) {
+    manifold->frame = _frame;
+  }
+}
+void ContactSolver::solve(float delta) {
+  L_SCOPE_MARKER("Contact solver");
+
+  // Remove manifolds that were not confirmed this step
+  {
+    static Array<Key> stale_keys;
+    stale_keys.clear();
+    for(const auto& manifold : _manifolds) {
+      if(manifold.value().frame != _frame) {
+        stale_keys.push(manifold.key());
+      }
+    }
+    for(const Key& key : stale_keys) {
+      _manifolds.remove(key);
+    }
+  }
+
+  // Wake sleeping bodies touched by awake or moving bodies
+  for(auto& pair : _manifolds) {
+    ContactManifold& manifold(pair.value());
+    RigidBody *body_a(manifold.body_a), *body_b(manifold.body_b);
+    const bool active_a(body_a && !body_a->_sleeping && (!body_a->_kinematic || body_a->_velocity.length_squared() > sleep_linear_sqr));
+    const bool active_b(body_b && !body_b->_sleeping && (!body_b->_kinematic || body_b->_velocity.length_squared() > sleep_linear_sqr));
+    if(active_a && body_b && body_b->_sleeping) {
+      body_b->wake();
+    }
+    if(active_b && body_a->_sleeping) {
+      body_a->wake();
+    }
+  }
+
+  // Link awake dynamic bodies in contact into islands, static and kinematic bodies do not link islands
+  bodies.clear();
+  parents.clear();
+  for(auto& pair : _manifolds) {
+    ContactManifold& manifold(pair.value());
+    add_body(manifold.body_a);
+    add_body(manifold.body_b);
+    if(listed(manifold.body_a) && manifold.body_b && listed(manifold.body_b)) {
+      const uint32_t root_a(find_root(manifold.body_a->_solver_index)), root_b(find_root(manifold.body_b->_solver_index));
+      if(root_a != root_b) {
+        parents[root_a] = root_b;
+      }
+    }
+  }
+
+  // Number islands and sort bodies and manifolds by island
+  uint32_t island_count(0);
+  body_islands.size(bodies.size());
+  for(uintptr_t i(0); i < bodies.size(); i++) {
+    const uint32_t root(find_root(uint32_t(i)));
+    if(root == i) {
+      body_islands[i] = island_count++;
+    }
+  }
+  for(uintptr_t i(0); i < bodies.size(); i++) {
+    body_islands[i] = body_islands[find_root(uint32_t(i))];
+  }
+
+  _island_body_starts.size(island_count + 1);
+  _island_manifold_starts.size(island_count + 1);
+  memset(_island_body_starts.begin(), 0, _island_body_starts.size() * sizeof(uint32_t));
+  memset(_island_manifold_starts.begin(), 0, _island_manifold_starts.size() * sizeof(uint32_t));
+  for(uintptr_t i(0); i < bodies.size(); i++) {
+    _island_body_starts[body_islands[i] + 1]++;
+  }
+  for(auto& pair : _manifolds) {
+    ContactManifold& manifold(pair.value());
+    RigidBody* body(listed(manifold.body_a) ? manifold.body_a : (manifold.body_b && listed(manifold.body_b) ? manifold.body_b : nullptr));
+    if(body) {
+      manifold.island = body_islands[body->_solver_index];
+      _island_manifold_starts[manifold.island + 1]++;
+    } else {
+      manifold.island = uint32_t(-1); // Asleep or not dynamic
+    }
+  }
+  for(uint32_t i(0); i < island_count; i++) {
+    _island_body_starts[i + 1] += _island_body_starts[i];
+    _island_manifold_starts[i + 1] += _island_manifold_starts[i];
+  }
+
+  island_counts.size(island_count);
+  memcpy(island_counts.begin(), _island_body_starts.begin(), island_count * sizeof(uint32_t));
+  _island_bodies.size(bodies.size());
+  for(uintptr_t i(0); i < bodies.size(); i++) {
+    _island_bodies[island_counts[body_islands[i]]++] = bodies[i];
+  }
+  memcpy(island_counts.begin(), _island_manifold_starts.begin(), island_count * sizeof(uint32_t));
+  _active_manifolds.size(_island_manifold_starts[island_count]);
+  for(auto& pair : _manifolds) {
+    ContactManifold& manifold(pair.value());
+    if(manifold.island != uint32_t(-1)) {
+      _active_manifolds[island_counts[manifold.island]++] = &manifold;
+    }
+  }
+
+  // Islands share no dynamic body so they can be solved concurrently
+  static float solve_delta;
+  solve_delta = delta;
+  TaskSystem::parallel_for(0, island_count, 1, [](uintptr_t begin, uintptr_t end, void*) {
+    for(uintptr_t i(begin); i < end; i++) {
+      solve_island(uint32_t(i), solve_delta);
+    }
+  }, nullptr);
+}
+void ContactSolver::solve_island(uint32_t island, float delta) {
+  ContactManifold** manifolds(_active_manifolds.begin() + _island_manifold_starts[island]);
+  const uintptr_t manifold_count(_island_manifold_starts[island + 1] - _island_manifold_starts[island]);
+  const float inv_delta(1.f/delta);
+
+  // Prepare constraints and warm start with last step's impulses
+  for(uintptr_t m(0); m < manifold_count; m++) {
+    ContactManifold& manifold(*manifolds[m]);
+    RigidBody *body_a(manifold.body_a), *body_b(manifold.body_b);
+    const Vector3f& normal(manifold.normal);
+    manifold.tangents[0] = (abs(normal.x()) > .57f ? Vector3f(normal.y(), -normal.x(), 0.f) : Vector3f(0.f, normal.z(), -normal.y())).normalized();
+    manifold.tangents[1] = normal.cross(manifold.tangents[0]);
+    const float restitution(body_b ? min(body_a->_restitution, body_b->_restitution) : body_a->_restitution);
+    for(uintptr_t p(0); p < manifold.point_count; p++) {
+      ContactPoint& point(manifold.points[p]);
+      point.offset_a = manifold.a->_transform->to_absolute(point.local_a) - body_a->center();
+      point.offset_b = body_b ? manifold.b->_transform->to_absolute(point.local_b) - body_b->center() : Vector3f(0.f);
+      point.normal_mass = effective_mass(body_a, body_b, point, normal);
+      point.tangent_mass[0] = effective_mass(body_a, body_b, point, manifold.tangents[0]);
+      point.tangent_mass[1] = effective_mass(body_a, body_b, point, manifold.tangents[1]);
+
+      const float normal_velocity((velocity_at(body_a, point.offset_a) - velocity_at(body_b, point.offset_b)).dot(normal));
+      point.velocity_bias = baumgarte*inv_delta*max(point.depth - slop, 0.f);
+      if(point.normal_impulse == 0.f && normal_velocity < -restitution_threshold) { // Only new impacts bounce, resting contacts would pump energy into stacks
+        point.velocity_bias = max(point.velocity_bias, -restitution*normal_velocity);
+      }
+
+      const Vector3f impulse(normal*point.normal_impulse + manifold.tangents[0]*point.tangent_impulse[0] + manifold.tangents[1]*point.tangent_impulse[1]);
+      apply_impulse(body_a, impulse, point.offset_a);
+      apply_impulse(body_b, -impulse, point.offset_b);
+    }
+  }
+
+  // Sequential impulses, accumulated impulses are clamped rather than individual ones
+  for(uint32_t iteration(0); iteration < iteration_count; iteration++) {
+    for(uintptr_t m(0); m < manifold_count; m++) {
+      ContactManifold& manifold(*manifolds[m]);
+      RigidBody *body_a(manifold.body_a), *body_b(manifold.body_b);
+      const float friction(body_b ? sqrt(body_a->_friction*body_b->_friction) : body_a->_friction);
+      for(uintptr_t p(0); p < manifold.point_count; p++) {
+        ContactPoint& point(manifold.points[p]);
+
+        // Friction is bounded by the current normal impulse
+        const float max_friction(friction*point.normal_impulse);
+        for(uintptr_t t(0); t < 2; t++) {
+          const Vector3f& tangent(manifold.tangents[t]);
+          const float velocity((velocity_at(body_a, point.offset_a) - velocity_at(body_b, point.offset_b)).dot(tangent));
+          const float old_impulse(point.tangent_impulse[t]);
+          point.tangent_impulse[t] = clamp(old_impulse - velocity*point.tangent_mass[t], -max_friction, max_friction);
+          const Vector3f impulse(tangent*(point.tangent_impulse[t] - old_impulse));
+          apply_impulse(body_a, impulse, point.offset_a);
+          apply_impulse(body_b, -impulse, point.offset_b);
+        }
+
+        const float velocity((velocity_at(body_a, point.offset_a) - velocity_at(body_b, point.offset_b)).dot(manifold.normal));
+        const float old_impulse(point.normal_impulse);
+        point.normal_impulse = max(old_impulse + (point.velocity_bias - velocity)*point.normal_mass, 0.f);
+        const Vector3f impulse(manifold.normal*(point.normal_impulse - old_impulse));
+        apply_impulse(body_a, impulse, point.offset_a);
+        apply_impulse(body_b, -impulse, point.offset_b);
+      }
+    }
+  }
+
+  // Put the island to sleep once all its bodies have been resting long enough
+  RigidBody** island_bodies(_island_bodies.begin() + _island_body_starts[island]);
+  const uintptr_t body_count(_island_body_starts[island + 1] - _island_body_starts[island]);
+  float min_sleep_time(sleep_delay);
+  for(uintptr_t i(0); i < body_count; i++) {
+    RigidBody& body(*island_bodies[i]);
+    if(body._velocity.length_squared() < sleep_linear_sqr && body._rotation.length_squared() < sleep_angular_sqr) {
+      body._sleep_time += delta;
+    } else {
+      body._sleep_time = 0.f;
+    }
+    min_sleep_time = min(min_sleep_time, body._sleep_time);
+  }
+  if(min_sleep_time >= sleep_delay) {
+    for(uintptr_t i(0); i < body_count; i++) {
+      RigidBody& body(*island_bodies[i]);
+      body._sleeping = true;
+      body._velocity = body._rotation = 0.f;
+    }
+  }
+}
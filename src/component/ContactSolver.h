@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../container/Array.h"
+#include "../container/Table.h"
+#include "../math/Vector.h"
+
+namespace L {
+  class Collider;
+  class RigidBody;
+
+  struct ContactPoint {
+    Vector3f local_a, local_b; // Contact point relative to each collider's transform
+    float overlap; // Overlap when the point was found
+    float depth; // Current overlap, follows the anchors
+    float normal_impulse, tangent_impulse[2]; // Accumulated over solver iterations and kept for warm starting
+
+    // Computed before solving
+    Vector3f offset_a, offset_b; // From centers of mass
+    float normal_mass, tangent_mass[2], velocity_bias;
+  };
+
+  // Persistent contact between two colliders, a always has a rigidbody
+  struct ContactManifold {
+    static const uint32_t max_point_count = 4;
+
+    Collider *a, *b;
+    RigidBody *body_a, *body_b;
+    Vector3f normal, tangents[2]; // Normal goes from b to a
+    ContactPoint points[max_point_count];
+    uint32_t point_count;
+    uint32_t frame; // Last sub-step the manifold was confirmed
+    uint32_t island;
+  };
+
+  // Sequential impulse solver over persistent contact manifolds
+  // Bodies touching each other form islands which are solved in parallel and can fall asleep together
+  class ContactSolver {
+  public:
+    struct Key {
+      Collider *a, *b;
+      inline bool operator==(const Key& other) const { return a == other.a && b == other.b; }
+    };
+
+    static const uint32_t iteration_count = 8;
+
+  protected:
+    static Table<Key, ContactManifold> _manifolds;
+    static Array<ContactManifold*> _active_manifolds; // Sorted by island
+    static Array<RigidBody*> _island_bodies; // Sorted by island
+    static Array<uint32_t> _island_manifold_starts, _island_body_starts; // With an extra end offset
+    static uint32_t _frame;
+
+    static bool dynamic(const RigidBody*);
+    static bool listed(const RigidBody*);
+    static void add_body(RigidBody*);
+    static Vector3f velocity_at(const RigidBody*, const Vector3f& offset);
+    static void apply_impulse(RigidBody*, const Vector3f& impulse, const Vector3f& offset);
+    static float effective_mass(const RigidBody* a, const RigidBody* b, const ContactPoint&, const Vector3f& axis);
+    static void solve_island(uint32_t island, float delta);
+
+  public:
+    // Marks the start of a sub-step, manifolds that aren't kept or confirmed afterwards are removed
+    static void begin();
+    // Adds a point found by the narrow phase to the manifold between a and b
+    static void add_point(Collider* a, Collider* b, const Vector3f& point, const Vector3f& normal, float overlap);
+    // Keeps a manifold whose colliders are asleep as is
+    static void keep(Collider* a, Collider* b);
+    // Builds islands, solves velocities and puts resting islands to sleep
+    static void solve(float delta);
+    // Returns null if a and b aren't in contact, a must be the one with a rigidbody
+    static const ContactManifold* find(Collider* a, Collider* b) { return _manifolds.find(Key {a, b}); }
+  };
+}
@@ -20,8 +20,8 @@ namespace L {
   public:
     const Array<KeyValue<const TypeDescription*, Handle<Component>>>& components() const { return _components; }
 
-    template <class CompType>
-    void components(Array<CompType*>& comps) const {
+    template <class CompType, class Allocator>
+    void components(Array<CompType*, Allocator>& comps) const {
       comps.clear();
       for(const auto& p : _components)
         if(p.key() == Type<CompType>::description())
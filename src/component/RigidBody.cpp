@@ -10,8 +10,8 @@ Vector3f RigidBody::_gravity(0.f, 0.f, .0f);
 RigidBody::RigidBody() :
   _inv_inertia_tensor(1.f), _inv_inertia_tensor_world(1.f),
   _velocity(0.f), _rotation(0.f), _force(0.f), _torque(0.f),
-  _inv_mass(1.f), _restitution(.5f), _drag(0.f), _ang_drag(0.f),
-  _kinematic(false) {}
+  _inv_mass(1.f), _restitution(.5f), _friction(.5f), _drag(0.f), _ang_drag(0.f),
+  _sleep_time(0.f), _solver_index(0), _kinematic(false), _sleeping(false), _continuous(false) {}
 
 void RigidBody::update_components() {
   _transform = entity()->require_component<Transform>();
@@ -21,8 +21,10 @@ void RigidBody::update_components() {
 void RigidBody::script_registration() {
   L_COMPONENT_BIND(RigidBody, "rigidbody");
   L_SCRIPT_METHOD(RigidBody, "kinematic", 1, kinematic(c.param(0).get<bool>()));
+  L_SCRIPT_METHOD(RigidBody, "continuous", 1, continuous(c.param(0).get<bool>()));
   L_SCRIPT_METHOD(RigidBody, "mass", 1, mass(c.param(0).get<float>()));
   L_SCRIPT_METHOD(RigidBody, "restitution", 1, restitution(c.param(0).get<float>()));
+  L_SCRIPT_METHOD(RigidBody, "friction", 1, friction(c.param(0).get<float>()));
   L_SCRIPT_METHOD(RigidBody, "drag", 1, drag(c.param(0).get<float>()));
   L_SCRIPT_METHOD(RigidBody, "angular_drag", 1, angular_drag(c.param(0).get<float>()));
   L_SCRIPT_RETURN_METHOD(RigidBody, "get_speed", 0, velocity());
@@ -62,37 +64,37 @@ void RigidBody::update() {
     _last_position = _transform->position();
     _last_rotation = _transform->rotation();
   } else {
-    _force = _torque = 0.f; // Reset force and torque
-    add_force(_gravity/_inv_mass); // Apply gravity
+    // Forces are set directly to avoid waking the body up
+    _force = _gravity/_inv_mass; // Reset force and apply gravity
+    _torque = 0.f;
     if(_velocity.length()>.0f) { // Apply linear drag
       Vector3f drag_force(_velocity);
       drag_force.length(-_drag*_velocity.length_squared());
-      add_force(drag_force);
+      _force += drag_force;
     }
     if(_rotation.length()>.0f) { // Apply angular drag
       Vector3f drag_torque(_rotation);
       drag_torque.length(-_ang_drag*_rotation.length_squared());
-      add_torque(drag_torque);
+      _torque += drag_torque;
     }
   }
 }
 void RigidBody::sub_update() {
-  if(!_kinematic) {
+  if(!_kinematic && !_sleeping) {
     const float delta(Engine::sub_delta_seconds());
     // Compute world inertia tensor
     const Matrix33f orientation(quat_to_mat(_transform->rotation()));
     _inv_inertia_tensor_world = orientation*_inv_inertia_tensor*orientation.transpose();
 
-    // Integrate
-    const Vector3f old_velocity(_velocity), oldRotation(_rotation);
-    _velocity += (_inv_mass*_force)*delta;
-    _rotation += (_inv_inertia_tensor_world*_torque)*delta;
-    _transform->move_absolute((_velocity + old_velocity)*(delta*.5f));
-    const Vector3f rotation_avg((_rotation + oldRotation)*.5f);
-    const float rotation_length(rotation_avg.length());
+    // Integrate, positions use the velocities from the contact solver before forces are applied again
+    _sub_start = _transform->position();
+    _transform->move_absolute(_velocity*delta);
+    const float rotation_length(_rotation.length());
     if(rotation_length > .0f) {
-      _transform->rotate_absolute(Quatf(rotation_avg*(1.f / rotation_length), rotation_length*delta));
+      _transform->rotate_absolute(Quatf(_rotation*(1.f / rotation_length), rotation_length*delta));
     }
+    _velocity += (_inv_mass*_force)*delta;
+    _rotation += (_inv_inertia_tensor_world*_torque)*delta;
   }
 }
 
@@ -112,24 +114,6 @@ void RigidBody::apply_impulse(const Vector3f& impulse, const Vector3f& offset) {
   if(!_kinematic) {
     _velocity += _inv_mass*impulse;
     _rotation += _inv_inertia_tensor_world*offset.cross(impulse);
-  }
-}
-void RigidBody::collision(RigidBody* a, RigidBody* b, const Vector3f& impact, const Vector3f& normal) {
-  const Vector3f
-    arel(impact-a->center()),
-    brel(b ? impact-b->center() : 0.f),
-    av(a->velocity_at(arel)),
-    bv(b ? b->velocity_at(brel) : 0.f);
-
-  const float contact_velocity((av-bv).dot(normal));
-  if(contact_velocity<0.f) {
-    const float restitution(contact_velocity<-.5f ? (b ? min(a->_restitution, b->_restitution) : a->_restitution) : 0.f);
-    const float velocity_from_acc(b ? 0.f : _gravity.dot(normal)*Engine::sub_delta_seconds());
-    const float desired_delta_velocity(-contact_velocity-restitution*(contact_velocity-velocity_from_acc));
-    float delta_velocity(a->delta_velocity(arel, normal));
-    if(b) delta_velocity += b->delta_velocity(brel, normal);
-    const Vector3f impulse(normal*(desired_delta_velocity/delta_velocity));
-    a->apply_impulse(impulse, arel);
-    if(b) b->apply_impulse(-impulse, brel);
+    wake();
   }
 }
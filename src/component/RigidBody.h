@@ -10,9 +10,12 @@ namespace L {
     Transform* _transform;
     Matrix33f _inv_inertia_tensor, _inv_inertia_tensor_world;
     Vector3f _velocity, _rotation, _force, _torque, _last_position;
+    Vector3f _sub_start; // Position before the last sub-update, used by continuous collision
     Quatf _last_rotation;
-    float _inv_mass, _restitution, _drag, _ang_drag;
-    bool _kinematic;
+    float _inv_mass, _restitution, _friction, _drag, _ang_drag;
+    float _sleep_time; // Time spent resting
+    uint32_t _solver_index;
+    bool _kinematic, _sleeping, _continuous;
   public:
     RigidBody();
 
@@ -23,31 +26,41 @@ namespace L {
     void update();
     void sub_update();
 
-    inline void kinematic(bool k) { _kinematic = k; }
+    inline bool kinematic() const { return _kinematic; }
+    inline void kinematic(bool k) { _kinematic = k; wake(); }
+    inline bool sleeping() const { return _sleeping; }
+    inline bool continuous() const { return _continuous; }
+    // Fast bodies can be swept against colliders to avoid going through them
+    inline void continuous(bool c) { _continuous = c; }
+    inline const Vector3f& sub_start() const { return _sub_start; }
+    inline void wake() { _sleeping = false; _sleep_time = 0.f; }
     inline const Vector3f& velocity() const { return _velocity; }
     inline Vector3f relative_velocity() const { return _transform->rotation().inverse().rotate(_velocity); }
     inline float mass() const { return 1.f/_inv_mass; }
     void mass(float m);
     inline float restitution() const { return _restitution; }
     inline void restitution(float r) { _restitution = r; }
+    inline float friction() const { return _friction; }
+    inline void friction(float f) { _friction = f; }
     inline float drag() const { return _drag; }
     inline void drag(float d) { _drag = d; }
     inline float angular_drag() const { return _ang_drag; }
     inline void angular_drag(float d) { _ang_drag = d; }
 
     inline Vector3f center() const { return _transform->position(); }
-    inline void add_velocity(const Vector3f& v) { _velocity += v; }
-    inline void add_force(const Vector3f& f) { _force += f; }
+    inline void add_velocity(const Vector3f& v) { _velocity += v; wake(); }
+    inline void add_force(const Vector3f& f) { _force += f; wake(); }
     inline void add_relative_force(const Vector3f& f) { add_force(_transform->rotation().rotate(f)); }
-    inline void add_torque(const Vector3f& t) { _torque += t; }
+    inline void add_torque(const Vector3f& t) { _torque += t; wake(); }
     inline void add_relative_torque(const Vector3f& t) { add_torque(_transform->rotation().rotate(t)); }
     inline Vector3f velocity_at(const Vector3f& offset) const { return _rotation.cross(offset)+_velocity; }
 
     float delta_velocity(const Vector3f& impact, const Vector3f& normal) const;
     void apply_impulse(const Vector3f& impulse, const Vector3f& offset);
-    static void collision(RigidBody* a, RigidBody* b, const Vector3f& impact, const Vector3f& normal);
 
     static void gravity(const Vector3f& g) { _gravity = g; }
     static const Vector3f& gravity() { return _gravity; }
+
+    friend class ContactSolver;
   };
 }
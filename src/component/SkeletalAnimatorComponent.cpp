@@ -17,37 +17,56 @@ void SkeletalAnimatorComponent::late_update() {
       local_pose.scale = 1.f;
     }
 
-    if(const Animation* animation = _animation.try_load()) {
-      // Compute local pose
-      animation->pose_at(_time, _local_pose.begin());
+    // Layers below a fully weighted override layer are invisible and can be dropped
+    for(uintptr_t i = _layers.size(); i-- > 1;) {
+      const Layer& layer = _layers[i];
+      if(layer.mode == AnimationBlendMode::Override && layer.weight >= 1.f && !layer.mask_joint && layer.animation.is_loaded()) {
+        _layers.erase(0, i);
+        break;
+      }
+    }
 
-      // Compute global pose
-      _global_pose.size(_local_pose.size());
-      for(uintptr_t i = 0; i < _global_pose.size(); i++) {
-        const uintptr_t parent = skeleton->joints[i].parent;
-        const JointPose& local_pose = _local_pose[i];
-        const Matrix44f matrix = sqt_to_mat(local_pose.rotation, local_pose.translation, local_pose.scale);
-        L_ASSERT(parent < i || parent == UINTPTR_MAX);
-        if(parent == UINTPTR_MAX) { // Parent is root
-          _global_pose[i] = matrix;
+    // Compute local pose
+    bool animated = false;
+    for(Layer& layer : _layers) {
+      if(const Animation* animation = layer.animation.try_load()) {
+        const float* joint_weights = nullptr;
+        if(layer.mask_joint) {
+          if(layer.joint_weights.size() != skeleton->joints.size()) {
+            layer.joint_weights.size(skeleton->joints.size());
+            for(uintptr_t i = 0; i < skeleton->joints.size(); i++) {
+              const SkeletonJoint& joint = skeleton->joints[i];
+              layer.joint_weights[i] = (joint.name == layer.mask_joint || (joint.parent >= 0 && layer.joint_weights[joint.parent] > 0.f)) ? 1.f : 0.f;
+            }
+          }
+          joint_weights = layer.joint_weights.begin();
+        }
+
+        if(!animated && layer.mode == AnimationBlendMode::Override && layer.weight >= 1.f && !joint_weights) {
+          animation->pose_at(layer.time, _local_pose.begin(), &layer.cursor);
         } else {
-          _global_pose[i] = _global_pose[parent] * matrix;
+          animation->blend_at(layer.time, _local_pose.begin(), layer.weight, layer.mode, joint_weights, &layer.cursor);
         }
+        animated = true;
+
+        // Increase time
+        layer.time = fmod(layer.time + Engine::delta_seconds(), animation->duration);
       }
+      layer.weight = min(1.f, layer.weight + layer.fade_speed * Engine::delta_seconds());
+    }
 
-      // Increase time
-      _time = fmod(_time + Engine::delta_seconds(), animation->duration);
+    if(animated) {
+      // Compute global pose and skinning matrices
+      _global_pose.size(_local_pose.size());
+      _skin.size(_global_pose.size());
+      compute_skinning(*skeleton, _local_pose.begin(), _global_pose.begin(), _skin.begin());
     } else { // Default global pose
       _global_pose.size(_local_pose.size());
       for(uintptr_t i = 0; i < _global_pose.size(); i++) {
         _global_pose[i] = skeleton->joints[i].inv_bind_pose.inverse();
       }
-    }
-
-    // Compute skinning matrices
-    _skin.size(_global_pose.size());
-    for(uintptr_t i(0); i < _skin.size(); i++) {
-      _skin[i] = _global_pose[i] * skeleton->joints[i].inv_bind_pose;
+      _skin.size(_global_pose.size());
+      compute_skinning(*skeleton, _global_pose.begin(), _skin.begin());
     }
 
     _primitive->material().set_buffer("Pose", _skin.begin(), sizeof(Matrix44f) * _skin.size());
@@ -92,6 +111,26 @@ void SkeletalAnimatorComponent::late_update() {
 #endif
   }
 }
+void SkeletalAnimatorComponent::animation(const char* filename) {
+  _layers.clear();
+  layer(filename, 1.f, AnimationBlendMode::Override);
+}
+void SkeletalAnimatorComponent::crossfade(const char* filename, float duration) {
+  layer(filename, 0.f, AnimationBlendMode::Override);
+  if(duration > 0.f) {
+    _layers.back().fade_speed = 1.f / duration;
+  } else {
+    _layers.back().weight = 1.f;
+  }
+}
+void SkeletalAnimatorComponent::layer(const char* filename, float weight, AnimationBlendMode mode, const Symbol& mask_joint) {
+  Layer layer;
+  layer.animation = filename;
+  layer.weight = weight;
+  layer.mode = mode;
+  layer.mask_joint = mask_joint;
+  _layers.push(layer);
+}
 void SkeletalAnimatorComponent::update_components() {
   _transform = entity()->require_component<Transform>();
   _primitive = entity()->require_component<Primitive>();
@@ -100,4 +139,8 @@ void SkeletalAnimatorComponent::script_registration() {
   L_COMPONENT_BIND(SkeletalAnimatorComponent, "skeletal_animator");
   L_SCRIPT_METHOD(SkeletalAnimatorComponent, "skeleton", 1, skeleton(c.param(0).get<String>()));
   L_SCRIPT_METHOD(SkeletalAnimatorComponent, "animation", 1, animation(c.param(0).get<String>()));
+  L_SCRIPT_METHOD(SkeletalAnimatorComponent, "crossfade", 2, crossfade(c.param(0).get<String>(), c.param(1).get<float>()));
+  L_SCRIPT_METHOD(SkeletalAnimatorComponent, "layer", 2, layer(c.param(0).get<String>(), c.param(1).get<float>(), AnimationBlendMode::Override));
+  L_SCRIPT_METHOD(SkeletalAnimatorComponent, "masked_layer", 3, layer(c.param(0).get<String>(), c.param(1).get<float>(), AnimationBlendMode::Override, c.param(2).get<Symbol>()));
+  L_SCRIPT_METHOD(SkeletalAnimatorComponent, "additive_layer", 2, layer(c.param(0).get<String>(), c.param(1).get<float>(), AnimationBlendMode::Additive));
 }
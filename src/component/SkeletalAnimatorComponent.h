@@ -7,21 +7,36 @@ namespace L {
   class SkeletalAnimatorComponent : public TComponent<SkeletalAnimatorComponent,
     ComponentFlag::LateUpdateAsync> {
   protected:
+    struct Layer {
+      Resource<Animation> animation;
+      AnimationCursor cursor;
+      Symbol mask_joint; // Only affects that joint and its descendants if set
+      Array<float> joint_weights; // Computed from mask_joint
+      float time = 0.f, weight = 1.f;
+      float fade_speed = 0.f; // Weight increase per second
+      AnimationBlendMode mode = AnimationBlendMode::Override;
+    };
+
     Transform* _transform = nullptr;
     Primitive* _primitive = nullptr;
     Resource<Skeleton> _skeleton;
-    Resource<Animation> _animation;
+    Array<Layer> _layers; // From bottom to top
     Array<JointPose> _local_pose;
     Array<Matrix44f> _global_pose;
     Array<Matrix44f> _skin;
-    float _time = 0.f;
 
   public:
+    static const uintptr_t async_grain = 1; // Each instance is costly enough to be its own chunk
+
     void late_update();
     void update_components();
     static void script_registration();
 
     inline void skeleton(const char* filename) { _skeleton = filename; }
-    inline void animation(const char* filename) { _animation = filename; }
+    // Replaces all layers
+    void animation(const char* filename);
+    // Fades in a new layer over duration, layers below are removed once it's done
+    void crossfade(const char* filename, float duration);
+    void layer(const char* filename, float weight, AnimationBlendMode mode, const Symbol& mask_joint = Symbol());
   };
 }
@@ -1,61 +1,275 @@
 #include "Archive.h"
 
+#include <cstdio>
+#include <cstdlib>
+
 #include "../hash.h"
-#include "../stream/CFileStream.h"
+#include "../system/File.h"
 
 using namespace L;
 
 Archive::Archive(const char* path)
-  : _path(path), _entries((Entry*)Memory::alloc(table_size_bytes)) {
-  CFileStream read_stream(_path, "rb");
-  if(read_stream) {
-    verbose("Opening archive %s", _path.begin());
-    read_stream.read(_entries, table_size_bytes);
-  } else {
-    verbose("Creating archive %s", _path.begin());
-    CFileStream write_stream(_path, "wb");
-    memset(_entries, 0, table_size_bytes);
-    write_stream.write(_entries, table_size_bytes);
-  }
+  : _path(path), _header {}, _file(nullptr), _mapping {}, _file_size(0), _create(false) {
+  open();
 }
 Archive::~Archive() {
-  Memory::free(_entries, table_size_bytes);
+  close();
 }
-Archive::Entry& Archive::find(uint32_t key_hash) {
-  uintptr_t index(key_hash%table_entry_count);
-  while(index<table_entry_count) {
-    Entry& e(_entries[index]);
-    if(e.hash==key_hash || e.hash==0)
-      return e;
-    index++;
+Archive::Entry Archive::find(const char* key) {
+  L_SCOPED_LOCK(_lock);
+  const uint64_t key_hash(fnv1a64(key, strlen(key)));
+  if(const Entry* entry = _entries.find(key_hash)) {
+    Record record;
+    const char* record_key;
+    if(read_record(*entry, record, &record_key)) {
+      if(record.key_length == strlen(key) && !memcmp(record_key, key, record.key_length)) {
+        return *entry;
+      }
+      warning("Key %s collides with %.*s in archive %s", key, record.key_length, record_key, _path.begin());
+    }
   }
-  static Entry none {};
-  return none;
+  return Entry {};
 }
 void Archive::store(const char* key, const void* data, size_t size) {
   L_ASSERT(size>0);
   L_SCOPED_LOCK(_lock);
+  if(!open_for_writing()) {
+    warning("Couldn't store key %s in archive %s", key, _path.begin());
+    return;
+  }
   verbose("Storing value of %d bytes to key %s in archive %s", size, key, _path.begin());
-  CFileStream file_stream(_path.begin(), "rb+");
-  const uint32_t key_hash(hash(key));
-  Entry& e(find(key_hash));
+  const uint32_t key_length(uint32_t(strlen(key)));
+  const uint64_t key_hash(fnv1a64(key, key_length));
+  Entry& e(_entries[key_hash]);
+  Record record {size, size, key_length, 0};
 
   // Reuse space if it's enough, otherwise or if there was no entry before,
   // append to end of file
-  if(!e.hash || e.size<size) {
-    e.position = uint32_t(file_stream.size());
+  Record old_record;
+  const char* old_key;
+  const bool has_old_record(e && read_record(e, old_record, &old_key));
+  if(has_old_record && (old_record.key_length!=key_length || memcmp(old_key, key, key_length))) {
+    warning("Key %s replaces colliding key %.*s in archive %s", key, old_record.key_length, old_key, _path.begin());
   }
+  if(has_old_record && old_record.capacity>=size) {
+    record.capacity = old_record.capacity;
+  } else {
+    e.record = _header.data_end;
+    _header.data_end += sizeof(Record)+key_length+size;
+  }
+
+  e.key = key_hash;
+  e.position = e.record+sizeof(Record)+key_length;
+  e.size = size;
+  _file.seek(e.record);
+  _file.write(&record, sizeof(record));
+  _file.write(key, key_length);
+  _file.write(data, size);
 
-  e.hash = key_hash;
-  e.size = uint32_t(size);
-  file_stream.seek(uintptr_t(&e)-uintptr_t(_entries));
-  file_stream.write(&e, sizeof(e));
-  file_stream.seek(e.position);
-  file_stream.write(data, size);
+  // Records may have overwritten the index, it will be written again when closing
+  _header.index_position = 0;
+  write_header();
+  _file.flush(); // Make the data visible to the mapping
+  _file_size = max(_file_size, size_t(_header.data_end));
+}
+bool Archive::load(Entry entry, void* dst) {
+  if(const void* data = map(entry)) {
+    memcpy(dst, data, entry.size);
+    return true;
+  }
+  return false;
 }
-void Archive::load(Entry entry, void* dst) {
+const void* Archive::map(Entry entry) {
   L_ASSERT(entry.size>0);
-  CFileStream file_stream(_path, "rb");
-  file_stream.seek(entry.position);
-  file_stream.read(dst, entry.size);
+  L_SCOPED_LOCK(_lock);
+  return map_range(entry.position, entry.size);
+}
+
+void Archive::compact() {
+  L_SCOPED_LOCK(_lock);
+  const uint64_t old_size(_header.data_end);
+  const String compact_path(_path+".compact");
+  remove(compact_path);
+  {
+    // Keep records in the order they were first written
+    Array<Entry> entries;
+    for(const auto& slot : _entries) {
+      entries.push(slot.value());
+    }
+    qsort(entries.begin(), entries.size(), sizeof(Entry), [](const void* a, const void* b) {
+      const uint64_t pa(((const Entry*)a)->record), pb(((const Entry*)b)->record);
+      return pa < pb ? -1 : int(pa > pb);
+    });
+
+    Archive compacted(compact_path);
+    for(const Entry& entry : entries) {
+      Record record;
+      const char* key;
+      if(read_record(entry, record, &key)) {
+        const String key_string(key, record.key_length);
+        compacted.store(key_string, map_range(entry.position, entry.size), size_t(entry.size));
+      }
+    }
+  }
+  close();
+  remove(_path);
+  rename(compact_path, _path);
+  open();
+  log("Compacted archive %s from %llu to %llu bytes", _path.begin(), (unsigned long long)old_size, (unsigned long long)_header.data_end);
+}
+uint64_t Archive::dead_size() {
+  L_SCOPED_LOCK(_lock);
+  uint64_t live_size(0);
+  for(const auto& slot : _entries) {
+    const Entry& entry(slot.value());
+    live_size += entry.position-entry.record+entry.size;
+  }
+  return _header.data_end-sizeof(Header)-live_size;
+}
+
+void Archive::open() {
+  _mapping.data = File::map(_path, _file_size, _mapping.size);
+  const Header* header(_mapping.size>=sizeof(Header) ? (const Header*)_mapping.data : nullptr); // Mappings are page aligned
+  if(header && header->magic==magic && header->version==version) {
+    verbose("Opening archive %s", _path.begin());
+    _header = *header;
+    if(!read_index()) {
+      warning("Rebuilding index of archive %s", _path.begin());
+      _entries.clear();
+      scan_records();
+    }
+  } else {
+    if(header) {
+      warning("Archive %s has an unknown format, it will be recreated", _path.begin());
+    }
+    if(_mapping.data) { // Nothing points into it and it would prevent truncating on some systems
+      File::unmap(_mapping.data, _mapping.size);
+      _mapping = Mapping {};
+    }
+    _file_size = 0;
+    // The file is only created or truncated when something gets stored
+    _header = Header {magic, version, sizeof(Header), 0, 0};
+    _create = true;
+  }
+}
+bool Archive::open_for_writing() {
+  if(!_file) {
+    if(_create) {
+      verbose("Creating archive %s", _path.begin());
+    }
+    _file.~CFileStream();
+    new(&_file) CFileStream(_path, _create ? "wb+" : "rb+");
+    if(!_file) {
+      return false;
+    }
+    if(_create) {
+      _create = false;
+      write_header();
+      _file.flush();
+      _file_size = sizeof(Header);
+    }
+  }
+  return true;
+}
+void Archive::close() {
+  if(_header.index_position==0 && _file) {
+    // Sorted by key so that identical contents give identical files
+    Array<Entry> entries;
+    for(const auto& slot : _entries) {
+      entries.push(slot.value());
+    }
+    qsort(entries.begin(), entries.size(), sizeof(Entry), [](const void* a, const void* b) {
+      const uint64_t ka(((const Entry*)a)->key), kb(((const Entry*)b)->key);
+      return ka < kb ? -1 : int(ka > kb);
+    });
+    _file.seek(_header.data_end);
+    _file.write(entries.begin(), entries.size()*sizeof(Entry));
+    _header.index_position = _header.data_end;
+    _header.index_count = entries.size();
+    write_header();
+  }
+  _file.~CFileStream();
+  new(&_file) CFileStream(nullptr);
+  _create = false;
+  _entries.clear();
+  if(_mapping.data) {
+    File::unmap(_mapping.data, _mapping.size);
+    _mapping = Mapping {};
+  }
+  for(const Mapping& mapping : _old_mappings) {
+    File::unmap(mapping.data, mapping.size);
+  }
+  _old_mappings.clear();
+  _file_size = 0;
+}
+bool Archive::read_index() {
+  if(_header.index_position<_header.data_end) {
+    return false;
+  }
+  const uint8_t* entries(map_range(_header.index_position, _header.index_count*sizeof(Entry)));
+  if(!entries) {
+    return false;
+  }
+  for(uint64_t i(0); i<_header.index_count; i++) {
+    Entry entry;
+    memcpy(&entry, entries+i*sizeof(Entry), sizeof(entry));
+    _entries[entry.key] = entry;
+  }
+  return true;
+}
+void Archive::scan_records() {
+  uint64_t position(sizeof(Header));
+  while(position<_header.data_end) {
+    Record record;
+    const uint8_t* record_data(map_range(position, sizeof(Record)));
+    if(record_data) {
+      memcpy(&record, record_data, sizeof(record));
+    }
+    if(!record_data || position+sizeof(Record)+record.key_length+record.capacity>_header.data_end) {
+      warning("Archive %s is truncated at %llu", _path.begin(), (unsigned long long)position);
+      _header.data_end = position;
+      break;
+    }
+    const char* key((const char*)(record_data+sizeof(Record)));
+    const uint64_t key_hash(fnv1a64(key, record.key_length));
+    // Later records replace earlier ones with the same key
+    _entries[key_hash] = Entry {key_hash, position, position+sizeof(Record)+record.key_length, record.size};
+    position += sizeof(Record)+record.key_length+record.capacity;
+  }
+}
+void Archive::write_header() {
+  _file.seek(0);
+  _file.write(&_header, sizeof(_header));
+}
+const uint8_t* Archive::map_range(uint64_t position, uint64_t size) {
+  if(position+size > _file_size) {
+    warning("Couldn't map range at %llu in archive %s", (unsigned long long)position, _path.begin());
+    return nullptr;
+  }
+  if(position+size > _mapping.size) {
+    // The file grew past the mapping, map it again with as much room to grow as it already has
+    if(_mapping.data) {
+      _old_mappings.push(_mapping);
+    }
+    _mapping.size = _file_size*2;
+    _mapping.data = File::map(_path, _file_size, _mapping.size);
+    if(!_mapping.data) {
+      warning("Couldn't map archive %s", _path.begin());
+      _mapping = Mapping {};
+      _file_size = 0;
+      return nullptr;
+    }
+  }
+  return (const uint8_t*)_mapping.data + position;
+}
+bool Archive::read_record(const Entry& entry, Record& record, const char** key) {
+  const uint8_t* record_data(map_range(entry.record, entry.position-entry.record));
+  if(!record_data) {
+    return false;
+  }
+  memcpy(&record, record_data, sizeof(record));
+  if(key) {
+    *key = (const char*)(record_data+sizeof(Record));
+  }
+  return true;
 }
@@ -1,31 +1,82 @@
 #pragma once
 
 #include "../parallelism/Lock.h"
+#include "../stream/CFileStream.h"
 #include "../text/String.h"
-#include "../hash.h"
+#include "Array.h"
+#include "Table.h"
 
 namespace L {
+  // File layout: header, records (record header, key and data) then an index of all live entries
+  // The index is only written when closing, records are scanned to rebuild it if it's missing
+  // Records and the index aren't aligned inside the file, they're copied out of the mapping before being read
   class Archive {
   public:
     struct Entry {
-      uint32_t hash;
-      uint32_t position;
-      uint32_t size;
+      uint64_t key; // Hash of the key string
+      uint64_t record; // Position of the record header
+      uint64_t position; // Position of the data
+      uint64_t size;
       inline operator bool() const { return size > 0; }
     };
-    static const size_t table_size_bytes = 1 << 16; // 64KB
-    static const size_t table_entry_count = table_size_bytes / sizeof(Entry);
   protected:
+    struct Header {
+      uint32_t magic;
+      uint32_t version;
+      uint64_t data_end; // Records stop there
+      uint64_t index_position; // Null if the index is out of date
+      uint64_t index_count;
+    };
+    struct Record {
+      uint64_t capacity; // Space reserved for data, may be more than size after reuse
+      uint64_t size;
+      uint32_t key_length;
+      uint32_t padding;
+    };
+    struct Mapping {
+      const void* data;
+      size_t size; // May extend past the end of the file so it can grow without remapping
+    };
+    static const uint32_t magic = 0x4352414c; // LARC
+    static const uint32_t version = 1;
+
     String _path;
-    Entry* _entries;
+    Header _header;
+    Table<uint64_t, Entry> _entries;
+    CFileStream _file; // Only opened when storing, reads go through the mapping
+    Mapping _mapping;
+    Array<Mapping> _old_mappings; // Kept until closing because readers may still point into them
+    size_t _file_size; // Only the part of the mapping within the file can be read
     Lock _lock;
+    bool _create; // The file is missing or has an unknown format
 
   public:
     Archive(const char* path);
     ~Archive();
-    inline Entry& find(const char* key) { return find(hash(key)); }
-    Entry& find(uint32_t key_hash);
+    // Returns an empty entry if the key is missing
+    Entry find(const char* key);
     void store(const char* key, const void* data, size_t size);
-    void load(Entry, void*);
+    bool load(Entry, void*);
+    // Returns a read-only pointer to the entry's data inside the mapped file, or null on failure
+    // It stays valid until the archive is closed
+    const void* map(Entry);
+
+    // Rewrites the file with only live records
+    // Offline operation: no pointer previously returned by map may be in use
+    void compact();
+    // Bytes that compacting would reclaim
+    uint64_t dead_size();
+    inline uint64_t file_size() const { return _header.data_end; }
+    inline uintptr_t count() const { return _entries.count(); }
+
+  protected:
+    void open();
+    bool open_for_writing();
+    void close();
+    bool read_index();
+    void scan_records();
+    void write_header();
+    const uint8_t* map_range(uint64_t position, uint64_t size);
+    bool read_record(const Entry&, Record&, const char** key = nullptr);
   };
 }
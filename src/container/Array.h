@@ -8,7 +8,7 @@
 #include "../dev/debug.h"
 
 namespace L {
-  template <class T>
+  template <class T, class Allocator = DefaultAllocator>
   class Array {
   protected:
     T* _data = nullptr;
@@ -36,7 +36,7 @@ namespace L {
     }
     inline Array(const Array& other) : _size(other._size), _capacity(other._capacity) {
       if(!other.empty()) {
-        _data = (T*)Memory::alloc(_capacity * sizeof(T));
+        _data = (T*)Allocator::alloc(_capacity * sizeof(T));
         copy(_data, other._data, _size);
       } else _data = nullptr;
     }
@@ -48,7 +48,7 @@ namespace L {
       if(_data) {
         for(uintptr_t i(0); i < _size; i++)
           (_data + i)->~T();
-        Memory::free(_data, _capacity * sizeof(T));
+        Allocator::free(_data, _capacity * sizeof(T));
       }
     }
     inline Array& operator=(const Array& other) {
@@ -122,7 +122,7 @@ namespace L {
     void capacity(size_t n) {
       if(n != capacity()) {
         L_ASSERT_MSG(n >= _size, "Cannot have capacity of array inferior to its size");
-        _data = (T*)Memory::realloc(_data, _capacity * sizeof(T), n * sizeof(T));
+        _data = (T*)Allocator::realloc(_data, _capacity * sizeof(T), n * sizeof(T));
         _capacity = n;
       }
     }
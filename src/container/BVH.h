@@ -0,0 +1,336 @@
+#pragma once
+
+#include "Array.h"
+#include "../math/Interval.h"
+#include "../parallelism/TaskSystem.h"
+
+namespace L {
+  // Dynamic bounding volume hierarchy for moving objects
+  // Nodes are indices into parallel arrays, traversals only touch boxes and children
+  // Leaves are inserted using the surface area heuristic and kept in shape with tree rotations
+  template <class V>
+  class BVH {
+  public:
+    static constexpr int32_t null = -1;
+
+  protected:
+    struct Task { int32_t a, b; }; // Self-traversal of a if a==b, a against b otherwise
+
+    Array<Interval3f> _box;
+    Array<int32_t> _left, _right; // Left is null for leaves, right links free nodes
+    Array<int32_t> _parent;
+    Array<uint8_t> _dirty; // Box of dirty internal nodes must be recomputed
+    Array<V> _value;
+    int32_t _root = null, _free = null;
+    Array<int32_t> _refit_top;
+    Array<Task> _tasks;
+    Array<Task> _thread_stacks[TaskSystem::max_thread_count];
+    Array<V> _thread_pairs[TaskSystem::max_thread_count];
+
+  public:
+    inline int32_t root() const { return _root; }
+    inline bool leaf(int32_t node) const { return _left[node] == null; }
+    inline int32_t left(int32_t node) const { return _left[node]; }
+    inline int32_t right(int32_t node) const { return _right[node]; }
+    inline const Interval3f& box(int32_t node) const { return _box[node]; }
+    inline const V& value(int32_t node) const { return _value[node]; }
+
+    int32_t insert(const Interval3f& box, const V& value) {
+      const int32_t leaf(allocate());
+      _box[leaf] = box;
+      _value[leaf] = value;
+      if(_root == null) {
+        _root = leaf;
+        return leaf;
+      }
+
+      const int32_t sibling(find_sibling(box));
+      const int32_t old_parent(_parent[sibling]);
+      const int32_t parent(allocate());
+      _parent[parent] = old_parent;
+      _left[parent] = sibling;
+      _right[parent] = leaf;
+      _box[parent] = _box[sibling] + box;
+      _parent[sibling] = _parent[leaf] = parent;
+      if(old_parent == null) {
+        _root = parent;
+      } else {
+        replace_child(old_parent, sibling, parent);
+        refit_ancestors(old_parent);
+      }
+      return leaf;
+    }
+    void remove(int32_t leaf) {
+      L_ASSERT(this->leaf(leaf));
+      if(leaf == _root) {
+        _root = null;
+      } else {
+        const int32_t parent(_parent[leaf]);
+        const int32_t grand_parent(_parent[parent]);
+        const int32_t sibling(_left[parent] == leaf ? _right[parent] : _left[parent]);
+        _parent[sibling] = grand_parent;
+        if(grand_parent == null) {
+          _root = sibling;
+        } else {
+          replace_child(grand_parent, parent, sibling);
+          refit_ancestors(grand_parent);
+        }
+        release(parent);
+      }
+      release(leaf);
+    }
+    // Changes the box of a leaf, ancestors are only updated on refit
+    void update(int32_t leaf, const Interval3f& box) {
+      _box[leaf] = box;
+      for(int32_t node(_parent[leaf]); node != null && !_dirty[node]; node = _parent[node]) {
+        _dirty[node] = true;
+      }
+    }
+    // Recomputes boxes of dirty nodes and rotates them, disjoint dirty subtrees are processed in parallel
+    void refit() {
+      if(_root == null || leaf(_root) || !_dirty[_root]) {
+        return;
+      }
+
+      // Split the dirty part of the tree breadth first until there are enough subtrees
+      const uintptr_t target_count(TaskSystem::thread_count() * 8);
+      _refit_top.clear();
+      _tasks.clear();
+      _tasks.push(Task {_root, _root});
+      for(uintptr_t i(0); i < _tasks.size() && _tasks.size() - i < target_count; i++) {
+        const int32_t node(_tasks[i].a);
+        _refit_top.push(node);
+        if(!leaf(_left[node]) && _dirty[_left[node]]) {
+          _tasks.push(Task {_left[node], _left[node]});
+        }
+        if(!leaf(_right[node]) && _dirty[_right[node]]) {
+          _tasks.push(Task {_right[node], _right[node]});
+        }
+        _tasks[i].a = null; // Refitted with the top of the tree
+      }
+
+      TaskSystem::parallel_for(0, _tasks.size(), 1, [](uintptr_t begin, uintptr_t end, void* p) {
+        BVH& bvh(*(BVH*)p);
+        for(uintptr_t i(begin); i < end; i++) {
+          if(bvh._tasks[i].a != null) {
+            bvh.refit_subtree(bvh._tasks[i].a);
+          }
+        }
+      }, this);
+
+      for(uintptr_t i(_refit_top.size()); i-- > 0;) {
+        refit_node(_refit_top[i]);
+        _dirty[_refit_top[i]] = false;
+      }
+    }
+    // Finds all pairs of leaves with overlapping boxes, each pair appears once
+    // Values of pairs are pushed next to each other
+    void pairs(Array<V>& pairs) {
+      pairs.clear();
+      if(_root == null) {
+        return;
+      }
+
+      // Expand the traversal breadth first to get enough tasks to share between threads
+      const uintptr_t target_count(TaskSystem::thread_count() * 16);
+      _tasks.clear();
+      _tasks.push(Task {_root, _root});
+      for(uintptr_t i(0); i < _tasks.size() && _tasks.size() - i < target_count; i++) {
+        const Task task(_tasks[i]);
+        if(task.a == task.b ? leaf(task.a) : (leaf(task.a) && leaf(task.b))) {
+          continue;
+        }
+        _tasks[i] = Task {null, null};
+        expand(task, _tasks);
+      }
+
+      for(uint32_t t(0); t < TaskSystem::thread_count(); t++) {
+        _thread_pairs[t].clear();
+      }
+      TaskSystem::parallel_for(0, _tasks.size(), 0, [](uintptr_t begin, uintptr_t end, void* p) {
+        BVH& bvh(*(BVH*)p);
+        const uint32_t thread_id(TaskSystem::thread_id());
+        Array<Task>& stack(bvh._thread_stacks[thread_id]);
+        Array<V>& thread_pairs(bvh._thread_pairs[thread_id]);
+        for(uintptr_t i(begin); i < end; i++) {
+          if(bvh._tasks[i].a == null) {
+            continue;
+          }
+          stack.push(bvh._tasks[i]);
+          while(!stack.empty()) {
+            const Task task(stack.back());
+            stack.pop();
+            if(task.a != task.b && bvh.leaf(task.a) && bvh.leaf(task.b)) {
+              thread_pairs.push_multiple(bvh._value[task.a], bvh._value[task.b]);
+            } else {
+              bvh.expand(task, stack);
+            }
+          }
+        }
+      }, this);
+
+      for(uint32_t t(0); t < TaskSystem::thread_count(); t++) {
+        pairs += _thread_pairs[t];
+      }
+    }
+    void query(const Interval3f& zone, Array<V>& values) const {
+      values.clear();
+      if(_root == null) {
+        return;
+      }
+      Array<int32_t> stack;
+      stack.push(_root);
+      while(!stack.empty()) {
+        const int32_t node(stack.back());
+        stack.pop();
+        if(zone.overlaps(_box[node])) {
+          if(leaf(node)) {
+            values.push(_value[node]);
+          } else {
+            stack.push_multiple(_left[node], _right[node]);
+          }
+        }
+      }
+    }
+    uint32_t height(int32_t node) const {
+      return node == null || leaf(node) ? 0 : 1 + max(height(_left[node]), height(_right[node]));
+    }
+
+  protected:
+    // Surface area heuristic only needs to compare areas, so this is half of it
+    static inline float area(const Interval3f& box) {
+      const Vector3f size(box.size());
+      return size.x() * size.y() + size.y() * size.z() + size.z() * size.x();
+    }
+
+    int32_t allocate() {
+      int32_t node(_free);
+      if(node != null) {
+        _free = _right[node];
+      } else {
+        node = int32_t(_box.size());
+        _box.push();
+        _left.push();
+        _right.push();
+        _parent.push();
+        _dirty.push();
+        _value.push();
+      }
+      _left[node] = _right[node] = _parent[node] = null;
+      _dirty[node] = false;
+      return node;
+    }
+    void release(int32_t node) {
+      _left[node] = null;
+      _right[node] = _free;
+      _free = node;
+    }
+    inline void replace_child(int32_t parent, int32_t old_child, int32_t new_child) {
+      (_left[parent] == old_child ? _left[parent] : _right[parent]) = new_child;
+      _parent[new_child] = parent;
+    }
+
+    // Descends toward the sibling with the lowest cost, where the cost of going down a node
+    // is the growth of its box and the cost of stopping is the area of the new parent
+    int32_t find_sibling(const Interval3f& box) const {
+      int32_t node(_root);
+      while(!leaf(node)) {
+        const float combined_area(area(_box[node] + box));
+        const float cost(2.f * combined_area);
+        const float inheritance_cost(2.f * (combined_area - area(_box[node])));
+        const float left_cost(descent_cost(_left[node], box) + inheritance_cost);
+        const float right_cost(descent_cost(_right[node], box) + inheritance_cost);
+        if(cost < left_cost && cost < right_cost) {
+          break;
+        }
+        node = left_cost < right_cost ? _left[node] : _right[node];
+      }
+      return node;
+    }
+    inline float descent_cost(int32_t node, const Interval3f& box) const {
+      const float combined_area(area(_box[node] + box));
+      return leaf(node) ? combined_area : combined_area - area(_box[node]);
+    }
+
+    void refit_ancestors(int32_t node) {
+      for(; node != null; node = _parent[node]) {
+        refit_node(node);
+      }
+    }
+    void refit_subtree(int32_t node) {
+      if(!leaf(node) && _dirty[node]) {
+        refit_subtree(_left[node]);
+        refit_subtree(_right[node]);
+        refit_node(node);
+        _dirty[node] = false;
+      }
+    }
+    inline void refit_node(int32_t node) {
+      _box[node] = _box[_left[node]] + _box[_right[node]];
+      rotate(node);
+    }
+
+    // Swaps a child with a grandchild on the other side when it reduces the area of the other child
+    // This only changes nodes below node, and not its own box
+    void rotate(int32_t node) {
+      const int32_t children[] = {_left[node], _right[node]};
+      int32_t best_child(null), best_grand_child(null);
+      float best_gain(0.f);
+      for(uintptr_t i(0); i < 2; i++) {
+        const int32_t child(children[i]), other(children[1 - i]);
+        if(leaf(other)) {
+          continue;
+        }
+        const float other_area(area(_box[other]));
+        const int32_t grand_children[] = {_left[other], _right[other]};
+        for(uintptr_t j(0); j < 2; j++) {
+          // Child takes the place of grand child, other then contains child and the remaining grand child
+          const float gain(other_area - area(_box[child] + _box[grand_children[1 - j]]));
+          if(gain > best_gain) {
+            best_gain = gain;
+            best_child = child;
+            best_grand_child = grand_children[j];
+          }
+        }
+      }
+      if(best_child != null) {
+        const int32_t other(_parent[best_grand_child]);
+        replace_child(node, best_child, best_grand_child);
+        replace_child(other, best_grand_child, best_child);
+        _box[other] = _box[_left[other]] + _box[_right[other]];
+        _dirty[other] = _dirty[other] || _dirty[best_child]; // Child may not be refitted yet
+      }
+    }
+
+    // Pushes the sub-tasks of a task whose nodes overlap
+    template <class Tasks>
+    inline void expand(const Task& task, Tasks& tasks) const {
+      if(task.a == task.b) {
+        if(leaf(task.a)) {
+          return;
+        }
+        const int32_t left(_left[task.a]), right(_right[task.a]);
+        if(!leaf(left)) {
+          tasks.push(Task {left, left});
+        }
+        if(!leaf(right)) {
+          tasks.push(Task {right, right});
+        }
+        push_if_overlapping(left, right, tasks);
+      } else if(leaf(task.b) || (!leaf(task.a) && area(_box[task.a]) > area(_box[task.b]))) {
+        // Descend the larger node
+        push_if_overlapping(_left[task.a], task.b, tasks);
+        push_if_overlapping(_right[task.a], task.b, tasks);
+      } else {
+        push_if_overlapping(task.a, _left[task.b], tasks);
+        push_if_overlapping(task.a, _right[task.b], tasks);
+      }
+    }
+    template <class Tasks>
+    inline void push_if_overlapping(int32_t a, int32_t b, Tasks& tasks) const {
+      if(_box[a].overlaps(_box[b])) {
+        tasks.push(Task {a, b});
+      }
+    }
+  };
+}
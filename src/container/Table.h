@@ -1,64 +1,210 @@
 #pragma once
 
+#include <cstring>
 #include <new>
 #include "../hash.h"
+#include "../system/intrinsics.h"
 #include "../system/Memory.h"
 #include "../stream/Stream.h"
 #include "../stream/serial_bin.h"
 #include "../stream/serial_text.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define L_TABLE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define L_TABLE_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace L {
+  // Group of control bytes that can be matched at once
+  // Control bytes are either empty, deleted, sentinel (past the end of small tables)
+  // or hold the 7 upper bits of the hash of a full slot
+  class TableGroup {
+  public:
+    static constexpr uintptr_t size = 16;
+    static constexpr int8_t empty = -128, deleted = -2, sentinel = -1;
+#if L_TABLE_NEON
+    typedef uint64_t Mask; // One nibble per slot
+    static constexpr uint32_t mask_shift = 2;
+#else
+    typedef uint32_t Mask; // One bit per slot
+    static constexpr uint32_t mask_shift = 0;
+#endif
+  protected:
+#if L_TABLE_SSE2
+    __m128i _ctrl;
+    static inline Mask to_mask(__m128i v) { return Mask(_mm_movemask_epi8(v)); }
+#elif L_TABLE_NEON
+    int8x16_t _ctrl;
+    static inline Mask to_mask(uint8x16_t v) {
+      const uint8x8_t nibbles(vshrn_n_u16(vreinterpretq_u16_u8(v), 4));
+      return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) & 0x8888888888888888ull;
+    }
+#else
+    int8_t _ctrl[size];
+#endif
+  public:
+    inline TableGroup(const int8_t* ctrl) {
+#if L_TABLE_SSE2
+      _ctrl = _mm_loadu_si128((const __m128i*)ctrl);
+#elif L_TABLE_NEON
+      _ctrl = vld1q_s8(ctrl);
+#else
+      memcpy(_ctrl, ctrl, size);
+#endif
+    }
+    inline Mask match(int8_t h2) const {
+#if L_TABLE_SSE2
+      return to_mask(_mm_cmpeq_epi8(_mm_set1_epi8(h2), _ctrl));
+#elif L_TABLE_NEON
+      return to_mask(vceqq_s8(vdupq_n_s8(h2), _ctrl));
+#else
+      Mask mask(0);
+      for(uintptr_t i(0); i < size; i++) {
+        mask |= Mask(_ctrl[i] == h2) << i;
+      }
+      return mask;
+#endif
+    }
+    inline Mask match_empty() const { return match(empty); }
+    inline Mask match_empty_or_deleted() const {
+#if L_TABLE_SSE2
+      return to_mask(_mm_cmpgt_epi8(_mm_set1_epi8(sentinel), _ctrl));
+#elif L_TABLE_NEON
+      return to_mask(vcltq_s8(_ctrl, vdupq_n_s8(sentinel)));
+#else
+      Mask mask(0);
+      for(uintptr_t i(0); i < size; i++) {
+        mask |= Mask(_ctrl[i] < sentinel) << i;
+      }
+      return mask;
+#endif
+    }
+    static inline uintptr_t first(Mask mask) { return bsf(mask) >> mask_shift; }
+    static inline Mask next(Mask mask) { return mask & (mask - 1); }
+  };
+
+  // Keys are compared with operator== unless a better overload is found
+  template <class K> inline bool table_key_equal(const K& a, const K& b) { return a == b; }
+
+  // Open addressing hash table
+  // Control bytes are kept apart from slots and probed a group at a time,
+  // so most lookups only compare keys of slots that are likely to match
   template <class K, class V>
   class Table {
+  protected:
+    static inline uint32_t hash_key(const K& key) { return hash(key); }
   public:
     class Slot {
     private:
-      uint32_t _hash;
       K _key;
       V _value;
     public:
-      inline Slot(uint32_t h, const K& key) : _hash(h), _key(key) {}
-      inline bool empty() const { return !hash(); }
-      inline uint32_t hash() const { return _hash; }
+      inline Slot(const K& key) : _key(key), _value() {}
+      inline uint32_t hash() const { return hash_key(_key); }
       inline const K& key() const { return _key; }
       inline const V& value() const { return _value; }
       inline V& value() { return _value; }
     };
   protected:
+    static constexpr size_t min_size = 4;
+
+    int8_t* _ctrl;
     Slot* _slots;
-    size_t _size, _count;
-    void grow() {
-      if(_slots) {
-        const size_t oldsize = _size;
-        Slot* oldslots = _slots;
-        _slots = Memory::alloc_type_zero<Slot>(_size *= 2);
-        for(uintptr_t i(0); i < oldsize; i++) {
-          if(!oldslots[i].empty()) {
-            memcpy((void*)(find_slot_or_create(oldslots[i].hash())), oldslots + i, sizeof(Slot));
+    size_t _size, _count, _deleted;
+
+    // Position depends on all bits of the hash, control byte on its upper bits
+    static inline uint64_t mix(uint32_t h) { return uint64_t(h) * 0x9e3779b97f4a7c15ull; }
+    static inline int8_t ctrl_for(uint64_t m) { return int8_t(m >> 57); }
+    static inline size_t max_count(size_t size) { return size - size / 8 - (size < TableGroup::size); }
+    static inline size_t ctrl_size(size_t size) { return size < TableGroup::size ? TableGroup::size : size; }
+    static inline size_t alloc_size(size_t size) { return ctrl_size(size) + size * sizeof(Slot); }
+    inline uintptr_t group_mask() const { return (_size - 1) / TableGroup::size; }
+
+    void alloc(size_t size) {
+      _size = size;
+      _ctrl = (int8_t*)Memory::alloc(alloc_size(size));
+      _slots = (Slot*)(_ctrl + ctrl_size(size));
+      memset(_ctrl, TableGroup::empty, size);
+      memset(_ctrl + size, TableGroup::sentinel, ctrl_size(size) - size);
+    }
+    // Relocates all slots to a new array, dropping deleted control bytes
+    void rehash(size_t size) {
+      int8_t* old_ctrl(_ctrl);
+      Slot* old_slots(_slots);
+      const size_t old_size(_size);
+      alloc(size);
+      for(uintptr_t i(0); i < old_size; i++) {
+        if(old_ctrl[i] >= 0) {
+          const uint64_t m(mix(old_slots[i].hash()));
+          const uintptr_t j(find_insert_index(m));
+          _ctrl[j] = ctrl_for(m);
+          memcpy((void*)(_slots + j), old_slots + i, sizeof(Slot));
+        }
+      }
+      _deleted = 0;
+      Memory::free(old_ctrl, alloc_size(old_size));
+    }
+    // Triangular probing over groups, visits them all when their count is a power of two
+    uintptr_t find_insert_index(uint64_t m) const {
+      const uintptr_t mask(group_mask());
+      uintptr_t group_index(uintptr_t(m >> 32) & mask);
+      for(uintptr_t step(1);; step++) {
+        const uintptr_t offset(group_index * TableGroup::size);
+        if(TableGroup::Mask match = TableGroup(_ctrl + offset).match_empty_or_deleted()) {
+          return offset + TableGroup::first(match);
+        }
+        group_index = (group_index + step) & mask;
+      }
+    }
+    Slot* find_slot(const K& key, uint64_t m) const {
+      if(_count == 0) {
+        return nullptr;
+      }
+      const int8_t h2(ctrl_for(m));
+      const uintptr_t mask(group_mask());
+      uintptr_t group_index(uintptr_t(m >> 32) & mask);
+      for(uintptr_t step(1);; step++) {
+        const uintptr_t offset(group_index * TableGroup::size);
+        const TableGroup group(_ctrl + offset);
+        for(TableGroup::Mask match(group.match(h2)); match; match = TableGroup::next(match)) {
+          Slot* slot(_slots + offset + TableGroup::first(match));
+          if(table_key_equal(slot->key(), key)) {
+            return slot;
           }
         }
-        Memory::free(oldslots, oldsize * sizeof(Slot));
-      } else {
-        _slots = Memory::alloc_type_zero<Slot>(_size = 4);
+        if(group.match_empty()) {
+          return nullptr;
+        }
+        group_index = (group_index + step) & mask;
       }
     }
   public:
     class Iterator {
     private:
       Slot* _slot;
+      const int8_t* _ctrl;
     public:
-      inline Iterator(Slot* slot) : _slot(slot) {}
-      inline Iterator& operator++() { if(_slot->hash()) _slot++; return *this; }
-      inline bool operator!=(const Iterator& other) { while(_slot < other._slot && !_slot->hash()) _slot++; return _slot != other._slot; }
+      inline Iterator(Slot* slot = nullptr, const int8_t* ctrl = nullptr) : _slot(slot), _ctrl(ctrl) {}
+      inline Iterator& operator++() { _slot++; _ctrl++; return *this; }
+      inline bool operator!=(const Iterator& other) { while(_slot < other._slot && *_ctrl < 0) { _slot++; _ctrl++; } return _slot != other._slot; }
       inline Slot* operator->() const { return _slot; }
       inline Slot& operator*() const { return *(operator->()); }
     };
-    constexpr Table() : _slots(nullptr), _size(0), _count(0) {}
-    Table(const Table& other) : _slots(other._slots ? Memory::alloc_type_zero<Slot>(other._size) : nullptr), _size(other._size), _count(other._count) {
-      for(uintptr_t i(0); i < _size; i++) {
-        if(!other._slots[i].empty()) {
-          new(_slots + i)Slot(other._slots[i]);
+    constexpr Table() : _ctrl(nullptr), _slots(nullptr), _size(0), _count(0), _deleted(0) {}
+    Table(const Table& other) : Table() {
+      if(other._ctrl) {
+        alloc(other._size);
+        memcpy(_ctrl, other._ctrl, ctrl_size(_size));
+        for(uintptr_t i(0); i < _size; i++) {
+          if(_ctrl[i] >= 0) {
+            new(_slots + i)Slot(other._slots[i]);
+          }
         }
+        _count = other._count;
+        _deleted = other._deleted;
       }
     }
     inline Table& operator=(const Table& other) {
@@ -67,9 +213,9 @@ namespace L {
       return *this;
     }
     ~Table() {
-      if(_slots) {
+      if(_ctrl) {
         clear();
-        Memory::free(_slots, _size * sizeof(Slot));
+        Memory::free(_ctrl, alloc_size(_size));
       }
     }
     inline size_t size() const { return _size; }
@@ -77,61 +223,56 @@ namespace L {
     inline Iterator begin() const {
       if(_count) {
         for(uintptr_t i(0); i < _size; i++) {
-          if(_slots[i].hash()) {
-            return Iterator(_slots + i);
+          if(_ctrl[i] >= 0) {
+            return Iterator(_slots + i, _ctrl + i);
           }
         }
       }
-      return Iterator(nullptr);
+      return Iterator();
     }
-    inline Iterator end() const { return (_count) ? _slots + _size : Iterator(nullptr); }
+    inline Iterator end() const { return (_count) ? Iterator(_slots + _size, _ctrl + _size) : Iterator(); }
     inline V& operator[](const K& k) { return *find_or_create(k); }
-    inline uintptr_t index_for(uint32_t h) const { return uintptr_t(h * (float(_size) / UINT32_MAX)); }
-    Slot* find_slot_or_create(uint32_t h) {
-      if(_count * 10 >= _size * 8) {
-        grow();
-      }
-      while(true) {
-        const uintptr_t i = index_for(h);
-        for(uintptr_t j = 0; j < _size; j++) {
-          const uintptr_t k = (i + j) % _size;
-          if(_slots[k].empty() || _slots[k].hash() == h) {
-            return _slots + k;
-          }
-        }
-        grow();
-      }
-    }
-    Slot* find_slot(const K& key) const {
-      const uint32_t h = hash(key);
-      const uintptr_t i = index_for(h);
-      for(uintptr_t j = 0; j < _size; j++) {
-        const uintptr_t k = (i + j) % _size;
-        if(_slots[k].hash() == h) {
-          return _slots + k;
-        } else if(_slots[k].empty()) {
-          return nullptr;
-        }
-      }
-      return nullptr;
-    }
+    inline Slot* find_slot(const K& key) const { return find_slot(key, mix(hash_key(key))); }
     V* find_or_create(const K& key, bool* created = nullptr) {
-      const uint32_t h = hash(key);
-      Slot* slot = find_slot_or_create(h);
-      if(slot->empty()) {
+      const uint64_t m(mix(hash_key(key)));
+      if(Slot* slot = find_slot(key, m)) {
         if(created) {
-          *created = true;
+          *created = false;
         }
-        new(slot)Slot(h, key);
-        _count++;
-      } else if(created) {
-        *created = false;
+        return &slot->value();
+      }
+      if(_ctrl == nullptr) {
+        alloc(min_size);
+      } else if(_count + _deleted >= max_count(_size)) {
+        // Only grow if deleted slots are not enough to make room
+        rehash(_count * 2 >= max_count(_size) ? _size * 2 : _size);
       }
-      return &slot->value();
+      const uintptr_t i(find_insert_index(m));
+      _deleted -= _ctrl[i] == TableGroup::deleted;
+      _ctrl[i] = ctrl_for(m);
+      new(_slots + i)Slot(key);
+      _count++;
+      if(created) {
+        *created = true;
+      }
+      return &_slots[i].value();
+    }
+    inline V* find(const K& key) const {
+      Slot* slot = find_slot(key);
+      return slot ? &slot->value() : nullptr;
     }
-    V* find(const K& key) const {
+    // Tries the slot index of a previous lookup before probing, the index is updated when the key is found elsewhere
+    // Tables built with the same keys in the same order share their layout, so the index stays valid between them
+    inline V* find(const K& key, uint32_t& hint) const {
+      if(hint < _size && _ctrl[hint] >= 0 && table_key_equal(_slots[hint].key(), key)) {
+        return &_slots[hint].value();
+      }
       Slot* slot = find_slot(key);
-      return slot && !slot->empty() ? &slot->value() : nullptr;
+      if(slot) {
+        hint = uint32_t(slot - _slots);
+        return &slot->value();
+      }
+      return nullptr;
     }
     V get(const K& key, const V& default_value) const {
       if(const V* value = find(key)) {
@@ -141,33 +282,33 @@ namespace L {
       }
     }
     void remove(const K& key) {
-      Slot* slot = find_slot(key);
-      if(slot && !slot->empty()) {
+      if(Slot* slot = find_slot(key)) {
+        const uintptr_t i(slot - _slots);
         slot->~Slot();
-        while(true) {
-          const uintptr_t slot_index = slot - _slots;
-          const uintptr_t next_slot_index = (slot_index + 1) % _size;
-          Slot* next_slot = _slots + next_slot_index;
-          if(!next_slot->empty() && index_for(next_slot->hash()) != next_slot_index) {
-            memcpy((void*)slot, next_slot, sizeof(*slot));
-            slot = next_slot;
-          } else {
-            break;
-          }
+        // Probing never went past a group that has an empty slot,
+        // so the slot can be emptied instead of marked deleted
+        if(TableGroup(_ctrl + (i & ~(TableGroup::size - 1))).match_empty()) {
+          _ctrl[i] = TableGroup::empty;
+        } else {
+          _ctrl[i] = TableGroup::deleted;
+          _deleted++;
         }
-        memset((void*)slot, 0, sizeof(*slot));
         _count--;
       }
     }
     void clear() {
       if(_count) {
         for(uintptr_t i(0); i < _size; i++) {
-          if(!_slots[i].empty()) {
+          if(_ctrl[i] >= 0) {
             _slots[i].~Slot();
           }
         }
       }
+      if(_ctrl) {
+        memset(_ctrl, TableGroup::empty, _size);
+      }
       _count = 0;
+      _deleted = 0;
     }
 
     friend Stream& operator<=(Stream& s, const Table& v) { s <= v.count(); for(const auto& e : v) s <= e.key() <= e.value(); return s; }
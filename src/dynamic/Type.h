@@ -4,6 +4,7 @@
 #include "../stream/serial_text.h"
 #include "../text/Symbol.h"
 #include "../hash.h"
+#include <type_traits>
 
 namespace L {
   typedef void(*Cast)(void*,const void*);
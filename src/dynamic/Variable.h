@@ -105,6 +105,10 @@ namespace L {
     friend Stream& operator<=(Stream& s, const Variable& v);
     friend Stream& operator>=(Stream& s, Variable& v);
     friend inline uint32_t hash(const Variable& v) { return v.type()->hash(v.value()); }
+    // Values of types without comparison are told apart by their hash
+    friend inline bool table_key_equal(const Variable& a, const Variable& b) {
+      return a._td == b._td && (a._td->cmp ? a._td->cmp(a.value(), b.value()) == 0 : hash(a) == hash(b));
+    }
     friend inline void resource_write(Stream& s, const Variable& v) { s <= v; }
     friend inline void resource_read(Stream& s, Variable& v) { s >= v; }
   };
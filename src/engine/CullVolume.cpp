@@ -2,56 +2,118 @@
 
 #include "../component/Camera.h"
 #include "../dev/profiling.h"
+#include "../math/simd.h"
 
 using namespace L;
 
-Interval3fTree<CullVolume*> CullVolume::_tree;
+static constexpr uint32_t all_planes = (1 << 6) - 1;
 
-void CullVolume::cull(const Camera& camera) {
-  L_SCOPE_MARKER("Culling");
-  Vector4f planes[6];
-  camera.frustum_planes(planes);
-  Array<const Node*> stack, invisible;
-  if(_tree.root())
-    stack.push(_tree.root());
-  {
-    L_SCOPE_MARKER("Mark visible");
-    while(!stack.empty()) {
-      const Node* node(stack.back());
+BVH<CullVolume*> CullVolume::_tree;
+uint32_t CullVolume::_stamp(0);
+Array<CullVolume::Task> CullVolume::_tasks;
+Array<CullVolume::Task> CullVolume::_thread_stacks[TaskSystem::max_thread_count];
+
+void CullVolume::mark_subtree(int32_t node) {
+  if(_tree.leaf(node)) {
+    _tree.value(node)->_visible_stamp = _stamp;
+  } else {
+    mark_subtree(_tree.left(node));
+    mark_subtree(_tree.right(node));
+  }
+}
+
+// Pops nodes four at a time and tests their boxes together against each plane one of them intersects
+void CullVolume::cull_stack(Array<Task>& stack, const Vector4f planes[6]) {
+  while(!stack.empty()) {
+    Task tasks[4];
+    float min_x[4], min_y[4], min_z[4], max_x[4], max_y[4], max_z[4];
+    uint32_t count(0), batch_mask(0);
+    for(; count < 4 && !stack.empty(); count++) {
+      tasks[count] = stack.back();
       stack.pop();
+      batch_mask |= tasks[count].plane_mask;
+    }
+    for(uint32_t i(0); i < 4; i++) {
+      const Interval3f& box(_tree.box(tasks[i < count ? i : 0].node)); // Pad with the first box
+      min_x[i] = box.min().x(), min_y[i] = box.min().y(), min_z[i] = box.min().z();
+      max_x[i] = box.max().x(), max_y[i] = box.max().y(), max_z[i] = box.max().z();
+    }
+    const Float4 mins[] {f4_load(min_x), f4_load(min_y), f4_load(min_z)};
+    const Float4 maxs[] {f4_load(max_x), f4_load(max_y), f4_load(max_z)};
+    const Float4 zero(f4_splat(0.f));
 
-      // Compute visibility
-      const Interval3f& bounds(node->key());
-      bool visible(true);
-      for(uintptr_t i(0); i<6; i++) {
-        const Vector4f& plane(planes[i]);
-        if((max(bounds.min().x()*plane.x(), bounds.max().x()*plane.x())
-            +max(bounds.min().y()*plane.y(), bounds.max().y()*plane.y())
-            +max(bounds.min().z()*plane.z(), bounds.max().z()*plane.z()))+plane.w() < 0.f) {
-          visible = false;
-          break;
-        }
+    // The corner farthest along the normal tells if a box is outside, the nearest if it is inside
+    uint32_t outside(0), intersecting[4] {};
+    for(uint32_t p(0); p < 6; p++) {
+      if(!(batch_mask & (1 << p))) {
+        continue;
       }
+      const Vector4f& plane(planes[p]);
+      const bool px(plane.x() > 0.f), py(plane.y() > 0.f), pz(plane.z() > 0.f);
+      const Float4 nx(f4_splat(plane.x())), ny(f4_splat(plane.y())), nz(f4_splat(plane.z())), w(f4_splat(plane.w()));
+      const Float4 farthest(f4_madd(px ? maxs[0] : mins[0], nx, f4_madd(py ? maxs[1] : mins[1], ny, f4_madd(pz ? maxs[2] : mins[2], nz, w))));
+      const Float4 nearest(f4_madd(px ? mins[0] : maxs[0], nx, f4_madd(py ? mins[1] : maxs[1], ny, f4_madd(pz ? mins[2] : maxs[2], nz, w))));
+      outside |= f4_mask(f4_less(farthest, zero));
+      const uint32_t crossing(f4_mask(f4_less(nearest, zero)));
+      for(uint32_t i(0); i < 4; i++) {
+        intersecting[i] |= ((crossing >> i) & 1) << p;
+      }
+    }
 
-      if(visible) {
-        if(node->branch()) {
-          stack.push(node->left());
-          stack.push(node->right());
-        } else
-          node->value()->_visible = true;
-      } else invisible.push(node);
+    for(uint32_t i(0); i < count; i++) {
+      if(outside & (1 << i)) {
+        continue;
+      }
+      const int32_t node(tasks[i].node);
+      const uint32_t plane_mask(intersecting[i] & tasks[i].plane_mask);
+      if(_tree.leaf(node)) {
+        _tree.value(node)->_visible_stamp = _stamp;
+      } else if(plane_mask == 0) {
+        mark_subtree(node);
+      } else {
+        stack.push(Task {_tree.left(node), plane_mask});
+        stack.push(Task {_tree.right(node), plane_mask});
+      }
     }
   }
+}
+
+void CullVolume::cull(const Camera& camera) {
+  Vector4f planes[6];
+  camera.frustum_planes(planes);
+  cull(planes);
+}
+void CullVolume::cull(const Vector4f planes[6]) {
+  L_SCOPE_MARKER("Culling");
+  _stamp++; // Volumes not reached by this cull become invisible
   {
-    L_SCOPE_MARKER("Mark invisible");
-    while(!invisible.empty()) {
-      const Node* node(invisible.back());
-      invisible.pop();
-      if(node->branch()) {
-        invisible.push(node->left());
-        invisible.push(node->right());
-      } else
-        node->value()->_visible = false;
+    L_SCOPE_MARKER("Refit");
+    _tree.refit();
+  }
+  if(_tree.root() == BVH<CullVolume*>::null) {
+    return;
+  }
+
+  // Split the top of the tree without testing it to get enough subtrees to share between threads
+  const uintptr_t target_count(TaskSystem::thread_count() * 16);
+  _tasks.clear();
+  _tasks.push(Task {_tree.root(), all_planes});
+  for(uintptr_t i(0); i < _tasks.size() && _tasks.size() - i < target_count; i++) {
+    const int32_t node(_tasks[i].node);
+    if(!_tree.leaf(node)) {
+      _tasks.push(Task {_tree.left(node), all_planes});
+      _tasks.push(Task {_tree.right(node), all_planes});
+      _tasks[i].node = BVH<CullVolume*>::null;
     }
   }
+
+  TaskSystem::parallel_for(0, _tasks.size(), 1, [](uintptr_t begin, uintptr_t end, void* p) {
+    Array<Task>& stack(_thread_stacks[TaskSystem::thread_id()]);
+    for(uintptr_t i(begin); i < end; i++) {
+      if(_tasks[i].node != BVH<CullVolume*>::null) {
+        stack.push(_tasks[i]);
+      }
+    }
+    cull_stack(stack, (const Vector4f*)p);
+  }, (void*)planes);
 }
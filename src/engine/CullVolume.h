@@ -1,25 +1,40 @@
 #pragma once
 
-#include "../container/IntervalTree.h"
+#include "../container/BVH.h"
+#include "../math/Vector.h"
 
 namespace L {
   class Camera;
   class CullVolume {
   protected:
-    static Interval3fTree<CullVolume*> _tree;
-    typedef Interval3fTree<CullVolume*>::Node Node;
-    Node* _node;
-    bool _visible;
+    struct Task {
+      int32_t node;
+      uint32_t plane_mask; // Planes the node may still be outside of, ancestors are inside the others
+    };
+
+    static BVH<CullVolume*> _tree;
+    static uint32_t _stamp; // Incremented each cull
+    static Array<Task> _tasks;
+    static Array<Task> _thread_stacks[TaskSystem::max_thread_count];
+    int32_t _node;
+    uint32_t _visible_stamp; // Stamp of the last cull that found the volume visible
   public:
-    constexpr CullVolume() : _node(nullptr), _visible(false) {}
-    inline ~CullVolume() { if(_node) _tree.remove(_node); }
+    constexpr CullVolume() : _node(BVH<CullVolume*>::null), _visible_stamp(uint32_t(-1)) {}
+    inline ~CullVolume() { if(_node != BVH<CullVolume*>::null) _tree.remove(_node); }
     void update_bounds(const Interval3f& bounds) {
-      if(!_node) _node = _tree.insert(bounds, this);
-      else if(!_node->key().contains(bounds))
+      if(_node == BVH<CullVolume*>::null) _node = _tree.insert(bounds, this);
+      else if(!_tree.box(_node).contains(bounds))
         _tree.update(_node, bounds.extended(1.f));
     }
-    inline bool visible() const { return _visible; }
+    inline bool visible() const { return _visible_stamp == _stamp; }
+
+  protected:
+    static void mark_subtree(int32_t node);
+    static void cull_stack(Array<Task>& stack, const Vector4f planes[6]);
 
+  public:
     static void cull(const Camera&);
+    // Planes point inward, volumes on the negative side of any plane are invisible
+    static void cull(const Vector4f planes[6]);
   };
 }
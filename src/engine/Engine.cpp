@@ -10,6 +10,7 @@
 #include "../rendering/Pipeline.h"
 #include "../rendering/shader_lib.h"
 #include "Resource.h"
+#include "../system/Memory.h"
 #include "../system/Window.h"
 #include "../stream/CFileStream.h"
 
@@ -140,7 +141,7 @@ void Engine::update() {
         }
 
         if(Entity* cam_entity = camera.entity()) {
-          Array<PostProcessComponent*> post_processes;
+          Array<PostProcessComponent*, FrameAllocator> post_processes;
           cam_entity->components(post_processes);
           if(post_processes.size() > 0) {
             L_SCOPE_GPU_MARKER(cmd_buffer, "Post processes");
@@ -203,8 +204,10 @@ void Engine::update() {
     Renderer::get()->end_render_command_buffer();
   }
   _frame++;
+  Memory::end_frame();
 }
 void Engine::clear() {
   L_SCOPE_MARKER("Engine clear");
   Entity::clear();
+  Memory::trim(); // Give memory of destroyed entities back to the system
 }
@@ -14,6 +14,7 @@
 #include "../stream/StringStream.h"
 #include "../system/File.h"
 #include "../system/FileWatch.h"
+#include "../time/Timer.h"
 
 using namespace L;
 
@@ -27,6 +28,20 @@ static Archive archive_dev("dev.bin");
 static Table<String, Array<ResourceSlot*>> _source_file_resources;
 #endif
 static Date program_mtime = 0;
+static Table<Symbol, ResourceSlot::CookFunction*> _cook_functions;
+
+struct CookItem {
+  ResourceSlot* slot;
+  ResourceSlot::CookFunction* function;
+  Buffer archive_data, dev_data;
+  Time time;
+  bool success = false;
+};
+struct CookStats {
+  uint32_t count = 0, failed = 0;
+  Time time;
+  uint64_t size = 0;
+};
 
 ResourceSlot::ResourceSlot(const Symbol& type, const char* url)
   : type(type), id(url), path(url, min<size_t>(strlen(url), strchr(url, '?') - url)) {
@@ -96,8 +111,9 @@ bool ResourceSlot::flush() {
   if(state != ResourceState::Loaded) {
     L_SCOPE_MARKERF("Resource flush (%s)", (const char*)id);
     load();
-    TaskSystem::yield_until([](void* data) {
-      return ((ResourceSlot*)data)->state == ResourceState::Loaded;
+    state_waiters.wait([](void* data) {
+      const ResourceState state(((ResourceSlot*)data)->state);
+      return state == ResourceState::Loaded || state == ResourceState::Failed;
     }, this);
   }
   return value != nullptr;
@@ -123,17 +139,16 @@ Buffer ResourceSlot::read_source_file() {
   }
   return Buffer();
 }
-Buffer ResourceSlot::read_archive() {
+const void* ResourceSlot::read_archive(size_t& size) {
   L_SCOPE_MARKER("Resource read archive");
   const Symbol typed_id = make_typed_id(type, id);
 
   if(Archive::Entry entry = archive.find(typed_id)) {
-    Buffer buffer(entry.size);
-    archive.load(entry, buffer);
-    return buffer;
+    size = size_t(entry.size);
+    return archive.map(entry);
   }
 
-  return Buffer();
+  return nullptr;
 }
 void ResourceSlot::write_archive(const void* data, size_t size) {
   L_SCOPE_MARKER("Resource write archive");
@@ -148,15 +163,14 @@ void ResourceSlot::read(Stream& stream) {
 void ResourceSlot::write(Stream& stream) const {
   stream <= source_files <= mtime;
 }
-Buffer ResourceSlot::read_archive_dev() {
+const void* ResourceSlot::read_archive_dev(size_t& size) {
   L_SCOPE_MARKER("Resource read dev archive");
   const Symbol typed_id = make_typed_id(type, id);
   if(Archive::Entry entry = archive_dev.find(typed_id)) {
-    Buffer buffer(entry.size);
-    archive_dev.load(entry, buffer);
-    return buffer;
+    size = size_t(entry.size);
+    return archive_dev.map(entry);
   }
-  return Buffer();
+  return nullptr;
 }
 void ResourceSlot::write_archive_dev(const void* data, size_t size) {
   L_SCOPE_MARKER("Resource write dev archive");
@@ -201,6 +215,101 @@ ResourceSlot* ResourceSlot::find(const Symbol& type, const char* url) {
     return slot;
   }
 }
+void ResourceSlot::compact_archives() {
+  archive.compact();
+#if !L_RLS
+  archive_dev.compact();
+#endif
+}
+void ResourceSlot::register_cook_function(const Symbol& type, CookFunction* function) {
+  L_SCOPED_LOCK(lock);
+  _cook_functions[type] = function;
+}
+bool ResourceSlot::cook(const char* manifest_path) {
+  L_SCOPE_MARKER("Resource cook");
+  CFileStream manifest_stream(manifest_path, "rb");
+  if(!manifest_stream) {
+    warning("Couldn't read cook manifest: %s", manifest_path);
+    return false;
+  }
+  const size_t manifest_size(manifest_stream.size());
+  String manifest;
+  manifest.size(manifest_size);
+  manifest_stream.read(manifest.begin(), manifest_size);
+
+  bool success = true;
+  Array<CookItem> items;
+  Table<Symbol, bool> item_ids; // Slots listed twice would be cooked concurrently
+  for(String& line : manifest.explode('\n')) {
+    line.trim(" \t\r");
+    if(line.size() == 0 || line[0] == '#') {
+      continue;
+    }
+    const Array<String> parts(line.explode(' ', 2));
+    const Symbol type(parts[0]);
+    if(CookFunction** function = parts.size() == 2 ? _cook_functions.find(type) : nullptr) {
+      ResourceSlot* slot(find(type, String(parts[1]).trim(" \t")));
+      if(item_ids.find(slot->id)) {
+        warning("Ignoring duplicate manifest line: %s", line.begin());
+        continue;
+      }
+      item_ids[slot->id] = true;
+      items.push(CookItem {slot, *function});
+    } else {
+      warning("Can't cook manifest line: %s", line.begin());
+      success = false;
+    }
+  }
+
+  Timer timer;
+  Table<Symbol, CookStats> stats;
+  // Batches bound the memory held by cooked data waiting to be written
+  const uintptr_t batch_size(TaskSystem::thread_count() * 4);
+  for(uintptr_t batch_begin(0); batch_begin < items.size(); batch_begin += batch_size) {
+    const uintptr_t batch_end(min(batch_begin + batch_size, items.size()));
+    TaskSystem::parallel_for(batch_begin, batch_end, 1, [](uintptr_t begin, uintptr_t end, void* p) {
+      for(uintptr_t i(begin); i < end; i++) {
+        CookItem& item(((CookItem*)p)[i]);
+        L_SCOPE_MARKERF("Resource cook (%s)", (const char*)item.slot->id);
+        StringStream archive_stream, dev_stream;
+        Timer item_timer;
+        item.success = item.function(*item.slot, archive_stream, dev_stream);
+        item.time = item_timer.since();
+        item.archive_data = Buffer(archive_stream.string().begin(), archive_stream.string().size());
+        item.dev_data = Buffer(dev_stream.string().begin(), dev_stream.string().size());
+      }
+    }, items.begin());
+
+    // Single writer in manifest order so that cooking the same manifest gives the same archive layout
+    for(uintptr_t i(batch_begin); i < batch_end; i++) {
+      CookItem& item(items[i]);
+      CookStats& type_stats(stats[item.slot->type]);
+      type_stats.count++;
+      type_stats.time = type_stats.time + item.time;
+      if(item.success && item.archive_data.size() > 0) {
+        item.slot->write_archive(item.archive_data, item.archive_data.size());
+#if !L_RLS
+        item.slot->write_archive_dev(item.dev_data, item.dev_data.size());
+#endif
+        type_stats.size += item.archive_data.size();
+      } else {
+        type_stats.failed++;
+        success = false;
+      }
+      item.archive_data = Buffer();
+      item.dev_data = Buffer();
+    }
+  }
+
+  for(const auto& type_stats : stats) {
+    const CookStats& value(type_stats.value());
+    const String time_str(to_string(value.time));
+    log("Cooked %d %s (%d failed) in %s for %llu bytes", value.count, (const char*)type_stats.key(), value.failed, time_str.begin(), (unsigned long long)value.size);
+  }
+  const String total_time_str(to_string(timer.since()));
+  log("Cooked %d resources in %s", items.size(), total_time_str.begin());
+  return success;
+}
 void ResourceSlot::set_program_mtime(Date mtime) {
   program_mtime = mtime;
 }
@@ -6,6 +6,7 @@
 #include "../container/Table.h"
 #include "../dynamic/Type.h"
 #include "../math/math.h"
+#include "../parallelism/TaskSystem.h"
 #include "../text/String.h"
 #include "../text/Symbol.h"
 #include "../time/Date.h"
@@ -29,6 +30,7 @@ namespace L {
     size_t cpu_size = 0, gpu_size = 0;
 
     std::atomic<ResourceState> state = {ResourceState::Unloaded};
+    TaskSystem::WaitList state_waiters; // Tasks flushing the resource
     void (*load_function)(ResourceSlot&);
     void* value = nullptr;
 
@@ -43,13 +45,14 @@ namespace L {
     bool flush();
 
     Buffer read_source_file();
-    Buffer read_archive();
+    // Archive reads point into the mapped archive file and stay valid until compaction
+    const void* read_archive(size_t& size);
     void write_archive(const void* data, size_t size);
 
 #if !L_RLS
     void read(Stream&);
     void write(Stream&) const;
-    Buffer read_archive_dev();
+    const void* read_archive_dev(size_t& size);
     void write_archive_dev(const void* data, size_t size);
     void update_source_file_table();
     bool is_out_of_date() const;
@@ -58,6 +61,13 @@ namespace L {
     static Symbol make_typed_id(const Symbol& type, const char* url);
     static ResourceSlot* find(const Symbol& type, const char* url);
     static void set_program_mtime(Date mtime);
+    static void compact_archives(); // Must not run while resources are loading
+
+    typedef bool CookFunction(ResourceSlot&, Stream& archive_stream, Stream& dev_stream);
+    static void register_cook_function(const Symbol& type, CookFunction*);
+    // Builds every resource listed in the manifest in parallel and writes them to the archives
+    // Each line of the manifest is a type name followed by a url, lines starting with # are ignored
+    static bool cook(const char* manifest_path);
 #if !L_RLS
     static void update();
     static Array<ResourceSlot*> slots();
@@ -28,9 +28,11 @@ namespace L {
     
     static Array<Loader> _loaders;
     static Array<KeyValue<ResourceTransformPhase, Transformer>> _transformers;
+    static Symbol _compression; // Default compression if null
   public:
     static void add_loader(Loader loader) {
       _loaders.push(loader);
+      ResourceSlot::register_cook_function(type_name<T>(), cook);
     }
     static void add_transformer(Transformer transformer, ResourceTransformPhase phase = ResourceTransformPhase::Default) {
       for(uintptr_t i = 0; i < _transformers.size(); i++) {
@@ -41,6 +43,14 @@ namespace L {
       }
       _transformers.push(key_value(phase, transformer));
     }
+    // Large resources may use a compression that works in parallel or allows partial reads
+    // Archived data is tagged with its compression, so changing it doesn't break data archived before
+    static void set_compression(const Symbol& name) {
+      _compression = name;
+    }
+    static const Compression& compression() {
+      return _compression ? get_compression(_compression) : get_compression();
+    }
     static bool load(ResourceSlot& slot) {
       if(slot.value) {
         Memory::delete_type<T>((T*)slot.value);
@@ -51,8 +61,9 @@ namespace L {
       bool look_in_archive = true;
 
 #if !L_RLS
-      if(Buffer dev_buffer = slot.read_archive_dev()) { // Look in the dev archive for that resource
-        BufferStream dev_stream((char*)dev_buffer.data(), dev_buffer.size());
+      size_t dev_size;
+      if(const void* dev_data = slot.read_archive_dev(dev_size)) { // Look in the dev archive for that resource
+        BufferStream dev_stream((char*)dev_data, dev_size); // Only read from
         {
           L_SCOPE_MARKER("Resource serialize dev");
           slot.read(dev_stream);
@@ -63,50 +74,45 @@ namespace L {
         look_in_archive = false; // No dev info on resource, assume reload needed
       }
 #endif
-      const Compression& comp = get_compression();
 
       if(look_in_archive) {
-        if(Buffer compressed_buffer = slot.read_archive()) { // Look in the archive for that resource
+        size_t size;
+        if(const void* data = slot.read_archive(size)) { // Look in the archive for that resource
+          static const Symbol none_symbol("none");
           Buffer buffer;
-          {
+          const Compression* archived_comp = read_compression_tag(data, size);
+          bool decompressed = archived_comp != nullptr;
+          if(archived_comp && archived_comp->name != none_symbol) { // Uncompressed resources are read straight from the mapped archive
             L_SCOPE_MARKER("Resource decompress");
-            buffer = comp.decompress(compressed_buffer.data(), compressed_buffer.size());
+            decompressed = archived_comp->decompress(data, size, buffer);
+            data = buffer.data();
+            size = buffer.size();
           }
 
-          {
-            L_SCOPE_MARKER("Resource unserialize");
-            BufferStream stream((char*)buffer.data(), buffer.size());
-            resource_read(stream, intermediate);
+          if(decompressed) { // Otherwise the resource is built again from source
+            {
+              L_SCOPE_MARKER("Resource unserialize");
+              BufferStream stream((char*)data, size); // Only read from
+              resource_read(stream, intermediate);
+            }
+            store(slot, intermediate);
+            return true;
           }
-          store(slot, intermediate);
-          return true;
         }
       }
 
       // Try to load it from source
       if(load_internal(slot, intermediate)) {
-        transform_internal(slot, intermediate);
-
-        StringStream uncompressed_stream, compressed_stream;
-        {
-          L_SCOPE_MARKER("Resource serialize");
-          resource_write(uncompressed_stream, intermediate);
-        }
-
-        slot.mtime = Date::now();
-
+        StringStream uncompressed_stream, compressed_stream, dev_stream;
+        serialize(slot, intermediate, uncompressed_stream, dev_stream);
 #if !L_RLS
-        StringStream dev_stream;
-        {
-          L_SCOPE_MARKER("Resource serialize dev");
-          slot.write(dev_stream);
-          resource_write_dev(dev_stream, intermediate);
-        }
         slot.write_archive_dev(dev_stream.string().begin(), dev_stream.string().size());
 #endif
         store(slot, intermediate);
         {
           L_SCOPE_MARKER("Resource compress");
+          const Compression& comp = compression();
+          write_compression_tag(comp, compressed_stream);
           comp.compress(uncompressed_stream.string().begin(), uncompressed_stream.string().size(), compressed_stream);
         }
         slot.write_archive(compressed_stream.string().begin(), compressed_stream.string().size());
@@ -114,10 +120,45 @@ namespace L {
       } else {
         slot.mtime = Date::now();
         slot.state = ResourceState::Failed;
+        slot.state_waiters.wake_all();
         warning("Unable to load %s from: %s", slot.type, slot.id);
       }
       return false;
     }
+    // Builds the resource from source without keeping it, the caller writes it to the archives
+    static bool cook(ResourceSlot& slot, Stream& compressed_stream, Stream& dev_stream) {
+      typename T::Intermediate intermediate {};
+      if(!load_internal(slot, intermediate)) {
+        warning("Unable to cook %s from: %s", slot.type, slot.id);
+        return false;
+      }
+      StringStream uncompressed_stream;
+      serialize(slot, intermediate, uncompressed_stream, dev_stream);
+      {
+        L_SCOPE_MARKER("Resource compress");
+        const Compression& comp = compression();
+        write_compression_tag(comp, compressed_stream);
+        comp.compress(uncompressed_stream.string().begin(), uncompressed_stream.string().size(), compressed_stream);
+      }
+      return true;
+    }
+    static void serialize(ResourceSlot& slot, typename T::Intermediate& intermediate, Stream& uncompressed_stream, Stream& dev_stream) {
+      transform_internal(slot, intermediate);
+      {
+        L_SCOPE_MARKER("Resource serialize");
+        resource_write(uncompressed_stream, intermediate);
+      }
+
+      slot.mtime = Date::now();
+
+#if !L_RLS
+      L_SCOPE_MARKER("Resource serialize dev");
+      slot.write(dev_stream);
+      resource_write_dev(dev_stream, intermediate);
+#else
+      (void)dev_stream;
+#endif
+    }
     static bool load_internal(ResourceSlot& slot, typename T::Intermediate& intermediate) {
       for(Loader loader : _loaders) {
         if(loader(slot, intermediate)) {
@@ -139,10 +180,12 @@ namespace L {
       slot.cpu_size = resource_cpu_size(intermediate);
       slot.gpu_size = resource_gpu_size(intermediate);
       slot.state = ResourceState::Loaded;
+      slot.state_waiters.wake_all();
     }
   };
   template <class T> Array<typename ResourceLoading<T>::Loader> ResourceLoading<T>::_loaders;
   template <class T> Array<KeyValue<ResourceTransformPhase, typename ResourceLoading<T>::Transformer>> ResourceLoading<T>::_transformers;
+  template <class T> Symbol ResourceLoading<T>::_compression;
 
   template <class T> void Resource<T>::load_function(ResourceSlot& slot) {
     ResourceLoading<T>::load(slot);
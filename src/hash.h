@@ -22,6 +22,15 @@ namespace L {
     }
     return wtr;
   }
+  inline uint64_t fnv1a64(const char* data, size_t size) {
+    uint64_t wtr(14695981039346656037ull);
+    while(size--) {
+      wtr ^= uint8_t(*data);
+      wtr *= 1099511628211ull;
+      data++;
+    }
+    return wtr;
+  }
   constexpr uint32_t FNV1A(const char* str, uint32_t r) { return (*str) ? FNV1A(str + 1, (r ^ *str) * 16777619) : r; }
   constexpr uint32_t FNV1A(const char* str) { return FNV1A(str, 2166136261); }
 
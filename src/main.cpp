@@ -115,9 +115,30 @@ int main(int argc, const char* argv[]) {
   Engine::set_init_script(L_SCRIPT_INIT_FILE);
 #endif
 
+  if(Arguments::has("compact_archive")) {
+    ResourceSlot::compact_archives();
+    return 0;
+  }
+
+  if(Arguments::has("cook")) {
+    // Cooking runs as the main task so resources can be built in parallel
+    static int cook_result = 0;
+    TaskSystem::push([](void*) {
+      cook_result = ResourceSlot::cook(Arguments::get("cook")) ? 0 : 1;
+    }, nullptr, uint32_t(-1), TaskSystem::MainTask);
+    TaskSystem::init();
+    return cook_result;
+  }
+
   if(Arguments::has("run_all_tests")) {
-    return run_all_tests();
-  } 
+    // Tests run as the main task so they can rely on the task system
+    static int test_result = 0;
+    TaskSystem::push([](void*) {
+      test_result = run_all_tests();
+    }, nullptr, uint32_t(-1), TaskSystem::MainTask);
+    TaskSystem::init();
+    return test_result;
+  }
 
   if(Window::instance() == nullptr) {
     error("No window module available");
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define L_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define L_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace L {
+  // Four floats processed at once, falls back to scalar code without SSE or NEON
+  // Comparisons return masks with all bits set in lanes where they hold
+#if L_SSE
+  typedef __m128 Float4;
+  inline Float4 f4_load(const float* p) { return _mm_loadu_ps(p); }
+  inline void f4_store(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+  inline Float4 f4_set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+  inline Float4 f4_splat(float v) { return _mm_set1_ps(v); }
+  inline Float4 f4_add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+  inline Float4 f4_sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+  inline Float4 f4_mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+  inline Float4 f4_min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+  inline Float4 f4_max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+  inline Float4 f4_less(Float4 a, Float4 b) { return _mm_cmplt_ps(a, b); }
+  inline Float4 f4_and(Float4 a, Float4 b) { return _mm_and_ps(a, b); }
+  inline Float4 f4_or(Float4 a, Float4 b) { return _mm_or_ps(a, b); }
+  inline uint32_t f4_mask(Float4 v) { return uint32_t(_mm_movemask_ps(v)); } // One bit per lane
+  template <int x, int y, int z, int w>
+  inline Float4 f4_shuffle(Float4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x)); }
+#elif L_NEON
+  typedef float32x4_t Float4;
+  inline Float4 f4_load(const float* p) { return vld1q_f32(p); }
+  inline void f4_store(float* p, Float4 v) { vst1q_f32(p, v); }
+  inline Float4 f4_set(float x, float y, float z, float w) { const float v[] {x, y, z, w}; return vld1q_f32(v); }
+  inline Float4 f4_splat(float v) { return vdupq_n_f32(v); }
+  inline Float4 f4_add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+  inline Float4 f4_sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+  inline Float4 f4_mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+  inline Float4 f4_min(Float4 a, Float4 b) { return vminq_f32(a, b); }
+  inline Float4 f4_max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+  inline Float4 f4_less(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+  inline Float4 f4_and(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+  inline Float4 f4_or(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+  inline uint32_t f4_mask(Float4 v) {
+    const uint32x4_t bits(vshrq_n_u32(vreinterpretq_u32_f32(v), 31));
+    return vgetq_lane_u32(bits, 0) | (vgetq_lane_u32(bits, 1) << 1) | (vgetq_lane_u32(bits, 2) << 2) | (vgetq_lane_u32(bits, 3) << 3);
+  }
+  template <int x, int y, int z, int w>
+  inline Float4 f4_shuffle(Float4 v) {
+    const float v_x(vgetq_lane_f32(v, x)), v_y(vgetq_lane_f32(v, y)), v_z(vgetq_lane_f32(v, z)), v_w(vgetq_lane_f32(v, w));
+    return f4_set(v_x, v_y, v_z, v_w);
+  }
+#else
+  struct Float4 { float v[4]; };
+  inline Float4 f4_load(const float* p) { Float4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+  inline void f4_store(float* p, Float4 v) { memcpy(p, v.v, sizeof(v.v)); }
+  inline Float4 f4_set(float x, float y, float z, float w) { return Float4 {{x, y, z, w}}; }
+  inline Float4 f4_splat(float v) { return Float4 {{v, v, v, v}}; }
+  inline Float4 f4_add(Float4 a, Float4 b) { return Float4 {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+  inline Float4 f4_sub(Float4 a, Float4 b) { return Float4 {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+  inline Float4 f4_mul(Float4 a, Float4 b) { return Float4 {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+  inline Float4 f4_min(Float4 a, Float4 b) {
+    return Float4 {{a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1], a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]}};
+  }
+  inline Float4 f4_max(Float4 a, Float4 b) {
+    return Float4 {{a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1], a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]}};
+  }
+  inline Float4 f4_from_bits(const uint32_t* bits) { Float4 r; memcpy(r.v, bits, sizeof(r.v)); return r; }
+  inline Float4 f4_less(Float4 a, Float4 b) {
+    const uint32_t bits[] {a.v[0] < b.v[0] ? ~0u : 0u, a.v[1] < b.v[1] ? ~0u : 0u, a.v[2] < b.v[2] ? ~0u : 0u, a.v[3] < b.v[3] ? ~0u : 0u};
+    return f4_from_bits(bits);
+  }
+  inline Float4 f4_and(Float4 a, Float4 b) {
+    uint32_t x[4], y[4];
+    memcpy(x, a.v, sizeof(x));
+    memcpy(y, b.v, sizeof(y));
+    const uint32_t bits[] {x[0] & y[0], x[1] & y[1], x[2] & y[2], x[3] & y[3]};
+    return f4_from_bits(bits);
+  }
+  inline Float4 f4_or(Float4 a, Float4 b) {
+    uint32_t x[4], y[4];
+    memcpy(x, a.v, sizeof(x));
+    memcpy(y, b.v, sizeof(y));
+    const uint32_t bits[] {x[0] | y[0], x[1] | y[1], x[2] | y[2], x[3] | y[3]};
+    return f4_from_bits(bits);
+  }
+  inline uint32_t f4_mask(Float4 v) {
+    uint32_t x[4];
+    memcpy(x, v.v, sizeof(x));
+    return (x[0] >> 31) | ((x[1] >> 31) << 1) | ((x[2] >> 31) << 2) | ((x[3] >> 31) << 3);
+  }
+  template <int x, int y, int z, int w>
+  inline Float4 f4_shuffle(Float4 v) { return Float4 {{v.v[x], v.v[y], v.v[z], v.v[w]}}; }
+#endif
+  inline Float4 f4_madd(Float4 a, Float4 b, Float4 c) { return f4_add(f4_mul(a, b), c); }
+}
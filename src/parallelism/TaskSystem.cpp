@@ -4,8 +4,9 @@
 
 #include "../dev/profiling.h"
 #include "../macros.h"
-#include "Semaphore.h"
+#include "../math/math.h"
 #include "../system/System.h"
+#include "WorkDeque.h"
 
 #if L_WINDOWS
 #include <Windows.h>
@@ -21,29 +22,33 @@ namespace L {
   void switch_to_fiber(FiberHandle);
   void create_thread(void(*)(void*), void*);
   uint32_t core_count();
+  void wait_on_address(std::atomic<uint32_t>*, uint32_t value);
+  void wake_address(std::atomic<uint32_t>*);
 }
 
-const uint32_t fiber_per_thread_count = 4;
-const uint32_t actual_thread_count(core_count());
-const uint32_t actual_fiber_count = max<uint32_t>(actual_thread_count*fiber_per_thread_count, 12);
-Semaphore semaphore(0);
+const uint32_t actual_thread_count(min(core_count(), TaskSystem::max_thread_count));
+// Fibers are created when a task starts and all existing ones are busy, waiting tasks keep theirs
+// They're stored in blocks twice as big as the previous one so they never move
+const uint32_t fiber_block_size = 64;
+const uint32_t fiber_block_count = 26; // Enough for 32-bit indices
+const uint32_t max_free_task_count = 1 << 10;
+const uint32_t max_range_split_count = 64;
+const uint32_t max_starve_count = 1 << 8;
+const uint32_t all_threads_mask = actual_thread_count < 32 ? (1u << actual_thread_count) - 1 : uint32_t(-1);
 
-enum class FiberState : uint32_t {
-  Empty = 0,
-  PreReady,
-  Ready,
-  Running,
-};
-struct FiberSlot {
-  FiberHandle handle;
+struct Fiber;
+struct Task {
   TaskSystem::Func func;
   TaskSystem::CondFunc cond_func;
   void* data;
   void* cond_data;
-  FiberSlot* parent;
-  std::atomic<FiberState> state;
-  std::atomic<uint32_t> counter;
-  uint32_t thread_mask;
+  Task* parent;
+  Task* next; // Intrusive link for task queues
+  Fiber* fiber; // Only set once the task has started
+  std::atomic<uint32_t>* parked; // Set for threads waiting outside of a task, woken through it instead of resumed
+  TaskSystem::Counter children; // Unfinished child tasks
+  uint32_t thread_mask = uint32_t(-1);
+  uint32_t flags;
 
   inline bool check_condition() {
     if(cond_func && cond_func(cond_data))
@@ -51,76 +56,373 @@ struct FiberSlot {
     return !cond_func;
   }
 };
+struct Fiber {
+  FiberHandle handle;
+  Task* task; // Reset by the fiber when its task is over
+  std::atomic<uint32_t> next_free;
+  uint32_t index;
+};
+
+// Unbounded FIFO of tasks, used to hand tasks over to a specific thread
+// and to park started tasks that yielded
+class TaskQueue {
+protected:
+  std::atomic<bool> _locked;
+  std::atomic<uint32_t> _size;
+  Task* _head;
+  Task* _tail;
+
+  inline void lock() {
+    bool expected = false;
+    while(!_locked.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
+      expected = false;
+    }
+  }
+  inline void unlock() { _locked.store(false, std::memory_order_release); }
+
+public:
+  void push(Task* task) {
+    task->next = nullptr;
+    lock();
+    if(_tail) {
+      _tail->next = task;
+    } else {
+      _head = task;
+    }
+    _tail = task;
+    _size += 1;
+    unlock();
+  }
+  // Pops the first task that may execute on a thread
+  Task* pop(uint32_t thread_bit) {
+    if(_size == 0) {
+      return nullptr;
+    }
+    lock();
+    Task* previous = nullptr;
+    Task* task = _head;
+    while(task && !(task->thread_mask & thread_bit)) {
+      previous = task;
+      task = task->next;
+    }
+    if(task) {
+      (previous ? previous->next : _head) = task->next;
+      if(_tail == task) {
+        _tail = previous;
+      }
+      _size -= 1;
+    }
+    unlock();
+    return task;
+  }
+  inline bool empty() const { return _size == 0; }
+};
+
+struct Worker {
+  WorkDeque<Task> deque; // Fresh tasks pushed from this thread
+  TaskQueue mailbox; // Tasks handed over by other threads and yielded tasks
+  FiberHandle original_fiber;
+  Task* current_task;
+  Task* free_tasks; // Recycled task records
+  uint32_t free_task_count;
+  std::atomic<uint32_t> parked; // Non-zero while the thread sleeps on it
+  void(*suspend_func)(Task*, void*); // Called once a suspending task is off its fiber
+  void* suspend_data;
+};
 
 bool initialized(false);
-FiberHandle* original_thread_fibers(Memory::alloc_type_zero<FiberHandle>(actual_thread_count));
-FiberSlot* fibers(Memory::alloc_type_zero<FiberSlot>(actual_fiber_count));
+Worker* workers(Memory::alloc_type_zero<Worker>(actual_thread_count));
+std::atomic<Fiber*> fiber_blocks[fiber_block_count] = {};
+std::atomic<uint64_t> free_fibers = {0}; // Tagged index (+1) of first free fiber
+std::atomic<uint32_t> created_fiber_count = {0};
+std::atomic<uint32_t> next_thread = {0};
+std::atomic<uint32_t> parked_mask = {0}; // Threads that are asleep or about to be
+TaskSystem::Counter task_count; // Unfinished tasks except the main one
+std::atomic<Task*> main_task = {nullptr};
+Task default_task; // Stands for the current task when outside of the task system
 thread_local uint32_t thread_index;
-thread_local uint32_t current_fiber;
+
+// Block n starts at fiber_block_size*(2^n-1) and holds fiber_block_size*2^n fibers
+static inline uint32_t fiber_block(uint32_t index) {
+  return log2(index / fiber_block_size + 1);
+}
+static inline Fiber* fiber_at(uint32_t index) {
+  const uint32_t block(fiber_block(index));
+  return fiber_blocks[block].load(std::memory_order_acquire) + (index - fiber_block_size * ((1u << block) - 1));
+}
+static void free_fiber(Fiber* fiber) {
+  const uint32_t fiber_index = fiber->index + 1;
+  uint64_t head = free_fibers.load();
+  do {
+    fiber->next_free.store(uint32_t(head), std::memory_order_relaxed);
+  } while(!free_fibers.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | fiber_index));
+}
+void fiber_func(void*);
+static Fiber* acquire_fiber() {
+  uint64_t head = free_fibers.load();
+  while(uint32_t fiber_index = uint32_t(head)) {
+    Fiber* fiber = fiber_at(fiber_index - 1);
+    const uint64_t new_head = ((head >> 32) + 1) << 32 | fiber->next_free.load(std::memory_order_relaxed);
+    if(free_fibers.compare_exchange_weak(head, new_head)) {
+      return fiber;
+    }
+  }
+
+  // No free fiber: create a new one, allocating its block if it's the first one in it
+  const uint32_t fiber_index = created_fiber_count.fetch_add(1);
+  std::atomic<Fiber*>& block(fiber_blocks[fiber_block(fiber_index)]);
+  if(block.load(std::memory_order_acquire) == nullptr) {
+    const size_t block_size(fiber_block_size << fiber_block(fiber_index));
+    Fiber* new_block(Memory::alloc_type_zero<Fiber>(block_size));
+    Fiber* expected(nullptr);
+    if(!block.compare_exchange_strong(expected, new_block)) {
+      Memory::free_type(new_block, block_size);
+    }
+  }
+  Fiber* fiber = fiber_at(fiber_index);
+  fiber->index = fiber_index;
+  fiber->handle = create_fiber(fiber_func, (void*)uintptr_t(fiber_index));
+  return fiber;
+}
+
+// Task records are recycled per thread to avoid hitting the allocator on every push
+static Task* alloc_task() {
+  Worker& worker(workers[thread_index]);
+  if(Task* task = worker.free_tasks) {
+    worker.free_tasks = task->next;
+    worker.free_task_count -= 1;
+    return new(task)Task();
+  }
+  return Memory::new_type<Task>();
+}
+static void free_task(Task* task) {
+  Worker& worker(workers[thread_index]);
+  if(worker.free_task_count < max_free_task_count) {
+    task->next = worker.free_tasks;
+    worker.free_tasks = task;
+    worker.free_task_count += 1;
+  } else {
+    Memory::delete_type(task);
+  }
+}
+
+static Task* current_task() {
+  if(Task* task = workers[thread_index].current_task) {
+    return task;
+  }
+  return &default_task;
+}
+
+// Wakes a thread up if it's parked, only one waker gets to clear its bit
+static bool wake_thread(uint32_t index) {
+  const uint32_t thread_bit(1 << index);
+  if((parked_mask.load() & thread_bit) && (parked_mask.fetch_and(~thread_bit) & thread_bit)) {
+    Worker& worker(workers[index]);
+    worker.parked = 0;
+    wake_address(&worker.parked);
+    return true;
+  }
+  return false;
+}
+static void wake_any_thread(uint32_t thread_mask) {
+  thread_mask &= all_threads_mask;
+  if(thread_mask == 0) {
+    return;
+  }
+  // Parked threads check for work after raising their bit,
+  // work must be visible before looking at the bits
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if(parked_mask.load(std::memory_order_relaxed) & thread_mask) {
+    for(uint32_t i(0); i<actual_thread_count; i++) {
+      if((thread_mask & (1 << i)) && wake_thread(i)) {
+        return;
+      }
+    }
+  }
+}
+static void wake_all_threads() {
+  for(uint32_t i(0); i<actual_thread_count; i++) {
+    wake_thread(i);
+  }
+}
+
+static void post_task(uint32_t target, Task* task) {
+  workers[target].mailbox.push(task);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  wake_thread(target);
+}
+// Hands a task over to a thread that is allowed to execute it
+static void send_task(Task* task) {
+  L_ASSERT(task->thread_mask & all_threads_mask);
+  uint32_t target;
+  do {
+    target = next_thread.fetch_add(1) % actual_thread_count;
+  } while(!(task->thread_mask & (1 << target)));
+  post_task(target, task);
+}
+// Schedules a suspended task again, preferably on the current thread
+static void resume_task(Task* task) {
+  if(task->thread_mask & (1 << thread_index)) {
+    post_task(thread_index, task);
+  } else {
+    send_task(task);
+  }
+}
 
 #if _MSC_VER
 #pragma optimize("g", off)
 #endif
 void yield_internal() {
-  switch_to_fiber(original_thread_fibers[thread_index]);
+  switch_to_fiber(workers[thread_index].original_fiber);
 }
 #if _MSC_VER
 #pragma optimize("g", on)
 #endif
 
+static void finish_task(Task* task) {
+  if(task->parent) {
+    task->parent->children.decrement(); // Notify task done
+  }
+  if(task->flags & TaskSystem::MainTask) {
+    Task* expected_task(task);
+    if(main_task.compare_exchange_strong(expected_task, nullptr)) {
+      wake_all_threads(); // Let every thread exit
+    }
+  } else {
+    task_count.decrement();
+  }
+  free_task(task);
+}
+
 void fiber_func(void* arg) {
-  const uintptr_t fiber_index = uintptr_t(arg);
-  FiberSlot& slot(fibers[fiber_index]);
+  Fiber& fiber(*fiber_at(uint32_t(uintptr_t(arg))));
   while(true) {
-    if(slot.func) {
-      slot.func(slot.data); // Execute task
-      if(slot.parent) {
-        slot.parent->counter -= 1; // Notify task done
+    Task* task(fiber.task);
+    task->func(task->data); // Execute task
+    task->children.wait();
+    finish_task(task);
+
+    // Reuse this fiber for the next local task directly
+    // instead of going back and forth with the thread fiber
+    Worker& worker(workers[thread_index]);
+    if(Task* next_task = main_task.load() ? worker.deque.pop() : nullptr) {
+      next_task->fiber = &fiber;
+      fiber.task = next_task;
+      worker.current_task = next_task;
+    } else {
+      fiber.task = nullptr;
+      yield_internal();
+    }
+  }
+}
+
+static Task* find_task(Worker& worker, uint32_t local_thread_index) {
+  const uint32_t thread_bit(1 << local_thread_index);
+  if(Task* task = worker.deque.pop()) {
+    return task;
+  }
+  if(Task* task = worker.mailbox.pop(thread_bit)) {
+    return task;
+  }
+  for(uint32_t i(1); i<actual_thread_count; i++) {
+    Worker& victim(workers[(local_thread_index+i)%actual_thread_count]);
+    if(Task* task = victim.deque.steal()) {
+      if(task->thread_mask & thread_bit) {
+        return task;
       }
-      while(slot.counter) // Wait for child tasks
-        yield_internal();
-      slot.func = nullptr;
+      send_task(task); // Stolen task does not want to execute on this thread
+    }
+    if(Task* task = victim.mailbox.pop(thread_bit)) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+// Returns true if the task was actually executed
+static bool execute_task(Worker& worker, Task* task) {
+  if(!task->check_condition()) {
+    worker.mailbox.push(task);
+    return false;
+  }
+  Fiber* fiber(task->fiber);
+  if(fiber == nullptr) {
+    fiber = acquire_fiber();
+    task->fiber = fiber;
+    fiber->task = task;
+  }
+
+  worker.current_task = task;
+  switch_to_fiber(fiber->handle);
+  worker.current_task = nullptr;
+
+  // The fiber may have gone through several tasks before coming back
+  if(Task* yielded_task = fiber->task) {
+    if(worker.suspend_func) {
+      void(*suspend_func)(Task*, void*)(worker.suspend_func);
+      worker.suspend_func = nullptr;
+      suspend_func(yielded_task, worker.suspend_data);
+    } else if(yielded_task->thread_mask & (1 << thread_index)) {
+      worker.mailbox.push(yielded_task);
+    } else {
+      send_task(yielded_task);
+    }
+  } else { // Fiber is idle
+    free_fiber(fiber);
+  }
+  return true;
+}
+
+// Only looks at what this thread would be woken up for
+static bool has_work(const Worker& worker) {
+  if(!worker.mailbox.empty()) { // Includes tasks polling their condition
+    return true;
+  }
+  for(uint32_t i(0); i<actual_thread_count; i++) {
+    if(!workers[i].deque.empty()) {
+      return true;
     }
-    yield_internal();
   }
+  return false;
+}
+static void park_thread(Worker& worker, uint32_t local_thread_index) {
+  L_SCOPE_MARKER("Park thread");
+  const uint32_t thread_bit(1 << local_thread_index);
+  worker.parked = 1;
+  parked_mask.fetch_or(thread_bit);
+  // Work may have been pushed before the bit was visible
+  if(!has_work(worker) && main_task.load()) {
+    while(worker.parked.load()) {
+      wait_on_address(&worker.parked, 1);
+    }
+  }
+  parked_mask.fetch_and(~thread_bit);
 }
 
 void thread_func(void* arg) {
   const uint32_t local_thread_index(thread_index = uint32_t(uintptr_t(arg)));
-  current_fiber = 0;
-  original_thread_fibers[local_thread_index] = convert_to_fiber();
+  Worker& worker(workers[local_thread_index]);
+  worker.original_fiber = convert_to_fiber();
 
   uint32_t starve_count(0);
-  while(fibers[0].func) { // Exit when original task is over
-    FiberSlot& slot(fibers[current_fiber]);
-    FiberState expected_state = FiberState::Ready;
-    if(slot.state.compare_exchange_strong(expected_state, FiberState::Running)) {
-      if(slot.thread_mask&(1<<local_thread_index)
-         && slot.check_condition()) {
-        switch_to_fiber(slot.handle);
+  while(main_task.load()) { // Exit when original task is over
+    if(Task* task = find_task(worker, local_thread_index)) {
+      if(execute_task(worker, task)) {
         starve_count = 0;
-      } else if(local_thread_index == 0 && (slot.thread_mask & 1) == 0) {
-        // The fiber does not want to execute on the main thread
-        // and the other threads may be asleep, wake them
-        semaphore.put();
+        continue;
       }
-      slot.state = (slot.func == nullptr ? FiberState::Empty : FiberState::Ready);
     }
 
-    // May sleep if unsollicited and not main thread
-    if(local_thread_index>0 && ++starve_count > (1<<8)) {
-      semaphore.get();
+    // Sleep until woken up when unsollicited for a while
+    if(++starve_count > max_starve_count) {
+      park_thread(worker, local_thread_index);
       starve_count = 0;
     }
-
-    current_fiber = (current_fiber+1)%actual_fiber_count;
   }
 }
 
 void TaskSystem::init() {
   initialized = true;
-  for(uintptr_t i(0); i<actual_fiber_count; i++)
-    fibers[i].handle = create_fiber(fiber_func, (void*)i);
   for(uintptr_t i(1); i<actual_thread_count; i++)
     create_thread(thread_func, (void*)i);
   thread_func(nullptr);
@@ -132,35 +434,38 @@ uint32_t TaskSystem::thread_id() {
   return thread_index;
 }
 uint32_t TaskSystem::fiber_count() {
-  return actual_fiber_count;
+  return created_fiber_count;
 }
 uint32_t TaskSystem::fiber_id() {
-  return current_fiber;
+  const Task* task(workers[thread_index].current_task);
+  return task ? task->fiber->index : 0;
 }
 void TaskSystem::push(Func f, void* d, uint32_t thread_mask, uint32_t flags) {
   if(!initialized && !(flags&MainTask))
     return f(d);
   L_SCOPE_MARKER("Pushing task");
-  FiberSlot* parent;
+  Task* task(alloc_task());
+  task->func = f;
+  task->data = d;
+  task->thread_mask = thread_mask;
+  task->flags = flags;
   if(initialized && !(flags&NoParent)) {
-    parent = fibers+current_fiber;
-    parent->counter += 1;
-  } else parent = nullptr;
-  while(true) {
-    for(uintptr_t i(0); i<actual_fiber_count; i++) {
-      FiberSlot& slot(fibers[i]);
-      FiberState expected_state = FiberState::Empty;
-      if(slot.state.compare_exchange_strong(expected_state, FiberState::PreReady)) {
-        slot.func = f;
-        slot.data = d;
-        slot.thread_mask = thread_mask;
-        slot.parent = parent;
-        slot.state = FiberState::Ready;
-        semaphore.put();
-        return;
-      }
-    }
-    yield_internal();
+    task->parent = current_task();
+    task->parent->children.increment();
+  }
+  if(flags&MainTask) {
+    main_task = task;
+  } else {
+    task_count.increment();
+  }
+
+  // Fresh tasks go to the local deque whenever possible so they can be stolen
+  const uint32_t thread_bit(1 << thread_index);
+  if(initialized && (thread_mask & thread_bit)) {
+    workers[thread_index].deque.push(task);
+    wake_any_thread(thread_mask & ~thread_bit);
+  } else {
+    send_task(task);
   }
 }
 void TaskSystem::yield() {
@@ -169,33 +474,200 @@ void TaskSystem::yield() {
 }
 void TaskSystem::yield_until(CondFunc cond_func, void* cond_data) {
   if(!cond_func(cond_data)) {
-    fibers[current_fiber].cond_func = cond_func;
-    fibers[current_fiber].cond_data = cond_data;
+    Task* task(current_task());
+    task->cond_func = cond_func;
+    task->cond_data = cond_data;
     yield_internal();
   }
 }
 void TaskSystem::join() {
   L_SCOPE_MARKER("Join");
-  yield_until([](void* data) { return *(uint32_t*)data==0; }, &fibers[current_fiber].counter);
+  current_task()->children.wait();
 }
 void TaskSystem::join_all() {
-  L_ASSERT(current_fiber==0);
+  L_ASSERT(current_task()==main_task);
   L_SCOPE_MARKER("Join all");
-  yield_until([](void*) {
-    for(uintptr_t i(1); i<actual_fiber_count; i++) {
-      if(fibers[i].func) {
-        return false;
+  task_count.wait();
+}
+
+void TaskSystem::WaitList::lock() {
+  bool expected(false);
+  while(!_locked.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
+    expected = false;
+  }
+}
+void TaskSystem::WaitList::unlock() {
+  _locked.store(false, std::memory_order_release);
+}
+void TaskSystem::WaitList::wake_waiters() {
+  Task* task((Task*)_head);
+  _head = nullptr;
+  while(task) {
+    Task* next(task->next);
+    if(std::atomic<uint32_t>* parked = task->parked) {
+      parked->store(0);
+      wake_address(parked);
+    } else {
+      resume_task(task);
+    }
+    task = next;
+  }
+}
+void TaskSystem::WaitList::wait(CondFunc cond_func, void* cond_data) {
+  struct Suspension {
+    WaitList* wait_list;
+    CondFunc cond_func;
+    void* cond_data;
+  } suspension{this, cond_func, cond_data};
+  while(true) {
+    lock();
+    const bool done(cond_func(cond_data));
+    unlock();
+    if(done) {
+      return;
+    }
+
+    Worker& worker(workers[thread_index]);
+    if(worker.current_task == nullptr) { // Cannot suspend outside of a task, park the thread instead
+      std::atomic<uint32_t> parked(1);
+      Task waiter {};
+      waiter.parked = &parked;
+      lock();
+      if(cond_func(cond_data)) {
+        unlock();
+        return;
+      }
+      waiter.next = (Task*)_head;
+      _head = &waiter;
+      unlock();
+      while(parked.load()) {
+        wait_on_address(&parked, 1);
       }
+      continue;
     }
-    return true;
-  });
+
+    // Task can only be put in the list once it's off its fiber,
+    // otherwise it could be resumed by another thread right away
+    worker.suspend_data = &suspension;
+    worker.suspend_func = [](Task* task, void* data) {
+      const Suspension& suspension(*(const Suspension*)data);
+      WaitList& wait_list(*suspension.wait_list);
+      wait_list.lock();
+      if(suspension.cond_func(suspension.cond_data)) {
+        wait_list.unlock();
+        resume_task(task);
+      } else {
+        task->next = (Task*)wait_list._head;
+        wait_list._head = task;
+        wait_list.unlock();
+      }
+    };
+    yield_internal();
+  }
+}
+void TaskSystem::WaitList::wake_all() {
+  lock();
+  wake_waiters();
+  unlock();
+}
+
+void TaskSystem::Event::set() {
+  lock(); // Waiters may destroy the event as soon as it's set
+  _set = true;
+  wake_waiters();
+  unlock();
+}
+void TaskSystem::Event::wait() {
+  WaitList::wait([](void* data) { return ((Event*)data)->is_set(); }, this);
+}
+
+void TaskSystem::Counter::decrement(uint32_t n) {
+  uint32_t value(_value.load());
+  while(value > n) { // Cannot be reaching zero, nobody to wake up
+    if(_value.compare_exchange_weak(value, value - n)) {
+      return;
+    }
+  }
+  lock(); // Waiters may destroy the counter as soon as it reaches zero
+  if((_value -= n) == 0) {
+    wake_waiters();
+  }
+  unlock();
+}
+void TaskSystem::Counter::wait() {
+  WaitList::wait([](void* data) { return ((Counter*)data)->value() == 0; }, this);
+}
+
+struct RangeSplit {
+  TaskSystem::RangeFunc func;
+  void* data;
+  uintptr_t begin, end, grain;
+};
+static void range_task(void*);
+static void process_range(TaskSystem::RangeFunc func, void* data, uintptr_t begin, uintptr_t end, uintptr_t grain) {
+  RangeSplit splits[max_range_split_count];
+  uint32_t split_count(0);
+  while(true) {
+    while(begin < end) {
+      // Split remaining range in half when there's nothing left to steal from this thread
+      if(end - begin > grain && split_count < max_range_split_count && workers[thread_index].deque.empty()) {
+        const uintptr_t middle(begin + (end - begin) / 2);
+        RangeSplit& split(splits[split_count++]);
+        split = RangeSplit{func, data, middle, end, grain};
+        TaskSystem::push(range_task, &split);
+        end = middle;
+      } else {
+        const uintptr_t chunk_end(min(begin + grain, end));
+        func(begin, chunk_end, data);
+        begin = chunk_end;
+      }
+    }
+
+    // Take back the last split if it was not stolen and carry on with it
+    if(split_count > 0) {
+      Worker& worker(workers[thread_index]);
+      const RangeSplit& split(splits[split_count - 1]);
+      if(Task* task = worker.deque.pop()) {
+        if(task->func == range_task && task->data == &split) {
+          begin = split.begin;
+          end = split.end;
+          split_count -= 1;
+          finish_task(task);
+          continue;
+        }
+        worker.deque.push(task);
+      }
+    }
+    break;
+  }
+
+  // Remaining splits were stolen and reference this stack frame
+  if(split_count > 0) {
+    TaskSystem::join();
+  }
+}
+static void range_task(void* p) {
+  const RangeSplit& split(*(const RangeSplit*)p);
+  process_range(split.func, split.data, split.begin, split.end, split.grain);
+}
+void TaskSystem::parallel_for(uintptr_t begin, uintptr_t end, uintptr_t grain, RangeFunc func, void* data) {
+  if(begin >= end) {
+    return;
+  }
+  if(!initialized || actual_thread_count == 1) {
+    return func(begin, end, data);
+  }
+  if(grain == 0) {
+    grain = max<uintptr_t>(1, (end - begin) / (actual_thread_count * 64));
+  }
+  process_range(func, data, begin, end, grain);
 }
 
 uint32_t TaskSystem::thread_mask() {
-  return fibers[current_fiber].thread_mask;
+  return current_task()->thread_mask;
 }
 void TaskSystem::thread_mask(uint32_t new_mask) {
-  uint32_t& thread_mask(fibers[current_fiber].thread_mask);
+  uint32_t& thread_mask(current_task()->thread_mask);
   if(thread_mask != new_mask) {
     thread_mask = new_mask;
     if(!(new_mask&(1<<thread_index)))
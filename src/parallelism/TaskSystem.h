@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include "../macros.h"
 
@@ -11,12 +12,16 @@ namespace L {
     };
     typedef void(*Func)(void*);
     typedef bool(*CondFunc)(void*);
+    typedef void(*RangeFunc)(uintptr_t begin, uintptr_t end, void*);
+
+    // Thread masks are 32 bits wide
+    constexpr uint32_t max_thread_count = 32;
 
     void init();
     uint32_t thread_count();
     uint32_t thread_id();
-    uint32_t fiber_count();
-    uint32_t fiber_id();
+    uint32_t fiber_count(); // Fibers created so far, grows as tasks wait
+    uint32_t fiber_id(); // Always below fiber_count
     void push(Func, void* = nullptr, uint32_t thread_mask = -1, uint32_t flags = 0);
     void yield();
     void yield_until(CondFunc, void* = nullptr);
@@ -25,6 +30,86 @@ namespace L {
 
     uint32_t thread_mask();
     void thread_mask(uint32_t mask);
+
+    // Calls func over sub-ranges of [begin,end) at most grain long (0 for automatic)
+    // Ranges are split lazily, only when other threads may be starving
+    void parallel_for(uintptr_t begin, uintptr_t end, uintptr_t grain, RangeFunc func, void* data);
+
+    template <class F>
+    inline void parallel_for(uintptr_t begin, uintptr_t end, uintptr_t grain, const F& f) {
+      parallel_for(begin, end, grain, [](uintptr_t b, uintptr_t e, void* p) {
+        for(uintptr_t i(b); i<e; i++) {
+          (*(const F*)p)(i);
+        }
+      }, (void*)&f);
+    }
+
+    // Reduce must be associative and commutative as partial results are combined per thread
+    template <class T, class Map, class Reduce>
+    T parallel_reduce(uintptr_t begin, uintptr_t end, uintptr_t grain, const T& identity, const Map& map, const Reduce& reduce) {
+      T partials[max_thread_count];
+      for(T& partial : partials) {
+        partial = identity;
+      }
+      auto range_func = [&](uintptr_t b, uintptr_t e) {
+        T value(identity);
+        for(uintptr_t i(b); i<e; i++) {
+          value = reduce(value, map(i));
+        }
+        T& partial(partials[thread_id()]); // Map may have yielded, get thread index now
+        partial = reduce(partial, value);
+      };
+      parallel_for(begin, end, grain, [](uintptr_t b, uintptr_t e, void* p) {
+        (*(decltype(range_func)*)p)(b, e);
+      }, (void*)&range_func);
+      T result(identity);
+      for(uint32_t i(0); i<thread_count(); i++) {
+        result = reduce(result, partials[i]);
+      }
+      return result;
+    }
+
+    // Tasks suspended until a condition is true, woken up explicitly instead of being polled
+    class WaitList {
+    protected:
+      std::atomic<bool> _locked;
+      void* _head;
+
+      void lock();
+      void unlock();
+      void wake_waiters(); // Must be locked
+
+    public:
+      constexpr WaitList() : _locked(false), _head(nullptr) {}
+      // Suspends current task until cond_func is true, it's only checked while locked
+      void wait(CondFunc cond_func, void* cond_data);
+      // Must be called after cond_func of waiters became true
+      void wake_all();
+    };
+
+    // Manual-reset event
+    class Event : protected WaitList {
+    protected:
+      std::atomic<bool> _set;
+    public:
+      constexpr Event(bool set = false) : _set(set) {}
+      inline bool is_set() const { return _set; }
+      void set();
+      inline void reset() { _set = false; }
+      void wait();
+    };
+
+    // Counter that tasks can wait on until it reaches zero
+    class Counter : protected WaitList {
+    protected:
+      std::atomic<uint32_t> _value;
+    public:
+      constexpr Counter(uint32_t value = 0) : _value(value) {}
+      inline uint32_t value() const { return _value; }
+      inline void increment(uint32_t n = 1) { _value += n; }
+      void decrement(uint32_t n = 1);
+      void wait();
+    };
   }
 
 #define L_SCOPE_THREAD_MASK(mask) L::ScopeThreadMask L_CONCAT(THREAD_MASK_,__LINE__)(mask)
@@ -5,67 +5,232 @@
 
 #include <atomic>
 #include <cstdlib>
+#include <linux/futex.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if !defined(__x86_64__) && !defined(__aarch64__)
+#define L_UCONTEXT_FIBERS 1
 #include <ucontext.h>
+#endif
 
 using namespace L;
 
-static const size_t fiber_stack_size = 1 << 17;
+// Stacks are reserved up front but only committed by the system when touched
+static const size_t fiber_stack_size = 1 << 19;
 
-static thread_local ucontext_t* current_context;
-static uint8_t* memory_pool = nullptr;
-static size_t memory_pool_size = 0;
-static std::atomic<uint32_t> memory_index = {0};
+#if L_UCONTEXT_FIBERS
+typedef ucontext_t FiberContext;
+#else
+// Only callee-saved registers need to be preserved across a switch,
+// they get pushed on the stack so the context is only a stack pointer
+struct FiberContext {
+  void* sp;
+};
 
-inline static void* local_alloc(uint32_t size) {
-  if(!memory_pool) {
-    memory_pool_size = (TaskSystem::thread_count() + TaskSystem::fiber_count())
-      * (sizeof(ucontext_t) + fiber_stack_size + sizeof(void*) * 2);
-    memory_pool = (uint8_t*)Memory::alloc(memory_pool_size);
-  }
-  const uint32_t index = memory_index.fetch_add(size);
-  return (void*)(memory_pool + index);
+extern "C" {
+  void l_switch_context(void** from_sp, void* to_sp);
+  void l_fiber_trampoline();
+}
+
+#if defined(__x86_64__)
+asm(R"(
+.text
+.globl l_switch_context
+.type l_switch_context,@function
+.align 16
+l_switch_context:
+  pushq %rbp
+  pushq %rbx
+  pushq %r12
+  pushq %r13
+  pushq %r14
+  pushq %r15
+  subq $16, %rsp
+  stmxcsr 8(%rsp)
+  fnstcw (%rsp)
+  movq %rsp, (%rdi)
+  movq %rsi, %rsp
+  ldmxcsr 8(%rsp)
+  fldcw (%rsp)
+  addq $16, %rsp
+  popq %r15
+  popq %r14
+  popq %r13
+  popq %r12
+  popq %rbx
+  popq %rbp
+  ret
+.size l_switch_context,.-l_switch_context
+
+.globl l_fiber_trampoline
+.type l_fiber_trampoline,@function
+.align 16
+l_fiber_trampoline:
+  movq %r13, %rdi
+  callq *%r12
+  ud2
+.size l_fiber_trampoline,.-l_fiber_trampoline
+)");
+
+enum : uintptr_t { // Stack slots of a suspended context
+  slot_fpu_cw, slot_mxcsr, slot_r15, slot_r14, slot_r13, slot_r12, slot_rbx, slot_rbp, slot_return,
+  slot_count,
+};
+static void init_fiber_stack(void** sp, void(*f)(void*), void* p) {
+  uint32_t mxcsr, fpu_cw = 0;
+  asm volatile("stmxcsr %0" : "=m"(mxcsr));
+  asm volatile("fnstcw %0" : "=m"(fpu_cw));
+  sp[slot_fpu_cw] = (void*)uintptr_t(fpu_cw);
+  sp[slot_mxcsr] = (void*)uintptr_t(mxcsr);
+  sp[slot_r12] = (void*)f;
+  sp[slot_r13] = p;
+  sp[slot_rbp] = nullptr;
+  sp[slot_return] = (void*)l_fiber_trampoline;
+}
+// Trampoline must see a 16-byte aligned stack pointer right before its call
+static const uintptr_t stack_frame_size = (slot_count + 2) * sizeof(void*);
+#elif defined(__aarch64__)
+asm(R"(
+.text
+.globl l_switch_context
+.type l_switch_context,%function
+.align 4
+l_switch_context:
+  sub sp, sp, #176
+  stp x19, x20, [sp, #0]
+  stp x21, x22, [sp, #16]
+  stp x23, x24, [sp, #32]
+  stp x25, x26, [sp, #48]
+  stp x27, x28, [sp, #64]
+  stp x29, x30, [sp, #80]
+  stp d8, d9, [sp, #96]
+  stp d10, d11, [sp, #112]
+  stp d12, d13, [sp, #128]
+  stp d14, d15, [sp, #144]
+  mrs x9, fpcr
+  str x9, [sp, #160]
+  mov x9, sp
+  str x9, [x0]
+  mov sp, x1
+  ldp x19, x20, [sp, #0]
+  ldp x21, x22, [sp, #16]
+  ldp x23, x24, [sp, #32]
+  ldp x25, x26, [sp, #48]
+  ldp x27, x28, [sp, #64]
+  ldp x29, x30, [sp, #80]
+  ldp d8, d9, [sp, #96]
+  ldp d10, d11, [sp, #112]
+  ldp d12, d13, [sp, #128]
+  ldp d14, d15, [sp, #144]
+  ldr x9, [sp, #160]
+  msr fpcr, x9
+  add sp, sp, #176
+  ret
+.size l_switch_context,.-l_switch_context
+
+.globl l_fiber_trampoline
+.type l_fiber_trampoline,%function
+.align 4
+l_fiber_trampoline:
+  mov x0, x20
+  blr x19
+  brk #0
+.size l_fiber_trampoline,.-l_fiber_trampoline
+)");
+
+enum : uintptr_t { // Stack slots of a suspended context
+  slot_x19, slot_x20, slot_x29 = 10, slot_x30, slot_fpcr = 20,
+  slot_count = 22,
+};
+static void init_fiber_stack(void** sp, void(*f)(void*), void* p) {
+  uint64_t fpcr;
+  asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+  sp[slot_x19] = (void*)f;
+  sp[slot_x20] = p;
+  sp[slot_x29] = nullptr;
+  sp[slot_x30] = (void*)l_fiber_trampoline;
+  sp[slot_fpcr] = (void*)uintptr_t(fpcr);
 }
-template <class T> inline static T* local_alloc_type() {
-  return (T*)local_alloc(sizeof(T));
+static const uintptr_t stack_frame_size = slot_count * sizeof(void*);
+#endif
+#endif
+
+static thread_local FiberContext* current_context;
+
+// Reserves a fiber stack with a guard page at its bottom to catch overflows
+static uint8_t* alloc_stack() {
+  const size_t page_size(sysconf(_SC_PAGESIZE));
+  uint8_t* stack = (uint8_t*)mmap(nullptr, fiber_stack_size, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if(stack == MAP_FAILED) {
+    error("Could not allocate fiber stack");
+  }
+  mprotect(stack, page_size, PROT_NONE);
+  return stack;
 }
 
 static void* proxy(void* p) {
   void** pa = (void**)p;
   void(*f)(void*) = (void (*)(void*))pa[0];
-  f(pa[1]);
+  void* arg = pa[1];
+  Memory::free_type(pa, 2);
+  f(arg);
   return nullptr;
 }
 
 namespace L {
   void* convert_to_fiber() {
-    ucontext_t* context(local_alloc_type<ucontext_t>());
+    FiberContext* context(Memory::new_type<FiberContext>());
+#if L_UCONTEXT_FIBERS
     getcontext(context);
+#endif
     current_context = context;
     return context;
   }
   void* create_fiber(void(*f)(void*), void* p) {
-    ucontext_t* context(local_alloc_type<ucontext_t>());
+    uint8_t* stack = alloc_stack();
+#if L_UCONTEXT_FIBERS
+    FiberContext* context(Memory::new_type<FiberContext>());
     if(getcontext(context) < 0) {
       error("getcontext error");
     }
     context->uc_stack.ss_size = fiber_stack_size;
-    context->uc_stack.ss_sp = local_alloc(context->uc_stack.ss_size);
+    context->uc_stack.ss_sp = stack;
     makecontext(context, (void(*)(void))f, 1, p);
+#else
+    // Context sits at the top of the stack, initial frame right below it
+    FiberContext* context((FiberContext*)(stack + fiber_stack_size) - 1);
+    const uintptr_t stack_top(uintptr_t(context) & ~uintptr_t(15));
+    context->sp = (void*)(stack_top - stack_frame_size);
+    init_fiber_stack((void**)context->sp, f, p);
+#endif
     return context;
   }
   void switch_to_fiber(void* f) {
-    ucontext_t* old_context(current_context);
-    current_context = (ucontext_t*)f;
+    FiberContext* old_context(current_context);
+    current_context = (FiberContext*)f;
+#if L_UCONTEXT_FIBERS
     swapcontext(old_context, current_context);
+#else
+    l_switch_context(&old_context->sp, current_context->sp);
+#endif
   }
   void create_thread(void(*f)(void*), void* p) {
     pthread_t thread;
-    void** proxy_p = (void**)local_alloc(2*sizeof(void*));
+    void** proxy_p = Memory::alloc_type<void*>(2);
     proxy_p[0] = (void*)f;
     proxy_p[1] = p;
     pthread_create(&thread, nullptr, proxy, proxy_p);
   }
+  void wait_on_address(std::atomic<uint32_t>* address, uint32_t value) {
+    syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+  }
+  void wake_address(std::atomic<uint32_t>* address) {
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+  }
   uint32_t core_count() {
     String output;
     System::call("nproc", output);
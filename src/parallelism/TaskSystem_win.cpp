@@ -1,5 +1,6 @@
 #include "TaskSystem.h"
 
+#include <atomic>
 #include <Windows.h>
 
 using namespace L;
@@ -9,7 +10,8 @@ namespace L {
     return ConvertThreadToFiber(0);
   }
   void* create_fiber(void(*f)(void*), void* p) {
-    return CreateFiber(0, f, p);
+    // Stack is reserved up front but only committed as it grows, like on Unix
+    return CreateFiberEx(0, 1 << 19, 0, f, p);
   }
   void switch_to_fiber(void* f) {
     SwitchToFiber(f);
@@ -17,6 +19,12 @@ namespace L {
   void create_thread(void(*f)(void*), void* p) {
     CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)f, (LPVOID)p, 0, NULL);
   }
+  void wait_on_address(std::atomic<uint32_t>* address, uint32_t value) {
+    WaitOnAddress(address, &value, sizeof(value), INFINITE);
+  }
+  void wake_address(std::atomic<uint32_t>* address) {
+    WakeByAddressSingle(address);
+  }
   uint32_t core_count() {
     SYSTEM_INFO system_info;
     GetSystemInfo(&system_info);
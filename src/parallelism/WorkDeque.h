@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "../system/Memory.h"
+
+namespace L {
+  // Chase-Lev work-stealing deque of pointers
+  // The owner thread pushes and pops from the bottom (LIFO)
+  // while any other thread may steal from the top (FIFO)
+  // Storage grows on demand, previous buffers are kept alive
+  // until destruction because thieves may still be reading them
+  template <class T>
+  class WorkDeque {
+  protected:
+    struct Buffer {
+      Buffer* previous;
+      intptr_t mask;
+      std::atomic<T*> data[1];
+
+      inline T* get(intptr_t i) const { return data[i & mask].load(std::memory_order_relaxed); }
+      inline void put(intptr_t i, T* e) { data[i & mask].store(e, std::memory_order_relaxed); }
+      static size_t alloc_size(intptr_t capacity) { return sizeof(Buffer) + sizeof(std::atomic<T*>) * (capacity - 1); }
+    };
+    static constexpr intptr_t initial_capacity = 1 << 8;
+
+    std::atomic<Buffer*> _buffer = {nullptr};
+    std::atomic<intptr_t> _top = {0};
+    std::atomic<intptr_t> _bottom = {0};
+
+    Buffer* grow(Buffer* old_buffer, intptr_t top, intptr_t bottom) {
+      const intptr_t capacity = old_buffer ? (old_buffer->mask + 1) * 2 : initial_capacity;
+      Buffer* buffer = (Buffer*)Memory::alloc(Buffer::alloc_size(capacity));
+      buffer->previous = old_buffer;
+      buffer->mask = capacity - 1;
+      for(intptr_t i = top; i < bottom; i++) {
+        buffer->put(i, old_buffer->get(i));
+      }
+      _buffer.store(buffer, std::memory_order_release);
+      return buffer;
+    }
+
+  public:
+    constexpr WorkDeque() {}
+    ~WorkDeque() {
+      Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+      while(buffer) {
+        Buffer* previous = buffer->previous;
+        Memory::free(buffer, Buffer::alloc_size(buffer->mask + 1));
+        buffer = previous;
+      }
+    }
+
+    // Owner only
+    void push(T* e) {
+      const intptr_t b = _bottom.load(std::memory_order_relaxed);
+      const intptr_t t = _top.load(std::memory_order_acquire);
+      Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+      if(buffer == nullptr || b - t > buffer->mask) {
+        buffer = grow(buffer, t, b);
+      }
+      buffer->put(b, e);
+      std::atomic_thread_fence(std::memory_order_release);
+      _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    // Owner only
+    T* pop() {
+      const intptr_t b = _bottom.load(std::memory_order_relaxed) - 1;
+      Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+      _bottom.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      intptr_t t = _top.load(std::memory_order_relaxed);
+      T* e = nullptr;
+      if(t <= b) {
+        e = buffer->get(b);
+        if(t == b) { // Last element: race against thieves
+          if(!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            e = nullptr;
+          }
+          _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+      } else {
+        _bottom.store(b + 1, std::memory_order_relaxed);
+      }
+      return e;
+    }
+    // Any thread, may spuriously fail when racing with other thieves
+    T* steal() {
+      intptr_t t = _top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      const intptr_t b = _bottom.load(std::memory_order_acquire);
+      if(t < b) {
+        Buffer* buffer = _buffer.load(std::memory_order_acquire);
+        T* e = buffer->get(t);
+        if(_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+          return e;
+        }
+      }
+      return nullptr;
+    }
+    inline bool empty() const {
+      return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+    }
+  };
+}
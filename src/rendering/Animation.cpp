@@ -1,127 +1,425 @@
 #include "Animation.h"
 
+#include "../math/simd.h"
+
 using namespace L;
 
-static inline void find_sample(const AnimationChannel& channel, float time, uintptr_t& i, float& t, float& span) {
-  for(i = 0; i < channel.times.size(); i++) {
-    if(channel.times[i] > time) {
-      if(i == 0) { // Before first sample, take value as is
-        t = 0.f;
-        span = 0.f;
-        return;
-      } else { // Interpolate values
-        i = i - 1;
-        span = channel.times[i + 1] - channel.times[i];
-        t = (time - channel.times[i]) / span;
-        return;
+static const uint32_t cursor_scan_count = 4;
+static const float quantization_scale = 32767.f;
+
+static inline uint32_t channel_component_count(AnimationChannelType type) {
+  switch(type) {
+    case AnimationChannelType::Translation: return 3;
+    case AnimationChannelType::Rotation: return 4;
+    default: return 1;
+  }
+}
+
+// Rotation keys are unit quaternions and can be stored as 16-bit fixed point
+// Cubic spline tangents are unbounded so these channels stay in floating point
+static inline bool is_quantized(AnimationChannelType type, AnimationInterpolationType interpolation) {
+  return type == AnimationChannelType::Rotation && interpolation != AnimationInterpolationType::CubicSpline;
+}
+static inline int16_t quantize(float v) {
+  const float scaled(clamp(v, -1.f, 1.f) * quantization_scale);
+  return int16_t(scaled < 0.f ? scaled - .5f : scaled + .5f);
+}
+static inline float dequantize(int16_t v) {
+  return float(v) / quantization_scale;
+}
+
+// Channels of a joint usually share their key times, these are only stored once
+static bool same_times(const AnimationChannel& a, const AnimationChannel& b) {
+  return a.times.size() == b.times.size() && !memcmp(a.times.begin(), b.times.begin(), a.times.size() * sizeof(float));
+}
+
+Animation::Animation(const Intermediate& intermediate) : duration(intermediate.duration) {
+  size_t times_size(0), values_size(0), rotations_size(0);
+  for(uintptr_t i(0); i < intermediate.channels.size(); i++) {
+    const AnimationChannel& channel(intermediate.channels[i]);
+    if(i == 0 || !same_times(intermediate.channels[i - 1], channel)) {
+      times_size += channel.times.size();
+    }
+    if(is_quantized(channel.type, channel.interpolation)) {
+      rotations_size += channel.values.size();
+    } else {
+      values_size += channel.values.size();
+    }
+  }
+
+  keys.size(times_size + values_size);
+  rotation_keys.size(rotations_size);
+  uint32_t times_offset(0), values_offset = uint32_t(times_size), rotations_offset(0);
+  for(uintptr_t i(0); i < intermediate.channels.size(); i++) {
+    const AnimationChannel& channel(intermediate.channels[i]);
+    if(i > 0 && !same_times(intermediate.channels[i - 1], channel)) {
+      times_offset += uint32_t(intermediate.channels[i - 1].times.size());
+    }
+    memcpy(keys.begin() + times_offset, channel.times.begin(), channel.times.size() * sizeof(float));
+    const bool quantized(is_quantized(channel.type, channel.interpolation));
+    if(quantized) {
+      for(uintptr_t j(0); j < channel.values.size(); j++) {
+        rotation_keys[rotations_offset + j] = quantize(channel.values[j]);
       }
-    } else if(i == channel.times.size() - 1) { // After last sample, take value as is
-      t = 0.f;
-      span = 0.f;
-      return;
-    }
-  }
-}
-
-void Animation::pose_at(float time, JointPose* joints) const {
-  for(const AnimationChannel& channel : channels) {
-    Vector3f& translation = joints[channel.joint_index].translation;
-    Quatf& rotation = joints[channel.joint_index].rotation;
-    float& scale = joints[channel.joint_index].scale;
-
-    uintptr_t i;
-    float t = 0.f, span = 0.f;
-    find_sample(channel, time, i, t, span);
-
-    AnimationInterpolationType interpolation = channel.interpolation;
-    if(channel.times.size() == 1) {
-      // Cannot do fancy interpolation with a single value
-      interpolation = AnimationInterpolationType::Step;
-    }
-
-    switch(interpolation) {
-      case AnimationInterpolationType::Step:
-        switch(channel.type) {
-          case AnimationChannelType::Translation:
-            memcpy(&translation, channel.values.begin() + i * 3, sizeof(Vector3f));
-            break;
-          case AnimationChannelType::Rotation:
-            memcpy(&rotation, channel.values.begin() + i * 4, sizeof(Quatf));
-            break;
-          case AnimationChannelType::Scale:
-            scale = channel.values[i];
-            break;
+    } else {
+      memcpy(keys.begin() + values_offset, channel.values.begin(), channel.values.size() * sizeof(float));
+    }
+    channels.push(Channel {
+      times_offset, quantized ? rotations_offset : values_offset, uint32_t(channel.times.size()),
+      uint32_t(channel.joint_index),
+      channel.type, channel.interpolation,
+    });
+    (quantized ? rotations_offset : values_offset) += uint32_t(channel.values.size());
+  }
+}
+
+// Finds the last key at or before time, or the first one if there's none
+// Starts by scanning forward from the hint, then falls back to binary search
+static inline uint32_t find_key(const float* times, uint32_t count, float time, uint32_t hint) {
+  uint32_t begin(0);
+  if(hint < count && times[hint] <= time) {
+    const uint32_t scan_end(min(hint + cursor_scan_count, count - 1));
+    uint32_t i(hint);
+    while(i < scan_end && times[i + 1] <= time) {
+      i++;
+    }
+    if(i < scan_end || i == count - 1) {
+      return i;
+    }
+    begin = i;
+  }
+  uint32_t end(count);
+  while(begin < end) {
+    const uint32_t middle((begin + end) / 2);
+    if(times[middle] <= time) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return begin > 0 ? begin - 1 : 0;
+}
+
+size_t L::resource_cpu_size(const Animation::Intermediate& v) {
+  size_t size(v.channels.size() * sizeof(Animation::Channel));
+  for(uintptr_t i(0); i < v.channels.size(); i++) {
+    const AnimationChannel& channel(v.channels[i]);
+    if(i == 0 || !same_times(v.channels[i - 1], channel)) {
+      size += channel.times.size() * sizeof(float);
+    }
+    size += channel.values.size() * (is_quantized(channel.type, channel.interpolation) ? sizeof(int16_t) : sizeof(float));
+  }
+  return size;
+}
+
+// Quantized channels are written the way they're stored at runtime
+void L::resource_write(Stream& s, const Animation::Intermediate& v) {
+  s <= v.channels.size();
+  for(const AnimationChannel& channel : v.channels) {
+    s <= channel.times <= channel.joint_name <= channel.joint_index <= channel.type <= channel.interpolation;
+    if(is_quantized(channel.type, channel.interpolation)) {
+      Array<int16_t> values;
+      values.size(channel.values.size());
+      for(uintptr_t i(0); i < values.size(); i++) {
+        values[i] = quantize(channel.values[i]);
+      }
+      s <= values;
+    } else {
+      s <= channel.values;
+    }
+  }
+  s <= v.duration;
+}
+void L::resource_read(Stream& s, Animation::Intermediate& v) {
+  size_t channel_count(0);
+  s >= channel_count;
+  v.channels.size(channel_count);
+  for(AnimationChannel& channel : v.channels) {
+    s >= channel.times >= channel.joint_name >= channel.joint_index >= channel.type >= channel.interpolation;
+    if(is_quantized(channel.type, channel.interpolation)) {
+      Array<int16_t> values;
+      s >= values;
+      channel.values.size(values.size());
+      for(uintptr_t i(0); i < values.size(); i++) {
+        channel.values[i] = dequantize(values[i]);
+      }
+    } else {
+      s >= channel.values;
+    }
+  }
+  s >= v.duration;
+}
+
+// Linear interpolation between keys a and b must reproduce every key in between for all channels
+static bool can_skip_keys(const Array<AnimationChannel>& channels, uintptr_t first, uintptr_t last, uintptr_t a, uintptr_t b, float tolerance) {
+  const Array<float>& times(channels[first].times);
+  for(uintptr_t k(a + 1); k < b; k++) {
+    const float t((times[k] - times[a]) / (times[b] - times[a]));
+    for(uintptr_t i(first); i < last; i++) {
+      const uint32_t component_count(channel_component_count(channels[i].type));
+      const float* values(channels[i].values.begin());
+      for(uint32_t c(0); c < component_count; c++) {
+        const float interpolated(values[a * component_count + c] * (1.f - t) + values[b * component_count + c] * t);
+        if(abs(interpolated - values[k * component_count + c]) > tolerance) {
+          return false;
         }
-        break;
-      case AnimationInterpolationType::Linear:
-        switch(channel.type) {
-          case AnimationChannelType::Translation:
-          {
-            Vector3f a, b;
-            memcpy(&a, channel.values.begin() + i * 3, sizeof(Vector3f));
-            memcpy(&b, channel.values.begin() + (i + 1) * 3, sizeof(Vector3f));
-            translation = a * (1.f - t) + b * t;
-            break;
-          }
-          case AnimationChannelType::Rotation:
-          {
-            Vector4f a, b;
-            memcpy(&a, channel.values.begin() + i * 4, sizeof(Vector4f));
-            memcpy(&b, channel.values.begin() + (i + 1) * 4, sizeof(Vector4f));
-            rotation = a * (1.f - t) + b * t;
-            break;
-          }
-          case AnimationChannelType::Scale:
-            scale = channel.values[i] * (1.f - t) + channel.values[i + 1] * t;
-            break;
+      }
+    }
+  }
+  return true;
+}
+
+void L::animation_reduce_keys(Animation::Intermediate& intermediate, float tolerance) {
+  Array<AnimationChannel>& channels(intermediate.channels);
+  for(uintptr_t first(0), last(0); first < channels.size(); first = last) {
+    // Channels sharing key times are reduced together to keep sharing them
+    bool linear(true);
+    for(last = first; last < channels.size() && (last == first || same_times(channels[last - 1], channels[last])); last++) {
+      linear = linear && channels[last].interpolation == AnimationInterpolationType::Linear;
+    }
+    const uintptr_t key_count(channels[first].times.size());
+    if(!linear || key_count < 3) {
+      continue;
+    }
+
+    // Greedily extend each segment as long as the keys it spans can be skipped
+    Array<uintptr_t> kept_keys;
+    kept_keys.push(0);
+    for(uintptr_t a(0), b(2); b < key_count; b++) {
+      if(!can_skip_keys(channels, first, last, a, b, tolerance)) {
+        a = b - 1;
+        kept_keys.push(a);
+      }
+    }
+    kept_keys.push(key_count - 1);
+    if(kept_keys.size() == key_count) {
+      continue;
+    }
+
+    for(uintptr_t i(first); i < last; i++) {
+      AnimationChannel& channel(channels[i]);
+      const uint32_t component_count(channel_component_count(channel.type));
+      for(uintptr_t k(0); k < kept_keys.size(); k++) {
+        channel.times[k] = channel.times[kept_keys[k]];
+        memmove(channel.values.begin() + k * component_count, channel.values.begin() + kept_keys[k] * component_count, component_count * sizeof(float));
+      }
+      channel.times.size(kept_keys.size());
+      channel.values.size(kept_keys.size() * component_count);
+    }
+  }
+}
+
+// Returns the components of a key, or of its value for cubic splines
+static inline void key_value(const Animation& animation, const Animation::Channel& channel, uint32_t key, float* value) {
+  const uint32_t component_count(channel_component_count(channel.type));
+  if(is_quantized(channel.type, channel.interpolation)) {
+    const int16_t* values(animation.rotation_keys.begin() + channel.values_offset + key * 4);
+    for(uint32_t i(0); i < 4; i++) {
+      value[i] = dequantize(values[i]);
+    }
+  } else {
+    const uint32_t stride(channel.interpolation == AnimationInterpolationType::CubicSpline ? component_count * 3 : component_count);
+    const uint32_t offset(channel.interpolation == AnimationInterpolationType::CubicSpline ? component_count : 0);
+    memcpy(value, animation.keys.begin() + channel.values_offset + key * stride + offset, component_count * sizeof(float));
+  }
+}
+
+// Evaluates a channel at time, filling as many components as its type has
+static void sample_channel(const Animation& animation, uintptr_t channel_index, float time, AnimationCursor* cursor, float* value) {
+  const Animation::Channel& channel(animation.channels[channel_index]);
+  const float* times(animation.keys.begin() + channel.times_offset);
+  const uint32_t component_count(channel_component_count(channel.type));
+
+  const uint32_t i(find_key(times, channel.key_count, time, cursor ? cursor->keys[channel_index] : 0));
+  if(cursor) {
+    cursor->keys[channel_index] = i;
+  }
+  if(i + 1 >= channel.key_count || times[i] > time) {
+    // Before first or after last key, or cannot do fancy interpolation with a single value
+    key_value(animation, channel, i, value);
+    return;
+  }
+  const float span(times[i + 1] - times[i]);
+  const float t((time - times[i]) / span);
+
+  switch(channel.interpolation) {
+    case AnimationInterpolationType::Step:
+      key_value(animation, channel, i, value);
+      break;
+    case AnimationInterpolationType::Linear:
+      if(is_quantized(channel.type, channel.interpolation)) {
+        const int16_t* key0(animation.rotation_keys.begin() + channel.values_offset + i * 4);
+        for(uint32_t c(0); c < 4; c++) {
+          value[c] = dequantize(key0[c]) * (1.f - t) + dequantize(key0[4 + c]) * t;
+        }
+      } else {
+        const float* key0(animation.keys.begin() + channel.values_offset + i * component_count);
+        for(uint32_t c(0); c < component_count; c++) {
+          value[c] = key0[c] * (1.f - t) + key0[component_count + c] * t;
+        }
+      }
+      break;
+    case AnimationInterpolationType::CubicSpline:
+    {
+      // Keys are made of in-tangent, value and out-tangent
+      const float t2 = t * t;
+      const float t3 = t2 * t;
+      const float p0f = 2.f * t3 - 3.f * t2 + 1.f;
+      const float m0f = (t3 - 2.f * t2 + t) * span;
+      const float p1f = -2.f * t3 + 3.f * t2;
+      const float m1f = (t3 - t2) * span;
+      const float* key0(animation.keys.begin() + channel.values_offset + i * component_count * 3);
+      const float* key1(key0 + component_count * 3);
+      for(uint32_t c(0); c < component_count; c++) {
+        value[c] = p0f * key0[component_count + c] + m0f * key0[component_count * 2 + c]
+          + p1f * key1[component_count + c] + m1f * key1[c];
+      }
+      break;
+    }
+  }
+}
+
+// Normalized linear interpolation through the shortest path, flips a rather than b to end up exactly on b
+static inline Quatf nlerp(const Quatf& a, const Quatf& b, float t) {
+  const float at(a.dot(b) < 0.f ? t - 1.f : 1.f - t);
+  return Quatf(Vector4f(a) * at + Vector4f(b) * t).normalized();
+}
+
+void Animation::pose_at(float time, JointPose* joints, AnimationCursor* cursor) const {
+  if(cursor && cursor->keys.size() != channels.size()) {
+    cursor->keys.size(channels.size(), 0u);
+  }
+  for(uintptr_t channel_index(0); channel_index < channels.size(); channel_index++) {
+    const Channel& channel(channels[channel_index]);
+    if(channel.key_count == 0) {
+      continue;
+    }
+    float value[4];
+    sample_channel(*this, channel_index, time, cursor, value);
+    JointPose& joint(joints[channel.joint_index]);
+    switch(channel.type) {
+      case AnimationChannelType::Translation: memcpy(&joint.translation, value, sizeof(Vector3f)); break;
+      case AnimationChannelType::Rotation: memcpy(&joint.rotation, value, sizeof(Quatf)); break;
+      case AnimationChannelType::Scale: joint.scale = value[0]; break;
+    }
+  }
+}
+
+void Animation::blend_at(float time, JointPose* joints, float weight, AnimationBlendMode mode, const float* joint_weights, AnimationCursor* cursor) const {
+  if(cursor && cursor->keys.size() != channels.size()) {
+    cursor->keys.size(channels.size(), 0u);
+  }
+  for(uintptr_t channel_index(0); channel_index < channels.size(); channel_index++) {
+    const Channel& channel(channels[channel_index]);
+    const float w(joint_weights ? weight * joint_weights[channel.joint_index] : weight);
+    if(channel.key_count == 0 || w <= 0.f) {
+      continue; // Masked out channels aren't even sampled
+    }
+    float value[4], reference[4];
+    sample_channel(*this, channel_index, time, cursor, value);
+    if(mode == AnimationBlendMode::Additive) {
+      key_value(*this, channel, 0, reference);
+    }
+    JointPose& joint(joints[channel.joint_index]);
+    switch(channel.type) {
+      case AnimationChannelType::Translation:
+      {
+        const Vector3f translation(value[0], value[1], value[2]);
+        if(mode == AnimationBlendMode::Additive) {
+          joint.translation += (translation - Vector3f(reference[0], reference[1], reference[2])) * w;
+        } else {
+          joint.translation = joint.translation * (1.f - w) + translation * w;
         }
         break;
-      case AnimationInterpolationType::CubicSpline:
+      }
+      case AnimationChannelType::Rotation:
       {
-        const float t2 = t * t;
-        const float t3 = t2 * t;
-        const float p0f = 2.f * t3 - 3.f * t2 + 1.f;
-        const float m0f = t3 - 2.f * t2 + t;
-        const float p1f = -2.f * t3 + 3.f * t2;
-        const float m1f = t3 - t2;
-        switch(channel.type) {
-          case AnimationChannelType::Translation:
-          {
-            Vector3f p0, m0, p1, m1;
-            memcpy(&p0, channel.values.begin() + i * 9 + 3, sizeof(Vector3f));
-            memcpy(&m0, channel.values.begin() + i * 9 + 6, sizeof(Vector3f));
-            memcpy(&p1, channel.values.begin() + (i + 1) * 9 + 3, sizeof(Vector3f));
-            memcpy(&m1, channel.values.begin() + (i + 1) * 9, sizeof(Vector3f));
-            m0 *= span;
-            m1 *= span;
-            translation = p0f * p0 + m0f * m0 + p1f * p1 + m1f * m1;
-            break;
-          }
-          case AnimationChannelType::Rotation:
-          {
-            Vector4f p0, m0, p1, m1;
-            memcpy(&p0, channel.values.begin() + i * 12 + 4, sizeof(Vector4f));
-            memcpy(&m0, channel.values.begin() + i * 12 + 8, sizeof(Vector4f));
-            memcpy(&p1, channel.values.begin() + (i + 1) * 12 + 4, sizeof(Vector4f));
-            memcpy(&m1, channel.values.begin() + (i + 1) * 12, sizeof(Vector4f));
-            m0 *= span;
-            m1 *= span;
-            rotation = p0f * p0 + m0f * m0 + p1f * p1 + m1f * m1;
-            break;
-          }
-          case AnimationChannelType::Scale:
-            float p0, m0, p1, m1;
-            p0 = channel.values[i * 3 + 1];
-            m0 = channel.values[i * 3 + 2];
-            p1 = channel.values[(i + 1) * 3 + 1];
-            m1 = channel.values[(i + 1) * 3];
-            m0 *= span;
-            m1 *= span;
-            scale = p0f * p0 + m0f * m0 + p1f * p1 + m1f * m1;
-            break;
+        const Quatf rotation(value[0], value[1], value[2], value[3]);
+        if(mode == AnimationBlendMode::Additive) {
+          const Quatf delta(Quatf(reference[0], reference[1], reference[2], reference[3]).inverse() * rotation);
+          joint.rotation = joint.rotation * nlerp(Quatf(), delta, w);
+        } else {
+          joint.rotation = nlerp(joint.rotation, rotation, w);
         }
         break;
       }
+      case AnimationChannelType::Scale:
+        if(mode == AnimationBlendMode::Additive) {
+          joint.scale *= 1.f + (reference[0] != 0.f ? value[0] / reference[0] - 1.f : 0.f) * w;
+        } else {
+          joint.scale = joint.scale * (1.f - w) + value[0] * w;
+        }
+        break;
+    }
+  }
+}
+
+// Affine matrix as four columns, the bottom row is always (0,0,0,1)
+struct Affine {
+  Float4 c[4];
+};
+
+static inline Affine affine_load(const Matrix44f& m) {
+  return Affine {{f4_load(m.array()), f4_load(m.array() + 4), f4_load(m.array() + 8), f4_load(m.array() + 12)}};
+}
+static inline void affine_store(const Affine& a, Matrix44f& m) {
+  for(uintptr_t i(0); i < 4; i++) {
+    f4_store(m.array() + i * 4, a.c[i]);
+  }
+}
+
+// Same as sqt_to_mat, with all three rotation columns built from shuffled products of the quaternion
+static inline Affine sqt_to_affine(const JointPose& pose) {
+  const Float4 q(f4_load(pose.rotation.array()));
+  const Float4 q2(f4_add(q, q));
+  const Float4 s(f4_set(pose.scale, pose.scale, pose.scale, 0.f));
+  // (1-2yy-2zz, 2xy+2zw, 2xz-2yw)
+  const Float4 a0(f4_mul(f4_shuffle<1, 0, 0, 3>(q), f4_shuffle<1, 1, 2, 3>(q2)));
+  const Float4 b0(f4_mul(f4_shuffle<2, 2, 1, 3>(q), f4_shuffle<2, 3, 3, 3>(q2)));
+  const Float4 c0(f4_madd(b0, f4_set(-1.f, 1.f, -1.f, 0.f), f4_madd(a0, f4_set(-1.f, 1.f, 1.f, 0.f), f4_set(1.f, 0.f, 0.f, 0.f))));
+  // (2xy-2zw, 1-2xx-2zz, 2yz+2xw)
+  const Float4 a1(f4_mul(f4_shuffle<0, 0, 1, 3>(q), f4_shuffle<1, 0, 2, 3>(q2)));
+  const Float4 b1(f4_mul(f4_shuffle<2, 2, 0, 3>(q), f4_shuffle<3, 2, 3, 3>(q2)));
+  const Float4 c1(f4_madd(b1, f4_set(-1.f, -1.f, 1.f, 0.f), f4_madd(a1, f4_set(1.f, -1.f, 1.f, 0.f), f4_set(0.f, 1.f, 0.f, 0.f))));
+  // (2xz+2yw, 2yz-2xw, 1-2xx-2yy)
+  const Float4 a2(f4_mul(f4_shuffle<0, 1, 0, 3>(q), f4_shuffle<2, 2, 0, 3>(q2)));
+  const Float4 b2(f4_mul(f4_shuffle<1, 0, 1, 3>(q), f4_shuffle<3, 3, 1, 3>(q2)));
+  const Float4 c2(f4_madd(b2, f4_set(1.f, -1.f, -1.f, 0.f), f4_madd(a2, f4_set(1.f, 1.f, -1.f, 0.f), f4_set(0.f, 0.f, 1.f, 0.f))));
+  return Affine {{
+    f4_mul(c0, s), f4_mul(c1, s), f4_mul(c2, s),
+    f4_set(pose.translation.x(), pose.translation.y(), pose.translation.z(), 1.f),
+  }};
+}
+
+// Only needs three multiply-adds per column because of the implicit bottom row
+static inline Affine affine_mul(const Affine& a, const Affine& b) {
+  Affine r;
+  for(uintptr_t i(0); i < 3; i++) {
+    r.c[i] = f4_madd(a.c[2], f4_shuffle<2, 2, 2, 2>(b.c[i]),
+      f4_madd(a.c[1], f4_shuffle<1, 1, 1, 1>(b.c[i]),
+        f4_mul(a.c[0], f4_shuffle<0, 0, 0, 0>(b.c[i]))));
+  }
+  r.c[3] = f4_madd(a.c[2], f4_shuffle<2, 2, 2, 2>(b.c[3]),
+    f4_madd(a.c[1], f4_shuffle<1, 1, 1, 1>(b.c[3]),
+      f4_madd(a.c[0], f4_shuffle<0, 0, 0, 0>(b.c[3]), a.c[3])));
+  return r;
+}
+
+void L::compute_skinning(const Skeleton& skeleton, const JointPose* local_pose, Matrix44f* global_pose, Matrix44f* skin) {
+  for(uintptr_t i(0); i < skeleton.joints.size(); i++) {
+    const SkeletonJoint& joint(skeleton.joints[i]);
+    const intptr_t parent(joint.parent);
+    L_ASSERT(parent < intptr_t(i));
+    Affine global(sqt_to_affine(local_pose[i]));
+    if(parent >= 0) {
+      global = affine_mul(affine_load(global_pose[parent]), global);
     }
+    affine_store(global, global_pose[i]);
+    affine_store(affine_mul(global, affine_load(joint.inv_bind_pose)), skin[i]);
+  }
+}
+void L::compute_skinning(const Skeleton& skeleton, const Matrix44f* global_pose, Matrix44f* skin) {
+  for(uintptr_t i(0); i < skeleton.joints.size(); i++) {
+    affine_store(affine_mul(affine_load(global_pose[i]), affine_load(skeleton.joints[i].inv_bind_pose)), skin[i]);
   }
 }
@@ -21,6 +21,12 @@ namespace L {
     Step, Linear, CubicSpline,
   };
 
+  enum class AnimationBlendMode : uint8_t {
+    Override, // Interpolates from the current pose
+    Additive, // Adds the difference to the first key
+  };
+
+  // Channel as produced by loaders, with its own arrays
   struct AnimationChannel {
     Array<float> times;
     Array<float> values;
@@ -30,13 +36,34 @@ namespace L {
     AnimationInterpolationType interpolation;
   };
 
+  // Remembers the last key sampled for each channel
+  // Sampling an animation forward from there only looks at a few keys
+  struct AnimationCursor {
+    Array<uint32_t> keys;
+  };
+
   struct Animation {
-    typedef Animation Intermediate;
+    struct Intermediate {
+      Array<AnimationChannel> channels;
+      float duration;
+    };
+    struct Channel {
+      uint32_t times_offset, values_offset, key_count;
+      uint32_t joint_index;
+      AnimationChannelType type;
+      AnimationInterpolationType interpolation;
+    };
 
-    Array<AnimationChannel> channels;
+    Array<Channel> channels;
+    Array<float> keys; // Times of all channels followed by values of all channels
+    Array<int16_t> rotation_keys; // Quantized rotation values
     float duration;
 
-    void pose_at(float time, JointPose* joints) const;
+    Animation(const Intermediate&);
+    void pose_at(float time, JointPose* joints, AnimationCursor* cursor = nullptr) const;
+    // Samples and blends into joints in one pass, channels of joints with no weight aren't sampled
+    void blend_at(float time, JointPose* joints, float weight, AnimationBlendMode mode = AnimationBlendMode::Override,
+      const float* joint_weights = nullptr, AnimationCursor* cursor = nullptr) const;
   };
 
   struct SkeletonJoint {
@@ -51,13 +78,22 @@ namespace L {
     Array<SkeletonJoint> joints;
   };
 
+  // Removes linear keys that can be interpolated from their neighbours within tolerance
+  void animation_reduce_keys(Animation::Intermediate&, float tolerance);
+
+  // Computes global and skinning matrices of all joints from their local poses
+  // Joint transforms are expected to be affine, parents must come before their children
+  void compute_skinning(const Skeleton&, const JointPose* local_pose, Matrix44f* global_pose, Matrix44f* skin);
+  // Computes skinning matrices from already known global matrices
+  void compute_skinning(const Skeleton&, const Matrix44f* global_pose, Matrix44f* skin);
+
 
   inline Stream& operator<=(Stream& s, const AnimationChannel& v) { return s <= v.times <= v.values <= v.joint_name <= v.joint_index <= v.type <= v.interpolation; }
   inline Stream& operator>=(Stream& s, AnimationChannel& v) { return s >= v.times >= v.values >= v.joint_name >= v.joint_index >= v.type >= v.interpolation; }
   inline size_t get_cpu_size(const AnimationChannel& v) { return get_cpu_size(v.times) + get_cpu_size(v.values); }
-  inline void resource_write(Stream& s, const Animation& v) { s <= v.channels <= v.duration; }
-  inline void resource_read(Stream& s, Animation& v) { s >= v.channels >= v.duration; }
-  inline size_t resource_cpu_size(const Animation& v) { return get_cpu_size(v.channels); }
+  void resource_write(Stream& s, const Animation::Intermediate& v);
+  void resource_read(Stream& s, Animation::Intermediate& v);
+  size_t resource_cpu_size(const Animation::Intermediate& v);
   inline Stream& operator<=(Stream& s, const SkeletonJoint& v) { return s <= v.inv_bind_pose <= v.name <= v.parent; }
   inline Stream& operator>=(Stream& s, SkeletonJoint& v) { return s >= v.inv_bind_pose >= v.name >= v.parent; }
   inline void resource_write(Stream& s, const Skeleton& v) { s <= v.joints; }
@@ -1,10 +1,12 @@
 #include "ScriptContext.h"
 
+#include <atomic>
 #include <stdarg.h>
 
 #include "../container/Ref.h"
 #include "../engine/Resource.h"
 #include "../engine/Resource.inl"
+#include "../system/intrinsics.h"
 
 using namespace L;
 
@@ -111,6 +113,77 @@ bool ScriptContext::try_execute_method(const Symbol& sym, std::initializer_list<
   }
   return false;
 }
+// Operations are dispatched with computed gotos where the compiler supports it, a switch otherwise
+// Each operation jumps to the next one itself so branch prediction can learn opcode sequences
+#if defined(__GNUC__)
+#define L_SCRIPT_OP(op) op_##op
+#define L_SCRIPT_DISPATCH() goto* dispatch_table[load_opcode(ip)]
+#else
+#define L_SCRIPT_OP(op) case op
+#define L_SCRIPT_DISPATCH() continue
+#endif
+#define L_SCRIPT_NEXT() ip++; L_SCRIPT_DISPATCH()
+
+// Scripts are shared by contexts running on other threads, so opcodes are accessed atomically when quickening
+// Others may still see the generic or the quickened opcode, both handle operands of any type
+static_assert(sizeof(ScriptOpCode) == sizeof(uint8_t), "Opcodes must be accessible atomically as bytes");
+static inline ScriptOpCode load_opcode(const ScriptInstruction* ip) {
+  return ScriptOpCode(relaxed_load((const uint8_t*)&ip->opcode));
+}
+static inline void store_opcode(const ScriptInstruction* ip, ScriptOpCode opcode) {
+  relaxed_store((uint8_t*)&ip->opcode, uint8_t(opcode));
+}
+
+// Quickens a generic operation if its operands are floats
+#define L_SCRIPT_QUICKEN(a, b, op) \
+  if(a.is<float>() && b.is<float>()) { \
+    store_opcode(ip, op); \
+    L_SCRIPT_DISPATCH(); \
+  }
+
+// Finds the constant key of a GetItemConst or SetItemConst instruction in a table, starting from the slot it found last time
+// Returns null for other objects and missing keys, which are left to the generic path
+// Like opcodes, cached slots are shared between contexts on other threads, any slot is only a hint
+static inline Var* find_cached_item(Script& script, const ScriptInstruction* ip, const Var& object) {
+  const uintptr_t index(ip - script.bytecode.begin());
+  if(index < script.item_slots.size()) {
+    if(const Ref<Table<Var, Var>>* table = object.try_as<Ref<Table<Var, Var>>>()) {
+      std::atomic<uint32_t>& cached_slot(script.item_slots[index]);
+      const uint32_t previous_slot(cached_slot.load(std::memory_order_relaxed));
+      uint32_t slot(previous_slot);
+      Var* value((*table)->find(script.constants[ip->bc8.b], slot));
+      if(slot != previous_slot) {
+        cached_slot.store(slot, std::memory_order_relaxed);
+      }
+      return value;
+    }
+  }
+  return nullptr;
+}
+
+// Write numbers and booleans to locals without going through type descriptions when they already hold one
+static inline void set_float(Var& local, float value) {
+  if(float* f = local.try_as<float>()) {
+    *f = value;
+  } else {
+    local = value;
+  }
+}
+static inline void set_bool(Var& local, bool value) {
+  if(bool* b = local.try_as<bool>()) {
+    *b = value;
+  } else {
+    local = value;
+  }
+}
+static inline void copy_local(Var& dst, const Var& src) {
+  if(const float* f = src.try_as<float>()) {
+    set_float(dst, *f);
+  } else {
+    dst = src;
+  }
+}
+
 Var ScriptContext::execute(const Ref<ScriptFunction>& function, const Var* params, size_t param_count) {
   L_SCOPE_MARKER("Script execution");
 
@@ -139,67 +212,89 @@ Var ScriptContext::execute(const Ref<ScriptFunction>& function, const Var* param
   Ref<ScriptFunction> current_function = function;
   Ref<Script> current_script = function->script;
 
+  // The instruction pointer is only written back to the frame before leaving the loop or calling outside code
+  // Locals of the current frame are only moved when the stack is resized or a native function runs
+  const ScriptInstruction* ip = _frames.back().ip;
+  Var* locals = _stack.begin() + _current_stack_start;
+
+#if defined(__GNUC__)
+  static const void* dispatch_table[] = {
+    &&op_CopyLocal, &&op_LoadConst, &&op_LoadGlobal, &&op_StoreGlobal, &&op_LoadFun,
+    &&op_LoadOuter, &&op_StoreOuter, &&op_CaptLocal, &&op_CaptOuter,
+    &&op_MakeObject, &&op_MakeArray, &&op_GetItem, &&op_SetItem, &&op_PushItem,
+    &&op_MakeIterator, &&op_Iterate, &&op_IterEndJump,
+    &&op_Jump, &&op_CondJump, &&op_CondNotJump,
+    &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Mod, &&op_Inv, &&op_Not,
+    &&op_LessThan, &&op_LessEqual, &&op_Equal,
+    &&op_Call, &&op_Return,
+    &&op_CondCopyLocal, &&op_CondLoadConst, &&op_CondLoadGlobal, &&op_LoadBool, &&op_LoadInt, &&op_GetItemConst, &&op_SetItemConst,
+    &&op_AddFloat, &&op_SubFloat, &&op_MulFloat, &&op_DivFloat, &&op_LessThanFloat, &&op_LessEqualFloat,
+  };
+  static_assert(sizeof(dispatch_table) / sizeof(*dispatch_table) == LessEqualFloat + 1, "Script dispatch table is missing opcodes");
+  L_SCRIPT_DISPATCH();
+#else
   while(true) {
-    const ScriptInstruction ip = *_frames.back().ip;
-    switch(ip.opcode) {
-      case CopyLocal: local(ip.a) = local(ip.bc8.b); break;
-      case LoadConst: local(ip.a) = current_script->constants[ip.bcu16]; break;
-      case LoadGlobal: local(ip.a) = current_script->globals[ip.bcu16].value(); break;
-      case StoreGlobal: current_script->globals[ip.bcu16] = local(ip.a); break;
-      case LoadFun: local(ip.a) = ref<ScriptFunction>(ScriptFunction {current_script, uintptr_t(ip.bc16)}); break;
-
-      case LoadOuter:
+    switch(load_opcode(ip)) {
+#endif
+      L_SCRIPT_OP(CopyLocal): copy_local(locals[ip->a], locals[ip->bc8.b]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(LoadConst): copy_local(locals[ip->a], current_script->constants[ip->bcu16]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(LoadGlobal): locals[ip->a] = current_script->globals[ip->bcu16].value(); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(StoreGlobal): current_script->globals[ip->bcu16] = locals[ip->a]; L_SCRIPT_NEXT();
+      L_SCRIPT_OP(LoadFun): locals[ip->a] = ref<ScriptFunction>(ScriptFunction {current_script, uintptr_t(ip->bc16)}); L_SCRIPT_NEXT();
+
+      L_SCRIPT_OP(LoadOuter):
       {
-        Ref<ScriptOuter> outer = current_function->outers[ip.bc8.b];
-        local(ip.a) = (outer->offset > 0) ? _stack[outer->offset] : outer->value;
-        break;
+        Ref<ScriptOuter> outer = current_function->outers[ip->bc8.b];
+        locals[ip->a] = (outer->offset > 0) ? _stack[outer->offset] : outer->value;
+        L_SCRIPT_NEXT();
       }
-      case StoreOuter:
+      L_SCRIPT_OP(StoreOuter):
       {
-        Ref<ScriptOuter> outer = current_function->outers[ip.a];
-        ((outer->offset > 0) ? _stack[outer->offset] : outer->value) = local(ip.bc8.b);
-        break;
+        Ref<ScriptOuter> outer = current_function->outers[ip->a];
+        ((outer->offset > 0) ? _stack[outer->offset] : outer->value) = locals[ip->bc8.b];
+        L_SCRIPT_NEXT();
       }
-      case CaptLocal:
+      L_SCRIPT_OP(CaptLocal):
       {
-        L_ASSERT(local(ip.a).is<Ref<ScriptFunction>>());
-        Ref<ScriptOuter> outer = ref<ScriptOuter>(ScriptOuter {ip.bc8.b + _current_stack_start});
-        local(ip.a).as<Ref<ScriptFunction>>()->outers.push(outer);
+        L_ASSERT(locals[ip->a].is<Ref<ScriptFunction>>());
+        Ref<ScriptOuter> outer = ref<ScriptOuter>(ScriptOuter {ip->bc8.b + _current_stack_start});
+        locals[ip->a].as<Ref<ScriptFunction>>()->outers.push(outer);
         _outers.push(outer);
-        break;
+        L_SCRIPT_NEXT();
       }
-      case CaptOuter: local(ip.a).as<Ref<ScriptFunction>>()->outers.push(current_function->outers[ip.bc8.b]); break;
-
-      case MakeObject: local(ip.a) = ref<Table<Var, Var>>(); break;
-      case MakeArray: local(ip.a) = ref<Array<Var>>(); break;
-      case GetItem: get_item(*this, local(ip.a), local(ip.bc8.b), local(ip.bc8.c)); break;
-      case SetItem: set_item(*this, local(ip.a), local(ip.bc8.b), local(ip.bc8.c)); break;
-      case PushItem: push_item(*this, local(ip.a), local(ip.bc8.b)); break;
-
-      case MakeIterator: local(ip.a) = make_iterator(*this, local(ip.bc8.b)); break;
-      case Iterate: iterate(*this, local(ip.bc8.c), local(ip.a), local(ip.bc8.b)); break;
-      case IterEndJump: if(iterator_has_ended(local(ip.a))) _frames.back().ip += intptr_t(ip.bc16); break;
-
-      case Jump: _frames.back().ip += intptr_t(ip.bc16); break;
-      case CondJump: if(local(ip.a).get<bool>()) _frames.back().ip += intptr_t(ip.bc16); break;
-      case CondNotJump: if(!local(ip.a).get<bool>()) _frames.back().ip += intptr_t(ip.bc16); break;
-
-      case Add: local(ip.a) += local(ip.bc8.b); break;
-      case Sub: local(ip.a) -= local(ip.bc8.b); break;
-      case Mul: local(ip.a) *= local(ip.bc8.b); break;
-      case Div: local(ip.a) /= local(ip.bc8.b); break;
-      case Mod: local(ip.a) %= local(ip.bc8.b); break;
-      case Inv: local(ip.a).invert(); break;
-      case Not: local(ip.a) = !local(ip.a).get<bool>(); break;
-
-      case LessThan: local(ip.a) = (local(ip.bc8.b) < local(ip.bc8.c)); break;
-      case LessEqual: local(ip.a) = (local(ip.bc8.b) <= local(ip.bc8.c)); break;
-      case Equal: local(ip.a) = (local(ip.bc8.b) == local(ip.bc8.c)); break;
-
-      case Call:
+      L_SCRIPT_OP(CaptOuter): locals[ip->a].as<Ref<ScriptFunction>>()->outers.push(current_function->outers[ip->bc8.b]); L_SCRIPT_NEXT();
+
+      L_SCRIPT_OP(MakeObject): locals[ip->a] = ref<Table<Var, Var>>(); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(MakeArray): locals[ip->a] = ref<Array<Var>>(); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(GetItem): _frames.back().ip = ip; get_item(*this, locals[ip->a], locals[ip->bc8.b], locals[ip->bc8.c]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(SetItem): _frames.back().ip = ip; set_item(*this, locals[ip->a], locals[ip->bc8.b], locals[ip->bc8.c]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(PushItem): _frames.back().ip = ip; push_item(*this, locals[ip->a], locals[ip->bc8.b]); L_SCRIPT_NEXT();
+
+      L_SCRIPT_OP(MakeIterator): _frames.back().ip = ip; locals[ip->a] = make_iterator(*this, locals[ip->bc8.b]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Iterate): _frames.back().ip = ip; iterate(*this, locals[ip->bc8.c], locals[ip->a], locals[ip->bc8.b]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(IterEndJump): if(iterator_has_ended(locals[ip->a])) ip += intptr_t(ip->bc16); L_SCRIPT_NEXT();
+
+      L_SCRIPT_OP(Jump): ip += intptr_t(ip->bc16); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(CondJump): if(locals[ip->a].get<bool>()) ip += intptr_t(ip->bc16); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(CondNotJump): if(!locals[ip->a].get<bool>()) ip += intptr_t(ip->bc16); L_SCRIPT_NEXT();
+
+      L_SCRIPT_OP(Add): L_SCRIPT_QUICKEN(locals[ip->a], locals[ip->bc8.b], AddFloat); locals[ip->a] += locals[ip->bc8.b]; L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Sub): L_SCRIPT_QUICKEN(locals[ip->a], locals[ip->bc8.b], SubFloat); locals[ip->a] -= locals[ip->bc8.b]; L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Mul): L_SCRIPT_QUICKEN(locals[ip->a], locals[ip->bc8.b], MulFloat); locals[ip->a] *= locals[ip->bc8.b]; L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Div): L_SCRIPT_QUICKEN(locals[ip->a], locals[ip->bc8.b], DivFloat); locals[ip->a] /= locals[ip->bc8.b]; L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Mod): locals[ip->a] %= locals[ip->bc8.b]; L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Inv): locals[ip->a].invert(); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Not): set_bool(locals[ip->a], !locals[ip->a].get<bool>()); L_SCRIPT_NEXT();
+
+      L_SCRIPT_OP(LessThan): L_SCRIPT_QUICKEN(locals[ip->bc8.b], locals[ip->bc8.c], LessThanFloat); locals[ip->a] = (locals[ip->bc8.b] < locals[ip->bc8.c]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(LessEqual): L_SCRIPT_QUICKEN(locals[ip->bc8.b], locals[ip->bc8.c], LessEqualFloat); locals[ip->a] = (locals[ip->bc8.b] <= locals[ip->bc8.c]); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(Equal): locals[ip->a] = (locals[ip->bc8.b] == locals[ip->bc8.c]); L_SCRIPT_NEXT();
+
+      L_SCRIPT_OP(Call):
       {
-        _current_stack_start += ip.a;
-        _current_param_count = ip.bc8.b;
+        _frames.back().ip = ip;
+        _current_stack_start += ip->a;
+        _current_param_count = ip->bc8.b;
         _stack.size(_current_stack_start + 256);
 
         const Var& new_func(local(0));
@@ -217,17 +312,19 @@ Var ScriptContext::execute(const Ref<ScriptFunction>& function, const Var* param
           _frames.back().param_count = _current_param_count;
           _frames.back().function = current_function = script_function;
           current_script = current_function->script;
-          _frames.back().ip = current_script->bytecode.begin() + current_function->offset;
-          continue; // Avoid ip increment
+          _frames.back().ip = ip = current_script->bytecode.begin() + current_function->offset;
+          locals = _stack.begin() + _current_stack_start;
+          L_SCRIPT_DISPATCH(); // Avoid ip increment
         } else {
           warning("Trying to call non-callable type: %s", new_func.type()->name);
           _current_stack_start = _frames.back().stack_start;
           _current_param_count = uint32_t(_frames.back().param_count);
           _stack.size(_current_stack_start + 256);
         }
-        break;
+        locals = _stack.begin() + _current_stack_start;
+        L_SCRIPT_NEXT();
       }
-      case Return:
+      L_SCRIPT_OP(Return):
         // Unlink outers
         for(uintptr_t i = 0; i < _outers.size(); i++) {
           if(_outers[i]->offset >= _current_stack_start) {
@@ -249,24 +346,79 @@ Var ScriptContext::execute(const Ref<ScriptFunction>& function, const Var* param
           _current_stack_start = _frames.back().stack_start;
           _current_param_count = _frames.back().param_count;
           _stack.size(_current_stack_start + 256);
+          locals = _stack.begin() + _current_stack_start;
 
           current_function = _frames.back().function;
           current_script = current_function->script;
+          ip = _frames.back().ip;
         }
-        break;
+        L_SCRIPT_NEXT();
 
         // Optimization opcodes
-      case LoadBool: local(ip.a) = (ip.bc8.b != 0); break;
-      case LoadInt: local(ip.a) = float(ip.bc16); break;
-      case GetItemConst: get_item(*this, local(ip.a), current_script->constants[ip.bc8.b], local(ip.bc8.c)); break;
-      case SetItemConst: set_item(*this, local(ip.a), current_script->constants[ip.bc8.b], local(ip.bc8.c)); break;
+      L_SCRIPT_OP(LoadBool): set_bool(locals[ip->a], ip->bc8.b != 0); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(LoadInt): set_float(locals[ip->a], float(ip->bc16)); L_SCRIPT_NEXT();
+      L_SCRIPT_OP(GetItemConst):
+        if(const Var* value = find_cached_item(*current_script, ip, locals[ip->a])) {
+          copy_local(locals[ip->bc8.c], *value);
+        } else {
+          _frames.back().ip = ip;
+          get_item(*this, locals[ip->a], current_script->constants[ip->bc8.b], locals[ip->bc8.c]);
+        }
+        L_SCRIPT_NEXT();
+      L_SCRIPT_OP(SetItemConst):
+        if(Var* value = find_cached_item(*current_script, ip, locals[ip->a])) {
+          copy_local(*value, locals[ip->bc8.c]);
+        } else {
+          _frames.back().ip = ip;
+          set_item(*this, locals[ip->a], current_script->constants[ip->bc8.b], locals[ip->bc8.c]);
+        }
+        L_SCRIPT_NEXT();
+
+        // Quickened opcodes
+#define L_SCRIPT_FLOAT_OP(op) \
+      if(float* a = locals[ip->a].try_as<float>()) { \
+        if(const float* b = locals[ip->bc8.b].try_as<float>()) { \
+          *a op *b; \
+          L_SCRIPT_NEXT(); \
+        } \
+      } \
+      locals[ip->a] op locals[ip->bc8.b]; \
+      L_SCRIPT_NEXT();
+#define L_SCRIPT_FLOAT_CMP(op) \
+      if(const float* b = locals[ip->bc8.b].try_as<float>()) { \
+        if(const float* c = locals[ip->bc8.c].try_as<float>()) { \
+          set_bool(locals[ip->a], *b op *c); \
+          L_SCRIPT_NEXT(); \
+        } \
+      } \
+      locals[ip->a] = (locals[ip->bc8.b] op locals[ip->bc8.c]); \
+      L_SCRIPT_NEXT();
+      L_SCRIPT_OP(AddFloat): L_SCRIPT_FLOAT_OP(+=)
+      L_SCRIPT_OP(SubFloat): L_SCRIPT_FLOAT_OP(-=)
+      L_SCRIPT_OP(MulFloat): L_SCRIPT_FLOAT_OP(*=)
+      L_SCRIPT_OP(DivFloat): L_SCRIPT_FLOAT_OP(/=)
+      L_SCRIPT_OP(LessThanFloat): L_SCRIPT_FLOAT_CMP(<)
+      L_SCRIPT_OP(LessEqualFloat): L_SCRIPT_FLOAT_CMP(<=)
+#undef L_SCRIPT_FLOAT_OP
+#undef L_SCRIPT_FLOAT_CMP
+
+      L_SCRIPT_OP(CondCopyLocal):
+      L_SCRIPT_OP(CondLoadConst):
+      L_SCRIPT_OP(CondLoadGlobal):
+#if !defined(__GNUC__)
       default:
+#endif
         error("Unhandled script instruction");
-        break;
+        L_SCRIPT_NEXT();
+#if !defined(__GNUC__)
     }
-    _frames.back().ip++;
   }
+#endif
 }
+#undef L_SCRIPT_OP
+#undef L_SCRIPT_DISPATCH
+#undef L_SCRIPT_NEXT
+#undef L_SCRIPT_QUICKEN
 
 void ScriptContext::warning(const char* msg, ...) const {
   va_list args;
@@ -53,6 +53,8 @@ void Script::print(Stream& s) {
       case MakeArray:    s << "MakeArray:    " << i.a << " := []\n"; break;
       case GetItem:      s << "GetItem:      " << i.bc8.c << " := " << i.a << "[" << i.bc8.b << "]\n"; break;
       case SetItem:      s << "SetItem:      " << i.a << "[" << i.bc8.b << "] := " << i.bc8.c << "\n"; break;
+      case GetItemConst: s << "GetItemConst: " << i.bc8.c << " := " << i.a << "[" << constants[i.bc8.b] << "]\n"; break;
+      case SetItemConst: s << "SetItemConst: " << i.a << "[" << constants[i.bc8.b] << "] := " << i.bc8.c << "\n"; break;
       case PushItem:     s << "PushItem:     " << i.a << "[] := " << i.bc8.b << "\n"; break;
 
       case MakeIterator: s << "MakeIterator: " << i.a << " := it(" << i.bc8.b << ")\n"; break;
@@ -75,6 +77,13 @@ void Script::print(Stream& s) {
       case LessEqual:    s << "LessEqual:    " << i.a << " := " << i.bc8.b << " <= " << i.bc8.c << "\n"; break;
       case Equal:        s << "Equal:        " << i.a << " := " << i.bc8.b << " == " << i.bc8.c << "\n"; break;
 
+      case AddFloat:     s << "AddFloat:     " << i.a << " += " << i.bc8.b << "\n"; break;
+      case SubFloat:     s << "SubFloat:     " << i.a << " -= " << i.bc8.b << "\n"; break;
+      case MulFloat:     s << "MulFloat:     " << i.a << " *= " << i.bc8.b << "\n"; break;
+      case DivFloat:     s << "DivFloat:     " << i.a << " /= " << i.bc8.b << "\n"; break;
+      case LessThanFloat:  s << "LessThanFloat:  " << i.a << " := " << i.bc8.b << " < " << i.bc8.c << "\n"; break;
+      case LessEqualFloat: s << "LessEqualFloat: " << i.a << " := " << i.bc8.b << " <= " << i.bc8.c << "\n"; break;
+
       case Call:         s << "Call:         " << i.a << " (" << i.bc8.b << " parameters)\n"; break;
       case Return:       s << "Return\n"; break;
       default: error("Unknown script instruction to print"); break;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "../container/Array.h"
 #include "../container/Ref.h"
 #include "../dynamic/Variable.h"
@@ -62,6 +64,15 @@ namespace L {
     LoadInt, // Load integer bc (as float) to local a
     GetItemConst, // Copy item from local a at index const b to local c
     SetItemConst, // Set item from local a at index const b to local c
+
+    // Quickened opcodes, substituted at runtime once operands were seen to be floats
+    // They fall back to the generic operation when operands have other types
+    AddFloat, // Add local b to local a
+    SubFloat, // Subtract local b to local a
+    MulFloat, // Multiply local a by local b
+    DivFloat, // Divide local a by local b
+    LessThanFloat, // Put in local a whether local b is lesser than local c
+    LessEqualFloat, // Put in local a whether local b is lesser than or equal to local c
   };
   struct ScriptInstruction {
     ScriptOpCode opcode;
@@ -78,6 +89,7 @@ namespace L {
     Array<Var> constants;
     Array<ScriptGlobal> globals;
     Array<ScriptInstruction> bytecode;
+    Array<std::atomic<uint32_t>> item_slots; // Table slot found by each GetItemConst and SetItemConst instruction last time, not serialized
 
 #if !L_RLS
     String source_id;
@@ -101,7 +113,10 @@ namespace L {
   };
 
   inline void script_write(Stream& s, const Script& v) { s <= v.constants <= v.globals <= v.bytecode; }
-  inline void script_read(Stream& s, Script& v) { s >= v.constants >= v.globals >= v.bytecode; }
+  inline void script_read(Stream& s, Script& v) {
+    s >= v.constants >= v.globals >= v.bytecode;
+    v.item_slots.size(v.bytecode.size(), uint32_t(-1));
+  }
   inline void resource_write(Stream& s, const ScriptFunction& v) {
     script_write(s, *v.script);
   }
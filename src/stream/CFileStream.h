@@ -20,8 +20,13 @@ namespace L {
 
     inline char peek() override { char c(char(fgetc(_fd))); ungetc(c, _fd); return c; }
     inline void rewind() override { ::rewind(_fd); }
+#if L_WINDOWS // long is 32-bit on Windows
+    inline uintptr_t tell() override { return uintptr_t(::_ftelli64(_fd)); }
+    inline void seek(uintptr_t i) override { ::_fseeki64(_fd, __int64(i), SEEK_SET); }
+#else
     inline uintptr_t tell() override { return ::ftell(_fd); }
     inline void seek(uintptr_t i) override { ::fseek(_fd, long(i), SEEK_SET); }
+#endif
     inline size_t size() override {
       uintptr_t o(tell());
       ::fseek(_fd, 0, SEEK_END);
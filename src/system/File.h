@@ -21,6 +21,12 @@ namespace L {
     void make() const;
 
     static bool mtime(const char* path, Date&);
+    // Maps a whole file read-only, returns null if it's empty or can't be opened
+    // Sets size to the size of the file and capacity to the size of the mapping
+    // Where supported, at least the requested capacity is mapped so that the file can grow into it
+    // Later writes to the file through other handles are visible within the new file size and the capacity
+    static const void* map(const char* path, size_t& size, size_t& capacity);
+    static void unmap(const void*, size_t size);
     static Array<String> list(const char* path);
   };
 }
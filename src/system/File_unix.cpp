@@ -1,6 +1,8 @@
 #include "File.h"
 
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 using namespace L;
@@ -19,6 +21,25 @@ bool File::mtime(const char* path, Date& date) {
     return true;
   } else return false;
 }
+const void* File::map(const char* path, size_t& size, size_t& capacity) {
+  const int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return nullptr;
+  }
+  struct stat buf;
+  void* ptr = MAP_FAILED;
+  if(!fstat(fd, &buf) && buf.st_size > 0) {
+    size = size_t(buf.st_size);
+    // Pages past the end of the file can be mapped, they become readable when it grows
+    capacity = capacity > size ? capacity : size;
+    ptr = mmap(nullptr, capacity, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd); // Mapping keeps its own reference to the file
+  return ptr != MAP_FAILED ? ptr : nullptr;
+}
+void File::unmap(const void* ptr, size_t size) {
+  munmap((void*)ptr, size);
+}
 Array<String> File::list(const char* path) {
   String output;
   System::call(String("find ")+path+" -printf \"%p\\n\"", output);
@@ -19,6 +19,27 @@ bool File::mtime(const char* path, Date& date) {
     return true;
   } else return false;
 }
+const void* File::map(const char* path, size_t& size, size_t& capacity) {
+  HANDLE file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  void* ptr = nullptr;
+  LARGE_INTEGER file_size;
+  if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+    // Read-only views can't extend past the end of the file
+    size = capacity = size_t(file_size.QuadPart);
+    if(HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+      ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+      CloseHandle(mapping); // View keeps its own reference to the mapping
+    }
+  }
+  CloseHandle(file);
+  return ptr;
+}
+void File::unmap(const void* ptr, size_t) {
+  UnmapViewOfFile(ptr);
+}
 Array<String> File::list(const char* path) {
   Array<String> wtr;
   HANDLE handle;
@@ -35,67 +35,289 @@ void Memory::free(void* ptr, size_t size) {
   L_ASSERT(*(uintptr_t*)ptr == size);
   virtual_free(ptr, size + 8);
 }
+Memory::Stats Memory::stats() { return Stats{}; }
+void Memory::trim() {}
 #elif L_USE_MALLOC
 void* Memory::alloc(size_t size) { return malloc(size); }
 void* Memory::alloc_zero(size_t size) { return ::calloc(size, 1); }
 void* Memory::realloc(void* ptr, size_t, size_t newsize) { return ::realloc(ptr, newsize); }
 void Memory::free(void* ptr, size_t) { ::free(ptr); }
+Memory::Stats Memory::stats() { return Stats{}; }
+void Memory::trim() {}
 #else
 
 static constexpr size_t max_size = 1 << 20;
-static constexpr size_t alloc_block_size = 1ull << 29;
+static constexpr uintptr_t freelist_count = 128;
+static constexpr size_t batch_size = 1 << 15; // Memory moved at once between a thread cache and global lists
+static constexpr uint32_t max_batch_count = 64;
+static constexpr uint64_t pointer_mask = (1ull << 48) - 1; // Upper bits of global list heads are an ABA tag
+static constexpr size_t segment_size = 1ull << 26; // Address space reserved at once
+static constexpr uint32_t max_segment_count = 1 << 10;
+static constexpr size_t span_unit_size = 1 << 16;
+static constexpr uintptr_t segment_unit_count = segment_size / span_unit_size;
+static constexpr uintptr_t span_size_count = 5; // From 1 to 16 units, enough for the biggest blocks
 
-static std::atomic<void*> freelists[128] = {};
-static size_t allocated(0), unused(0), wasted(0);
-static uint8_t* alloc_block_start = nullptr;
-static std::atomic<uint8_t*> next = {nullptr};
+// Free blocks are linked through their first word,
+// the first block of a batch links to the next batch through its second word
+struct FreeBlock {
+  FreeBlock* next;
+  FreeBlock* next_batch;
+};
+
+// Sits in front of global lists to avoid contention
+// Statistics are only written by their own thread but read from any,
+// blocks may be freed on another thread than they were allocated on
+// so only their sum across threads makes sense
+struct ThreadCache {
+  FreeBlock* freelists[freelist_count];
+  uint32_t freelist_counts[freelist_count];
+  std::atomic<size_t> allocated, unused, wasted;
+  ThreadCache* next;
+};
+
+// Size classes carve blocks from spans of one or more units,
+// so that a span whose blocks are all free can be given back as a whole
+// Every unit of a span holds the same information
+struct SpanInfo {
+  uint16_t start_unit;
+  uint8_t freelist_index;
+  uint8_t unit_count;
+  uint32_t free_count; // Only used while trimming
+};
+struct Segment {
+  uint8_t* start;
+  SpanInfo* spans; // One per unit
+  uintptr_t used_unit_count;
+};
+struct ClassCursor {
+  uint8_t* next;
+  uint8_t* end;
+};
+
+static std::atomic<uint64_t> global_freelists[freelist_count] = {}; // Tagged pointers to first batches
+static std::atomic<ThreadCache*> thread_caches = {nullptr};
+static thread_local ThreadCache* thread_cache = nullptr;
+
+// Arena is only touched when carving new blocks or trimming, under a single lock
+static std::atomic<bool> arena_locked = {false};
+static Segment segments[max_segment_count]; // Only ever appended to
+static std::atomic<uint32_t> segment_count = {0};
+static ClassCursor class_cursors[freelist_count] = {};
+static uint8_t* free_spans[span_size_count] = {}; // Discarded spans linked through their first word
+static std::atomic<size_t> reserved = {0};
 
 // Cannot allocate less than 8 bytes for alignment purposes
+// Empty allocations still get a block of their own
 inline uintptr_t freelist_index(size_t size) {
-  return (size<=512) ? (((size+7)/8)-1) : (clog2(size)+55);
+  return (size<=512) ? (size ? ((size+7)/8)-1 : 0) : (clog2(size)+55);
 }
+// Blocks need to be large enough to be linked in batches
 inline void freelist_index_size(size_t size, uintptr_t& index, size_t& padded_size) {
   if(size<=512) {
-    index = ((size+7)/8)-1;
-    padded_size = (index+1)*8;
+    index = freelist_index(size);
+    padded_size = max((index+1)*8, sizeof(FreeBlock));
   } else {
     index = clog2(size);
     padded_size = uintptr_t(1)<<index;
     index += 55;
   }
 }
+inline size_t freelist_padded_size(uintptr_t index) {
+  return (index < 64) ? max((index+1)*8, sizeof(FreeBlock)) : uintptr_t(1)<<(index-55);
+}
+inline size_t span_size(size_t padded_size) {
+  return max(span_unit_size, padded_size);
+}
+inline uint32_t batch_count(size_t padded_size) {
+  return uint32_t(clamp<size_t>(batch_size / padded_size, 1, max_batch_count));
+}
+
+inline void add_stat(std::atomic<size_t>& stat, size_t value) {
+  stat.store(stat.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+inline void sub_stat(std::atomic<size_t>& stat, size_t value) {
+  stat.store(stat.load(std::memory_order_relaxed) - value, std::memory_order_relaxed);
+}
+static void count_markers() {
+#if L_PROFILING
+  const Memory::Stats stats(Memory::stats());
+  L_COUNT_MARKER("Allocated memory", stats.allocated);
+  L_COUNT_MARKER("Unused memory", stats.unused);
+  L_COUNT_MARKER("Wasted memory", stats.wasted);
+#endif
+}
+
+static ThreadCache& get_thread_cache() {
+  if(thread_cache == nullptr) {
+    // Caches are never freed so statistics stay valid after their thread ends
+    thread_cache = new(Memory::virtual_alloc(sizeof(ThreadCache)))ThreadCache();
+    ThreadCache* head(thread_caches.load());
+    do {
+      thread_cache->next = head;
+    } while(!thread_caches.compare_exchange_weak(head, thread_cache));
+  }
+  return *thread_cache;
+}
+
+static FreeBlock* pop_batch(uintptr_t index) {
+  std::atomic<uint64_t>& freelist(global_freelists[index]);
+  uint64_t head(freelist.load());
+  while(FreeBlock* batch = (FreeBlock*)(head & pointer_mask)) {
+    // Batch may have been popped and reused since, in which case the tag changed
+    const uint64_t new_head(((head >> 48) + 1) << 48 | uint64_t(batch->next_batch));
+    if(freelist.compare_exchange_weak(head, new_head)) {
+      return batch;
+    }
+  }
+  return nullptr;
+}
+static void push_batch(uintptr_t index, FreeBlock* batch) {
+  L_ASSERT((uint64_t(batch) & ~pointer_mask) == 0);
+  std::atomic<uint64_t>& freelist(global_freelists[index]);
+  uint64_t head(freelist.load());
+  do {
+    batch->next_batch = (FreeBlock*)(head & pointer_mask);
+  } while(!freelist.compare_exchange_weak(head, ((head >> 48) + 1) << 48 | uint64_t(batch)));
+}
+
+static void lock_arena() {
+  bool expected(false);
+  while(!arena_locked.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
+    expected = false;
+  }
+}
+static void unlock_arena() {
+  arena_locked.store(false, std::memory_order_release);
+}
+static Segment* find_segment(const void* ptr) {
+  const uint32_t count(segment_count.load(std::memory_order_acquire));
+  for(uint32_t i(0); i < count; i++) {
+    Segment& segment(segments[i]);
+    if(ptr >= segment.start && ptr < segment.start + segment_size) {
+      return &segment;
+    }
+  }
+  return nullptr;
+}
+static SpanInfo& find_span(const void* ptr) {
+  Segment& segment(*find_segment(ptr));
+  const uintptr_t unit(uintptr_t((const uint8_t*)ptr - segment.start) / span_unit_size);
+  return segment.spans[segment.spans[unit].start_unit];
+}
+// Must be locked
+// Reuses a discarded span if possible, otherwise takes units from the last segment
+static uint8_t* alloc_span(uintptr_t index, size_t padded_size) {
+  const uintptr_t unit_count(span_size(padded_size) / span_unit_size);
+  const uintptr_t size_index(log2(uint64_t(unit_count)));
+  uint8_t* span(free_spans[size_index]);
+  if(span) {
+    free_spans[size_index] = *(uint8_t**)span;
+  } else {
+    const uint32_t count(segment_count.load(std::memory_order_relaxed));
+    Segment* segment(count ? &segments[count - 1] : nullptr);
+    if(segment == nullptr || segment->used_unit_count + unit_count > segment_unit_count) {
+      if(count >= max_segment_count) {
+        error("memory: arena exhausted after %d segments", count);
+      }
+      uint8_t* start((uint8_t*)Memory::virtual_alloc(segment_size));
+      SpanInfo* spans((SpanInfo*)Memory::virtual_alloc(sizeof(SpanInfo) * segment_unit_count));
+      if(start == nullptr || spans == nullptr) {
+        error("memory: unable to reserve arena segment");
+      }
+      L_ASSERT((uint64_t(start + segment_size) & ~pointer_mask) == 0);
+      segment = &segments[count];
+      segment->start = start;
+      segment->spans = spans;
+      segment->used_unit_count = 0;
+      segment_count.store(count + 1, std::memory_order_release);
+      reserved += segment_size;
+    }
+    span = segment->start + segment->used_unit_count * span_unit_size;
+    segment->used_unit_count += unit_count;
+  }
+
+  Segment& segment(*find_segment(span));
+  const uintptr_t start_unit(uintptr_t(span - segment.start) / span_unit_size);
+  for(uintptr_t i(0); i < unit_count; i++) {
+    segment.spans[start_unit + i] = SpanInfo {uint16_t(start_unit), uint8_t(index), uint8_t(unit_count), 0};
+  }
+  return span;
+}
+// Must be locked
+static void free_span(uint8_t* span, size_t size) {
+  Memory::virtual_discard(span, size);
+  const uintptr_t size_index(log2(uint64_t(size / span_unit_size)));
+  *(uint8_t**)span = free_spans[size_index];
+  free_spans[size_index] = span;
+}
+
+// Fills an empty thread freelist with a batch from the global list or from fresh memory
+static void refill(ThreadCache& cache, uintptr_t index, size_t padded_size) {
+  uint32_t count(batch_count(padded_size));
+  FreeBlock* batch(pop_batch(index));
+  if(batch == nullptr) {
+    lock_arena();
+    ClassCursor& cursor(class_cursors[index]);
+    if(cursor.next == cursor.end) { // Current span is fully carved
+      cursor.next = alloc_span(index, padded_size);
+      cursor.end = cursor.next + (span_size(padded_size) / padded_size) * padded_size;
+    }
+    // Last batch of a span may be partial, it stays in the thread cache
+    count = min(count, uint32_t((cursor.end - cursor.next) / padded_size));
+    uint8_t* start(cursor.next);
+    cursor.next += padded_size * count;
+    unlock_arena();
+
+    for(uint32_t i(0); i < count; i++) {
+      ((FreeBlock*)(start + i * padded_size))->next = (i + 1 < count) ? (FreeBlock*)(start + (i + 1) * padded_size) : nullptr;
+    }
+    batch = (FreeBlock*)start;
+    add_stat(cache.unused, padded_size * count);
+  }
+  cache.freelists[index] = batch;
+  cache.freelist_counts[index] = count;
+  count_markers();
+}
+// Gives a batch back to the global list when a thread freed too much
+static void flush(ThreadCache& cache, uintptr_t index, size_t padded_size) {
+  const uint32_t count(batch_count(padded_size));
+  FreeBlock* batch(cache.freelists[index]);
+  FreeBlock* last(batch);
+  for(uint32_t i(1); i < count; i++) {
+    last = last->next;
+  }
+  cache.freelists[index] = last->next;
+  cache.freelist_counts[index] -= count;
+  last->next = nullptr;
+  push_batch(index, batch);
+  count_markers();
+}
 
 void* Memory::alloc(size_t size) {
+  ThreadCache& cache(get_thread_cache());
   if(size >= max_size) { // Big allocations go directly to the system
-    allocated += size;
-    L_COUNT_MARKER("Allocated memory", allocated);
+    add_stat(cache.allocated, size);
+    count_markers();
     return virtual_alloc(size);
   }
   uintptr_t index;
   size_t padded_size;
   freelist_index_size(size, index, padded_size);
 
-  wasted += padded_size - size;
-  L_COUNT_MARKER("Wasted memory", wasted);
-  allocated += padded_size;
-  L_COUNT_MARKER("Allocated memory", allocated);
+  if(cache.freelists[index] == nullptr) {
+    refill(cache, index, padded_size);
+  }
+  FreeBlock* block(cache.freelists[index]);
+  cache.freelists[index] = block->next;
+  cache.freelist_counts[index] -= 1;
 
-  while(void* ptr = freelists[index]) { // There's a free space available
-    if(freelists[index].compare_exchange_strong(ptr, *(void**)ptr)) {
-      unused -= padded_size;
-      L_COUNT_MARKER("Unused memory", unused);
+  add_stat(cache.allocated, padded_size);
+  add_stat(cache.wasted, padded_size - size);
+  sub_stat(cache.unused, padded_size);
 #if L_DBG
-      memset(ptr, 0xcd, padded_size);
+  memset(block, 0xcd, padded_size);
 #endif
-      return ptr;
-    }
-  }
-
-  // No free space available: make one
-  if(alloc_block_start == nullptr) {
-    alloc_block_start = next = (uint8_t*)Memory::virtual_alloc(1ull << 29);
-  }
-  return next.fetch_add(padded_size);
+  return block;
 }
 void* Memory::alloc_zero(size_t size) {
   void* ptr = alloc(size);
@@ -113,8 +335,8 @@ void* Memory::realloc(void* ptr, size_t oldsize, size_t newsize) {
   // then we can simply ignore the realloc
   else if(oldsize && oldsize < max_size && newsize < max_size &&
     freelist_index(oldsize) == freelist_index(newsize)) {
-    wasted += oldsize - newsize;
-    L_COUNT_MARKER("Wasted memory", wasted);
+    ThreadCache& cache(get_thread_cache());
+    add_stat(cache.wasted, oldsize - newsize);
     return ptr;
   } else {
     void* new_ptr = alloc(newsize);
@@ -130,29 +352,250 @@ void Memory::free(void* ptr, size_t size) {
     warning("memory: nullptr provided to free function");
     return;
   }
+  ThreadCache& cache(get_thread_cache());
   if(size >= max_size) { // Big allocations go directly to the system
     virtual_free(ptr, size);
-    allocated -= size;
-    L_COUNT_MARKER("Allocated memory", allocated);
+    sub_stat(cache.allocated, size);
+    count_markers();
     return;
   }
-  L_ASSERT(ptr >= alloc_block_start && ptr < alloc_block_start + alloc_block_size);
+#if L_DBG
+  L_ASSERT(find_segment(ptr) != nullptr);
+#endif
   uintptr_t index;
   size_t padded_size;
   freelist_index_size(size, index, padded_size);
 #if L_DBG
   memset(ptr, 0xdd, padded_size);
 #endif
-  do {
-    void* freelist = freelists[index];
-    L_ASSERT(freelist == nullptr || (freelist >= alloc_block_start && freelist < alloc_block_start + alloc_block_size));
-    *((void**)ptr) = freelist;
-  } while(!freelists[index].compare_exchange_strong(*(void**)ptr, ptr));
-  unused += padded_size;
-  L_COUNT_MARKER("Unused memory", unused);
-  wasted -= padded_size - size;
-  L_COUNT_MARKER("Wasted memory", wasted);
-  allocated -= padded_size;
-  L_COUNT_MARKER("Allocated memory", allocated);
+  FreeBlock* block((FreeBlock*)ptr);
+  block->next = cache.freelists[index];
+  cache.freelists[index] = block;
+  cache.freelist_counts[index] += 1;
+
+  sub_stat(cache.allocated, padded_size);
+  sub_stat(cache.wasted, padded_size - size);
+  add_stat(cache.unused, padded_size);
+
+  // Keep up to two batches around so alternating allocs and frees stay local
+  if(cache.freelist_counts[index] >= 2 * batch_count(padded_size)) {
+    flush(cache, index, padded_size);
+  }
+}
+void Memory::trim() {
+  L_SCOPE_MARKER("Memory trim");
+  static constexpr uint32_t released_span = uint32_t(-1);
+  ThreadCache& cache(get_thread_cache());
+  lock_arena();
+
+  const uint32_t count(segment_count.load(std::memory_order_relaxed));
+  for(uint32_t i(0); i < count; i++) {
+    for(uintptr_t unit(0); unit < segments[i].used_unit_count; unit++) {
+      segments[i].spans[unit].free_count = 0;
+    }
+  }
+
+  // Blocks cached by other threads are left alone, their spans won't be given back
+  for(uintptr_t index(0); index < freelist_count; index++) {
+    const size_t padded_size(freelist_padded_size(index));
+    const uint32_t span_block_count(uint32_t(span_size(padded_size) / padded_size));
+
+    // Gather free blocks from this thread and the global list
+    FreeBlock* blocks(cache.freelists[index]);
+    std::atomic<uint64_t>& freelist(global_freelists[index]);
+    uint64_t head(freelist.load());
+    while(!freelist.compare_exchange_weak(head, ((head >> 48) + 1) << 48)) {}
+    for(FreeBlock* batch((FreeBlock*)(head & pointer_mask)); batch;) {
+      FreeBlock* next_batch(batch->next_batch);
+      FreeBlock* last(batch);
+      while(last->next) {
+        last = last->next;
+      }
+      last->next = blocks;
+      blocks = batch;
+      batch = next_batch;
+    }
+
+    for(FreeBlock* block(blocks); block; block = block->next) {
+      find_span(block).free_count += 1;
+    }
+
+    // Blocks of fully free spans are dropped, other ones are kept
+    // Spans are only discarded later as dropped blocks are still linked
+    FreeBlock* kept_blocks(nullptr);
+    uint32_t kept_count(0);
+    for(FreeBlock* block(blocks); block;) {
+      FreeBlock* next_block(block->next);
+      SpanInfo& span(find_span(block));
+      if(span.free_count == span_block_count) {
+        span.free_count = released_span;
+        sub_stat(cache.unused, span_block_count * padded_size);
+      } else if(span.free_count != released_span) {
+        block->next = kept_blocks;
+        kept_blocks = block;
+        kept_count += 1;
+      }
+      block = next_block;
+    }
+
+    // Kept blocks go back in full batches, the remainder stays in this thread
+    const uint32_t block_count(batch_count(padded_size));
+    while(kept_count >= block_count) {
+      FreeBlock* batch(kept_blocks);
+      FreeBlock* last(batch);
+      for(uint32_t i(1); i < block_count; i++) {
+        last = last->next;
+      }
+      kept_blocks = last->next;
+      last->next = nullptr;
+      push_batch(index, batch);
+      kept_count -= block_count;
+    }
+    cache.freelists[index] = kept_blocks;
+    cache.freelist_counts[index] = kept_count;
+  }
+
+  for(uint32_t i(0); i < count; i++) {
+    Segment& segment(segments[i]);
+    for(uintptr_t unit(0); unit < segment.used_unit_count; unit += segment.spans[unit].unit_count) {
+      if(segment.spans[unit].free_count == released_span) {
+        free_span(segment.start + unit * span_unit_size, segment.spans[unit].unit_count * span_unit_size);
+      }
+    }
+  }
+
+  unlock_arena();
+  count_markers();
+}
+Memory::Stats Memory::stats() {
+  Stats stats{};
+  stats.reserved = reserved;
+  for(ThreadCache* cache(thread_caches.load()); cache; cache = cache->next) {
+    stats.allocated += cache->allocated.load(std::memory_order_relaxed);
+    stats.unused += cache->unused.load(std::memory_order_relaxed);
+    stats.wasted += cache->wasted.load(std::memory_order_relaxed);
+  }
+  return stats;
 }
 #endif
+
+static constexpr size_t frame_chunk_size = 1 << 20;
+static constexpr size_t frame_alignment = 16;
+
+struct FrameChunk {
+  FrameChunk* next;
+  size_t size;
+};
+struct FrameBuffer {
+  FrameChunk* first;
+  FrameChunk* current;
+  uint8_t* next;
+  uint8_t* end;
+};
+// Each thread alternates between two buffers, the one that gets reset
+// was last used two frames ago or more
+// Chunks are kept from one frame to the next
+struct FrameArena {
+  FrameBuffer buffers[2];
+  uint32_t buffer_index;
+  std::atomic<uint32_t> frame;
+  std::atomic<size_t> used; // During current frame
+  FrameArena* next;
+};
+
+static std::atomic<FrameArena*> frame_arenas = {nullptr};
+static thread_local FrameArena* frame_arena = nullptr;
+static std::atomic<uint32_t> current_frame = {0};
+
+static void reset_frame_buffer(FrameBuffer& buffer) {
+  buffer.current = buffer.first;
+  buffer.next = buffer.first ? (uint8_t*)(buffer.first + 1) : nullptr;
+  buffer.end = buffer.first ? (uint8_t*)buffer.first + buffer.first->size : nullptr;
+}
+static FrameArena& get_frame_arena() {
+  if(frame_arena == nullptr) {
+    frame_arena = new(Memory::virtual_alloc(sizeof(FrameArena)))FrameArena();
+    frame_arena->frame = current_frame.load();
+    FrameArena* head(frame_arenas.load());
+    do {
+      frame_arena->next = head;
+    } while(!frame_arenas.compare_exchange_weak(head, frame_arena));
+  }
+  FrameArena& arena(*frame_arena);
+  const uint32_t frame(current_frame.load(std::memory_order_relaxed));
+  if(arena.frame.load(std::memory_order_relaxed) != frame) {
+    arena.frame.store(frame, std::memory_order_relaxed);
+    arena.used.store(0, std::memory_order_relaxed);
+    arena.buffer_index ^= 1;
+    reset_frame_buffer(arena.buffers[arena.buffer_index]);
+  }
+  return arena;
+}
+// Moves to the next chunk that fits, creating it if necessary
+static void next_frame_chunk(FrameBuffer& buffer, size_t size) {
+  while(buffer.current && buffer.current->next) {
+    buffer.current = buffer.current->next;
+    buffer.next = (uint8_t*)(buffer.current + 1);
+    buffer.end = (uint8_t*)buffer.current + buffer.current->size;
+    if(buffer.next + size <= buffer.end) {
+      return;
+    }
+  }
+  const size_t chunk_size(max(frame_chunk_size, size + sizeof(FrameChunk)));
+  FrameChunk* chunk((FrameChunk*)Memory::virtual_alloc(chunk_size));
+  if(chunk == nullptr) {
+    error("memory: unable to allocate frame memory chunk");
+  }
+  chunk->next = nullptr;
+  chunk->size = chunk_size;
+  (buffer.current ? buffer.current->next : buffer.first) = chunk;
+  buffer.current = chunk;
+  buffer.next = (uint8_t*)(chunk + 1);
+  buffer.end = (uint8_t*)chunk + chunk_size;
+}
+
+void* Memory::frame_alloc(size_t size) {
+  FrameArena& arena(get_frame_arena());
+  FrameBuffer& buffer(arena.buffers[arena.buffer_index]);
+  size = (size + frame_alignment - 1) & ~(frame_alignment - 1);
+  if(buffer.next + size > buffer.end) {
+    next_frame_chunk(buffer, size);
+  }
+  void* ptr(buffer.next);
+  buffer.next += size;
+  arena.used.store(arena.used.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+  return ptr;
+}
+void* Memory::frame_realloc(void* ptr, size_t oldsize, size_t newsize) {
+  FrameArena& arena(get_frame_arena());
+  FrameBuffer& buffer(arena.buffers[arena.buffer_index]);
+  oldsize = (oldsize + frame_alignment - 1) & ~(frame_alignment - 1);
+  newsize = (newsize + frame_alignment - 1) & ~(frame_alignment - 1);
+  // Last allocation can simply be extended
+  if(ptr && (uint8_t*)ptr + oldsize == buffer.next && (uint8_t*)ptr + newsize <= buffer.end) {
+    buffer.next = (uint8_t*)ptr + newsize;
+    arena.used.store(arena.used.load(std::memory_order_relaxed) + newsize - oldsize, std::memory_order_relaxed);
+    return ptr;
+  }
+  void* new_ptr(frame_alloc(newsize));
+  if(ptr) {
+    memcpy(new_ptr, ptr, min(oldsize, newsize));
+  }
+  return new_ptr;
+}
+void Memory::end_frame() {
+  const uint32_t frame(current_frame.load());
+#if L_PROFILING
+  static size_t high_water(0);
+  size_t used(0);
+  for(FrameArena* arena(frame_arenas.load()); arena; arena = arena->next) {
+    if(arena->frame.load(std::memory_order_relaxed) == frame) {
+      used += arena->used.load(std::memory_order_relaxed);
+    }
+  }
+  high_water = max(high_water, used);
+  L_COUNT_MARKER("Frame memory", used);
+  L_COUNT_MARKER("Frame memory high-water", high_water);
+#endif
+  current_frame.store(frame + 1);
+}
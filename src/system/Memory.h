@@ -17,7 +17,36 @@ namespace L {
     template<typename T> static void free_type(T* p, size_t count = 1) { free(p, sizeof(T)*count); }
     static void free(void*, size_t);
 
+    struct Stats {
+      size_t allocated; // Including padding
+      size_t unused; // Freed but kept for later allocations
+      size_t wasted; // Padding
+      size_t reserved; // Address space held by the allocator
+    };
+    static Stats stats(); // Aggregated over all threads
+    // Gives memory of fully free pages back to the system
+    static void trim();
+
+    // Scratch memory valid until the end of next frame, never freed explicitly
+    // Should not be used by tasks spanning several frames
+    static void* frame_alloc(size_t);
+    static void* frame_realloc(void*, size_t oldsize, size_t newsize);
+    static void end_frame();
+
     static void* virtual_alloc(size_t);
     static void virtual_free(void*, size_t);
+    static void virtual_discard(void*, size_t); // Lets the system reclaim pages, their content is lost
+  };
+
+  // Allocators for containers
+  struct DefaultAllocator {
+    static inline void* alloc(size_t size) { return Memory::alloc(size); }
+    static inline void* realloc(void* ptr, size_t oldsize, size_t newsize) { return Memory::realloc(ptr, oldsize, newsize); }
+    static inline void free(void* ptr, size_t size) { Memory::free(ptr, size); }
+  };
+  struct FrameAllocator {
+    static inline void* alloc(size_t size) { return Memory::frame_alloc(size); }
+    static inline void* realloc(void* ptr, size_t oldsize, size_t newsize) { return Memory::frame_realloc(ptr, oldsize, newsize); }
+    static inline void free(void*, size_t) {}
   };
 }
@@ -5,8 +5,12 @@
 using namespace L;
 
 void* Memory::virtual_alloc(size_t size) {
-  return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+  return ptr != MAP_FAILED ? ptr : nullptr;
 }
 void Memory::virtual_free(void* ptr, size_t size) {
   munmap(ptr, size);
 }
+void Memory::virtual_discard(void* ptr, size_t size) {
+  madvise(ptr, size, MADV_DONTNEED);
+}
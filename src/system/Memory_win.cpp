@@ -21,3 +21,6 @@ void Memory::virtual_free(void* ptr, size_t) {
   BOOL success = VirtualFree(ptr, 0, MEM_RELEASE);
   L_ASSERT(success);
 }
+void Memory::virtual_discard(void* ptr, size_t size) {
+  VirtualAlloc(ptr, size, MEM_RESET, PAGE_READWRITE);
+}
@@ -13,7 +13,7 @@ namespace L {
     _BitScanReverse(&wtr,v);
     return wtr;
 #elif __GNUC__
-    return sizeof(v)*8-__builtin_clz(v);
+    return sizeof(v)*8-1-__builtin_clz(v);
 #endif
   }
 
@@ -23,7 +23,44 @@ namespace L {
     _BitScanReverse64(&wtr, v);
     return wtr;
 #elif __GNUC__
-    return sizeof(v)*8-__builtin_clzll(v);
+    return sizeof(v)*8-1-__builtin_clzll(v);
+#endif
+  }
+
+  inline uint32_t bsf(uint32_t v) {
+#if _MSC_VER
+    unsigned long wtr;
+    _BitScanForward(&wtr, v);
+    return wtr;
+#elif __GNUC__
+    return __builtin_ctz(v);
+#endif
+  }
+
+  inline uint32_t bsf(uint64_t v) {
+#if _MSC_VER
+    unsigned long wtr;
+    _BitScanForward64(&wtr, v);
+    return wtr;
+#elif __GNUC__
+    return __builtin_ctzll(v);
+#endif
+  }
+
+  // Atomic byte accesses without ordering, for shared data that readers may see before or after a write
+  inline uint8_t relaxed_load(const uint8_t* p) {
+#if _MSC_VER
+    return uint8_t(__iso_volatile_load8((const volatile char*)p));
+#elif __GNUC__
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+#endif
+  }
+
+  inline void relaxed_store(uint8_t* p, uint8_t v) {
+#if _MSC_VER
+    __iso_volatile_store8((volatile char*)p, char(v));
+#elif __GNUC__
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
 #endif
   }
 }
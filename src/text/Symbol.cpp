@@ -1,6 +1,7 @@
 #include "Symbol.h"
 
-#include "../container/Table.h"
+#include <atomic>
+
 #include "../dev/debug.h"
 #include "../parallelism/Lock.h"
 #include "../stream/serial_bin.h"
@@ -9,27 +10,111 @@
 
 using namespace L;
 
-static const size_t blob_size = 2*1024*1024;
-static Table<uint32_t, const char*> _symbols;
-static char *_blob_next, *_blob_end;
-static Lock symbol_lock;
-
-Symbol::Symbol(const char* str, size_t length) {
-  L_SCOPED_LOCK(symbol_lock);
-  const uint32_t hash(fnv1a(str, length));
-  if(const char** found = _symbols.find(hash))
-    _string = *found;
-  else {
-    if(size_t(_blob_end)-size_t(_blob_next)<=(length+1)) {
-      _blob_next = (char*)Memory::virtual_alloc(blob_size);
-      _blob_end = _blob_next+blob_size;
+// Symbols are spread over shards by hash, each with its own open-addressing table
+// Lookups are lock-free: entries are only ever added, and tables that were
+// replaced by bigger ones are kept alive for readers still probing them
+// Inserting takes the shard lock and looks up again before adding the string
+static const uint32_t shard_count = 64;
+static const size_t initial_table_size = 256;
+static const size_t blob_size = 64 * 1024;
+
+struct SymbolEntry {
+  uint32_t hash;
+  uint32_t length;
+  // Followed by the null-terminated string
+  inline const char* string() const { return (const char*)(this + 1); }
+};
+struct SymbolTable {
+  SymbolTable* previous;
+  size_t mask;
+  std::atomic<const SymbolEntry*> entries[1];
+
+  static size_t alloc_size(size_t size) { return sizeof(SymbolTable) + sizeof(std::atomic<const SymbolEntry*>) * (size - 1); }
+};
+struct SymbolShard {
+  std::atomic<SymbolTable*> table;
+  Lock lock;
+  size_t count;
+  char *blob_next, *blob_end;
+};
+
+static SymbolShard shards[shard_count];
+
+static const char* find_symbol(const SymbolTable* table, const char* str, size_t length, uint32_t hash) {
+  if(table) {
+    for(size_t i(hash & table->mask);; i = (i + 1) & table->mask) {
+      const SymbolEntry* entry(table->entries[i].load(std::memory_order_acquire));
+      if(entry == nullptr) {
+        return nullptr;
+      } else if(entry->hash == hash && entry->length == length && !memcmp(entry->string(), str, length)) {
+        return entry->string();
+      }
+    }
+  }
+  return nullptr;
+}
+static void insert_symbol(SymbolTable* table, const SymbolEntry* new_entry) {
+  for(size_t i(new_entry->hash & table->mask);; i = (i + 1) & table->mask) {
+    if(table->entries[i].load(std::memory_order_relaxed) == nullptr) {
+      table->entries[i].store(new_entry, std::memory_order_release);
+      return;
+    }
+  }
+}
+// Must be called with the shard locked
+static SymbolTable* grow_symbol_table(SymbolShard& shard) {
+  SymbolTable* old_table(shard.table.load(std::memory_order_relaxed));
+  const size_t size(old_table ? (old_table->mask + 1) * 2 : initial_table_size);
+  SymbolTable* table((SymbolTable*)Memory::alloc_zero(SymbolTable::alloc_size(size)));
+  table->previous = old_table;
+  table->mask = size - 1;
+  if(old_table) {
+    for(size_t i(0); i <= old_table->mask; i++) {
+      if(const SymbolEntry* entry = old_table->entries[i].load(std::memory_order_relaxed)) {
+        insert_symbol(table, entry);
+      }
     }
-    memcpy(_blob_next, str, length);
-    _blob_next[length] = '\0';
-    _string = _blob_next;
-    _symbols[hash] = _string;
-    _blob_next += length+1;
   }
+  shard.table.store(table, std::memory_order_release);
+  return table;
+}
+// Must be called with the shard locked
+static SymbolEntry* alloc_symbol_entry(SymbolShard& shard, size_t length) {
+  const size_t size((sizeof(SymbolEntry) + length + 1 + 7) & ~size_t(7));
+  if(size > blob_size / 4) { // Big symbols get their own memory
+    return (SymbolEntry*)Memory::virtual_alloc(size);
+  }
+  if(size_t(shard.blob_end - shard.blob_next) < size) {
+    shard.blob_next = (char*)Memory::virtual_alloc(blob_size);
+    shard.blob_end = shard.blob_next + blob_size;
+  }
+  SymbolEntry* entry((SymbolEntry*)shard.blob_next);
+  shard.blob_next += size;
+  return entry;
+}
+
+Symbol::Symbol(const char* str, size_t length, uint32_t hash) {
+  SymbolShard& shard(shards[hash >> 26]);
+  if((_string = find_symbol(shard.table.load(std::memory_order_acquire), str, length, hash))) {
+    return;
+  }
+
+  L_SCOPED_LOCK(shard.lock);
+  SymbolTable* table(shard.table.load(std::memory_order_relaxed));
+  if((_string = find_symbol(table, str, length, hash))) {
+    return; // Added while we were waiting for the lock
+  }
+  if(table == nullptr || (shard.count + 1) * 2 > table->mask + 1) {
+    table = grow_symbol_table(shard);
+  }
+  SymbolEntry* entry(alloc_symbol_entry(shard, length));
+  entry->hash = hash;
+  entry->length = uint32_t(length);
+  memcpy((char*)entry->string(), str, length);
+  ((char*)entry->string())[length] = '\0';
+  insert_symbol(table, entry);
+  shard.count++;
+  _string = entry->string();
 }
 
 Stream& L::operator<=(Stream& s, const Symbol& v) {
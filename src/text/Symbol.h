@@ -1,7 +1,12 @@
 #pragma once
 
+#include <type_traits>
+#include "../hash.h"
 #include "../stream/Stream.h"
 
+//! Symbol from a string literal, hashed at compile-time
+#define L_SYMBOL(str) L::Symbol(str, sizeof(str) - 1, std::integral_constant<uint32_t, L::FNV1A(str)>::value)
+
 namespace L {
   //! String interning mechanism
   //! Should be thread-safe
@@ -11,7 +16,8 @@ namespace L {
   public:
     constexpr Symbol() : _string(nullptr) {}
     inline Symbol(const char* str) : Symbol(str, strlen(str)) {}
-    Symbol(const char* str, size_t length);
+    inline Symbol(const char* str, size_t length) : Symbol(str, length, fnv1a(str, length)) {}
+    Symbol(const char* str, size_t length, uint32_t hash); // Hash must be fnv1a of the string
     inline bool operator==(const Symbol& other) const { return _string==other._string; }
     inline bool operator!=(const Symbol& other) const { return _string!=other._string; }
     inline bool operator<(const Symbol& other) const { return strcmp(_string, other._string)<0; }
@@ -1,5 +1,11 @@
 #include "compression.h"
 
+#include <atomic>
+
+#include "../dev/profiling.h"
+#include "../parallelism/TaskSystem.h"
+#include "../stream/StringStream.h"
+
 using namespace L;
 
 static const Symbol empty_symbol = "", none_symbol = "none";
@@ -7,7 +13,7 @@ static Array<Compression> compressions{
   Compression{
     "none",
     [](const void* data, size_t size, Stream& out_stream) { out_stream.write(data, size); },
-    [](const void* data, size_t size) { return Buffer(data, size); },
+    [](const void* data, size_t size, Buffer& out) { out = Buffer(data, size); return true; },
   }};
 
 void L::register_compression(const Compression& compression) {
@@ -24,3 +30,149 @@ const Compression& L::get_compression(const Symbol& name) {
 const Array<Compression>& L::get_compressions() {
   return compressions;
 }
+void L::write_compression_tag(const Compression& compression, Stream& out_stream) {
+  const size_t name_length(strlen(compression.name));
+  L_ASSERT(name_length < 256);
+  out_stream.put(char(name_length));
+  out_stream.write(compression.name, name_length);
+}
+const Compression* L::read_compression_tag(const void*& data, size_t& size) {
+  const uint8_t* bytes((const uint8_t*)data);
+  if(size < 1 || bytes[0] > size - 1) {
+    return nullptr;
+  }
+  const size_t name_length(bytes[0]);
+  for(const Compression& compression : compressions) {
+    if(strlen(compression.name) == name_length && !memcmp(compression.name, bytes + 1, name_length)) {
+      data = bytes + 1 + name_length;
+      size -= 1 + name_length;
+      return &compression;
+    }
+  }
+  return nullptr;
+}
+
+struct ChunkedHeader {
+  uint32_t magic;
+  uint32_t chunk_size;
+  uint64_t size; // Uncompressed
+  uint32_t chunk_count;
+  uint32_t name_length; // Name of the inner compression follows the header
+};
+struct ChunkedView {
+  ChunkedHeader header; // Copied because data may not be aligned inside archives
+  const Compression* inner;
+  const uint8_t* index; // End of each compressed chunk, relative to the start of chunk data
+  const uint8_t* chunks;
+
+  // Data may not be aligned inside archives
+  inline uint64_t chunk_start(uint32_t i) const { return i > 0 ? chunk_end(i - 1) : 0; }
+  inline uint64_t chunk_end(uint32_t i) const {
+    uint64_t end;
+    memcpy(&end, index + i * sizeof(end), sizeof(end));
+    return end;
+  }
+};
+static const uint32_t chunked_magic = 0x4b48434c; // LCHK
+
+static bool chunked_view(const void* data, size_t size, ChunkedView& view) {
+  if(size < sizeof(ChunkedHeader)) {
+    return false;
+  }
+  ChunkedHeader& header(view.header);
+  memcpy(&header, data, sizeof(header));
+  if(header.magic != chunked_magic || header.chunk_size == 0
+     || header.chunk_count != (header.size + header.chunk_size - 1) / header.chunk_size) {
+    return false;
+  }
+  if(header.name_length > size - sizeof(ChunkedHeader)) {
+    return false;
+  }
+  const size_t index_position(sizeof(ChunkedHeader) + header.name_length);
+  const size_t chunks_position(index_position + header.chunk_count * sizeof(uint64_t));
+  if(chunks_position > size) {
+    return false;
+  }
+  const char* name_start((const char*)data + sizeof(ChunkedHeader));
+  const Symbol name(String(name_start, header.name_length));
+  view.inner = &get_compression(name);
+  if(view.inner->name != name) {
+    warning("Unknown compression %s in chunked data", (const char*)name);
+    return false;
+  }
+  view.index = (const uint8_t*)data + index_position;
+  view.chunks = (const uint8_t*)data + chunks_position;
+  for(uint32_t i(0); i < header.chunk_count; i++) {
+    if(view.chunk_end(i) < view.chunk_start(i) || view.chunk_end(i) > size - chunks_position) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void L::chunked_compress(const Compression& inner, const void* data, size_t size, Stream& out_stream, size_t chunk_size) {
+  L_SCOPE_MARKER("Chunked compress");
+  const uint32_t chunk_count(uint32_t((size + chunk_size - 1) / chunk_size));
+  Array<StringStream> chunks;
+  chunks.size(chunk_count);
+  TaskSystem::parallel_for(0, chunk_count, 1, [&](uintptr_t i) {
+    const size_t offset(i * chunk_size);
+    inner.compress((const uint8_t*)data + offset, min(chunk_size, size - offset), chunks[i]);
+  });
+
+  const ChunkedHeader header {chunked_magic, uint32_t(chunk_size), size, chunk_count, uint32_t(strlen(inner.name))};
+  out_stream.write(&header, sizeof(header));
+  out_stream.write(inner.name, header.name_length);
+  uint64_t end(0);
+  for(const StringStream& chunk : chunks) {
+    end += chunk.string().size();
+    out_stream.write(&end, sizeof(end));
+  }
+  for(const StringStream& chunk : chunks) {
+    out_stream.write(chunk.string().begin(), chunk.string().size());
+  }
+}
+bool L::chunked_decompress(const void* data, size_t size, Buffer& out) {
+  ChunkedView view;
+  if(!chunked_view(data, size, view)) {
+    return false;
+  }
+  Buffer buffer(size_t(view.header.size));
+  if(!chunked_decompress_range(data, size, 0, buffer.size(), buffer.data())) {
+    return false;
+  }
+  out = static_cast<Buffer&&>(buffer);
+  return true;
+}
+size_t L::chunked_size(const void* data, size_t size) {
+  ChunkedView view;
+  return chunked_view(data, size, view) ? size_t(view.header.size) : 0;
+}
+bool L::chunked_decompress_range(const void* data, size_t size, size_t offset, size_t length, void* dst) {
+  L_SCOPE_MARKER("Chunked decompress");
+  ChunkedView view;
+  if(!chunked_view(data, size, view) || offset + length > view.header.size) {
+    return false;
+  }
+  if(length == 0) {
+    return true;
+  }
+
+  // Only chunks overlapping the range are decompressed
+  const size_t chunk_size(view.header.chunk_size);
+  std::atomic<bool> failed(false);
+  TaskSystem::parallel_for(offset / chunk_size, (offset + length - 1) / chunk_size + 1, 1, [&](uintptr_t i) {
+    const uint64_t start(view.chunk_start(uint32_t(i)));
+    Buffer chunk;
+    const size_t chunk_offset(i * chunk_size);
+    if(!view.inner->decompress(view.chunks + start, size_t(view.chunk_end(uint32_t(i)) - start), chunk)
+       || chunk.size() != min<size_t>(chunk_size, size_t(view.header.size) - chunk_offset)) {
+      failed = true;
+      return;
+    }
+    // Copy the part of the chunk inside the range
+    const size_t copy_start(max(offset, chunk_offset)), copy_end(min(offset + length, chunk_offset + chunk.size()));
+    memcpy((uint8_t*)dst + (copy_start - offset), (const uint8_t*)chunk.data() + (copy_start - chunk_offset), copy_end - copy_start);
+  });
+  return !failed;
+}
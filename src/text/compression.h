@@ -7,7 +7,7 @@
 
 namespace L {
   typedef void CompressFunc(const void* data, size_t size, Stream& out_stream);
-  typedef Buffer DecompressFunc(const void* data, size_t size);
+  typedef bool DecompressFunc(const void* data, size_t size, Buffer& out); // Returns false if data is invalid
   struct Compression {
     Symbol name;
     CompressFunc* compress;
@@ -16,4 +16,16 @@ namespace L {
   void register_compression(const Compression&);
   const Compression& get_compression(const Symbol& name = "");
   const Array<Compression>& get_compressions();
+
+  // Tagged data starts with the name of the compression it was made with, so it can't be read with another one
+  void write_compression_tag(const Compression&, Stream& out_stream);
+  const Compression* read_compression_tag(const void*& data, size_t& size); // Skips the tag, null if missing or unknown
+
+  // Chunked container: chunks compressed independently by another compression, behind an index
+  // Chunks are compressed and decompressed in parallel and ranges can be decompressed on their own
+  static const size_t chunked_default_chunk_size = 1 << 18;
+  void chunked_compress(const Compression& inner, const void* data, size_t size, Stream& out_stream, size_t chunk_size = chunked_default_chunk_size);
+  bool chunked_decompress(const void* data, size_t size, Buffer& out);
+  size_t chunked_size(const void* data, size_t size); // Uncompressed size, zero if invalid
+  bool chunked_decompress_range(const void* data, size_t size, size_t offset, size_t length, void* dst);
 }